@@ -35,6 +35,46 @@ const char* ApiConstants::ERRORSTRING_INVALID_COMMIT_OFFSET_SIZE = "invalud comm
 const char* ApiConstants::ERRORSTRING_TOPIC_AUTH_FAILED = "topic auth failed";
 const char* ApiConstants::ERRORSTRING_GROUP_AUTHRIZATION_FAILED = "group auth failed";
 const char* ApiConstants::ERRORSTRING_CLUSTER_AUTH_FAILED = "cluster auth failed";
+const char* ApiConstants::ERRORSTRING_INVALID_TIMESTAMP = "invalid timestamp";
+const char* ApiConstants::ERRORSTRING_UNSUPPORTED_SASL_MECHANISM = "unsupported sasl mechanism";
+const char* ApiConstants::ERRORSTRING_ILLEGAL_SASL_STATE = "illegal sasl state";
+const char* ApiConstants::ERRORSTRING_UNSUPPORTED_VERSION = "unsupported version";
+const char* ApiConstants::ERRORSTRING_TOPIC_ALREADY_EXISTS = "topic already exists";
+const char* ApiConstants::ERRORSTRING_INVALID_PARTITIONS = "invalid partitions";
+const char* ApiConstants::ERRORSTRING_INVALID_REPLICATION_FACTOR = "invalid replication factor";
+const char* ApiConstants::ERRORSTRING_INVALID_REPLICA_ASSIGNMENT = "invalid replica assignment";
+const char* ApiConstants::ERRORSTRING_INVALID_CONFIG = "invalid config";
+const char* ApiConstants::ERRORSTRING_NOT_CONTROLLER = "not controller";
+const char* ApiConstants::ERRORSTRING_INVALID_REQUEST = "invalid request";
+const char* ApiConstants::ERRORSTRING_UNSUPPORTED_FOR_MESSAGE_FORMAT = "unsupported for message format";
+const char* ApiConstants::ERRORSTRING_POLICY_VIOLATION = "policy violation";
+const char* ApiConstants::ERRORSTRING_OUT_OF_ORDER_SEQUENCE_NUMBER = "out of order sequence number";
+const char* ApiConstants::ERRORSTRING_DUPLICATE_SEQUENCE_NUMBER = "duplicate sequence number";
+const char* ApiConstants::ERRORSTRING_INVALID_PRODUCER_EPOCH = "invalid producer epoch";
+const char* ApiConstants::ERRORSTRING_INVALID_TXN_STATE = "invalid transaction state";
+const char* ApiConstants::ERRORSTRING_INVALID_PRODUCER_ID_MAPPING = "invalid producer id mapping";
+const char* ApiConstants::ERRORSTRING_INVALID_TRANSACTION_TIMEOUT = "invalid transaction timeout";
+const char* ApiConstants::ERRORSTRING_CONCURRENT_TRANSACTIONS = "concurrent transactions";
+const char* ApiConstants::ERRORSTRING_TRANSACTION_COORDINATOR_FENCED = "transaction coordinator fenced";
+const char* ApiConstants::ERRORSTRING_TRANSACTIONAL_ID_AUTH_FAILED = "transactional id auth failed";
+const char* ApiConstants::ERRORSTRING_SECURITY_DISABLED = "security disabled";
+const char* ApiConstants::ERRORSTRING_OPERATION_NOT_ATTEMPTED = "operation not attempted";
+const char* ApiConstants::ERRORSTRING_KAFKA_STORAGE_ERROR = "kafka storage error";
+const char* ApiConstants::ERRORSTRING_LOG_DIR_NOT_FOUND = "log dir not found";
+const char* ApiConstants::ERRORSTRING_SASL_AUTHENTICATION_FAILED = "sasl authentication failed";
+const char* ApiConstants::ERRORSTRING_UNKNOWN_PRODUCER_ID = "unknown producer id";
+const char* ApiConstants::ERRORSTRING_REASSIGNMENT_IN_PROGRESS = "reassignment in progress";
+const char* ApiConstants::ERRORSTRING_DELEGATION_TOKEN_AUTH_DISABLED = "delegation token auth disabled";
+const char* ApiConstants::ERRORSTRING_DELEGATION_TOKEN_NOT_FOUND = "delegation token not found";
+const char* ApiConstants::ERRORSTRING_DELEGATION_TOKEN_OWNER_MISMATCH = "delegation token owner mismatch";
+const char* ApiConstants::ERRORSTRING_DELEGATION_TOKEN_REQUEST_NOT_ALLOWED = "delegation token request not allowed";
+const char* ApiConstants::ERRORSTRING_DELEGATION_TOKEN_AUTH_FAILED = "delegation token auth failed";
+const char* ApiConstants::ERRORSTRING_DELEGATION_TOKEN_EXPIRED = "delegation token expired";
+const char* ApiConstants::ERRORSTRING_INVALID_PRINCIPAL_TYPE = "invalid principal type";
+const char* ApiConstants::ERRORSTRING_NON_EMPTY_GROUP = "non empty group";
+const char* ApiConstants::ERRORSTRING_GROUP_ID_NOT_FOUND = "groupid not found";
+const char* ApiConstants::ERRORSTRING_FETCH_SESSION_ID_NOT_FOUND = "fetch session id not found";
+const char* ApiConstants::ERRORSTRING_INVALID_FETCH_SESSION_EPOCH = "invalid fetch session epoch";
 
 const char * ApiConstants::errorStringLookupTable[] = {
     ERRORSTRING_NO_ERROR,
@@ -69,6 +109,46 @@ const char * ApiConstants::errorStringLookupTable[] = {
     ERRORSTRING_TOPIC_AUTH_FAILED,
     ERRORSTRING_GROUP_AUTHRIZATION_FAILED,
     ERRORSTRING_CLUSTER_AUTH_FAILED,
+    ERRORSTRING_INVALID_TIMESTAMP,
+    ERRORSTRING_UNSUPPORTED_SASL_MECHANISM,
+    ERRORSTRING_ILLEGAL_SASL_STATE,
+    ERRORSTRING_UNSUPPORTED_VERSION,
+    ERRORSTRING_TOPIC_ALREADY_EXISTS,
+    ERRORSTRING_INVALID_PARTITIONS,
+    ERRORSTRING_INVALID_REPLICATION_FACTOR,
+    ERRORSTRING_INVALID_REPLICA_ASSIGNMENT,
+    ERRORSTRING_INVALID_CONFIG,
+    ERRORSTRING_NOT_CONTROLLER,
+    ERRORSTRING_INVALID_REQUEST,
+    ERRORSTRING_UNSUPPORTED_FOR_MESSAGE_FORMAT,
+    ERRORSTRING_POLICY_VIOLATION,
+    ERRORSTRING_OUT_OF_ORDER_SEQUENCE_NUMBER,
+    ERRORSTRING_DUPLICATE_SEQUENCE_NUMBER,
+    ERRORSTRING_INVALID_PRODUCER_EPOCH,
+    ERRORSTRING_INVALID_TXN_STATE,
+    ERRORSTRING_INVALID_PRODUCER_ID_MAPPING,
+    ERRORSTRING_INVALID_TRANSACTION_TIMEOUT,
+    ERRORSTRING_CONCURRENT_TRANSACTIONS,
+    ERRORSTRING_TRANSACTION_COORDINATOR_FENCED,
+    ERRORSTRING_TRANSACTIONAL_ID_AUTH_FAILED,
+    ERRORSTRING_SECURITY_DISABLED,
+    ERRORSTRING_OPERATION_NOT_ATTEMPTED,
+    ERRORSTRING_KAFKA_STORAGE_ERROR,
+    ERRORSTRING_LOG_DIR_NOT_FOUND,
+    ERRORSTRING_SASL_AUTHENTICATION_FAILED,
+    ERRORSTRING_UNKNOWN_PRODUCER_ID,
+    ERRORSTRING_REASSIGNMENT_IN_PROGRESS,
+    ERRORSTRING_DELEGATION_TOKEN_AUTH_DISABLED,
+    ERRORSTRING_DELEGATION_TOKEN_NOT_FOUND,
+    ERRORSTRING_DELEGATION_TOKEN_OWNER_MISMATCH,
+    ERRORSTRING_DELEGATION_TOKEN_REQUEST_NOT_ALLOWED,
+    ERRORSTRING_DELEGATION_TOKEN_AUTH_FAILED,
+    ERRORSTRING_DELEGATION_TOKEN_EXPIRED,
+    ERRORSTRING_INVALID_PRINCIPAL_TYPE,
+    ERRORSTRING_NON_EMPTY_GROUP,
+    ERRORSTRING_GROUP_ID_NOT_FOUND,
+    ERRORSTRING_FETCH_SESSION_ID_NOT_FOUND,
+    ERRORSTRING_INVALID_FETCH_SESSION_EPOCH,
 };
 
 const char* ApiConstants::getErrorString(int errorCode)
@@ -83,3 +163,43 @@ const char* ApiConstants::getErrorString(int errorCode)
 
     return errorStringLookupTable[errorCode];
 }
+
+int ApiConstants::firstFlexibleVersion(int apikey)
+{
+    switch(apikey) {
+    case PRODUCE_REQUEST_KEY: return 9;
+    case FETCH_REQUEST_KEY: return 12;
+    case LIST_OFFSET_REQUEST_KEY: return 6;
+    case METADATA_REQUEST_KEY: return 9;
+    case LEADER_AND_ISR_REQUEST_KEY: return 4;
+    case STOP_REPLICA_REQUEST_KEY: return 2;
+    case OFFSET_COMMIT_REQUEST_KEY: return 8;
+    case OFFSET_FETCH_REQUEST_KEY: return 6;
+    case GROUP_COORDINATOR_REQUEST_KEY: return 3;
+    case JOIN_GROUP_REQUEST_KEY: return 6;
+    case HEARTBEAT_REQUEST_KEY: return 4;
+    case LEAVE_GROUP_REQUEST_KEY: return 4;
+    case SYNC_GROUP_REQUEST_KEY: return 4;
+    case DESCRIBE_GROUPS_REQUEST_KEY: return 5;
+    case LIST_GROUPS_REQUEST_KEY: return 3;
+    case API_VERSIONS_REQUEST_KEY: return 3;
+    case INIT_PRODUCER_ID_REQUEST_KEY: return 2;
+    default: return -1;
+    }
+}
+
+bool ApiConstants::isFlexible(int apikey, int apiver)
+{
+    int first = firstFlexibleVersion(apikey);
+    return first >= 0 && apiver >= first;
+}
+
+int ApiConstants::requestHeaderVersion(int apikey, int apiver)
+{
+    return isFlexible(apikey, apiver) ? 2 : 1;
+}
+
+int ApiConstants::responseHeaderVersion(int apikey, int apiver)
+{
+    return isFlexible(apikey, apiver) && apikey != API_VERSIONS_REQUEST_KEY ? 1 : 0;
+}
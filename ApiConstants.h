@@ -7,6 +7,11 @@ public:
     const static int API_VERSION0 = 0;
     const static int API_VERSION1 = 1;
     const static int API_VERSION2 = 2;
+    const static int API_VERSION3 = 3;
+    const static int API_VERSION4 = 4;
+    const static int API_VERSION5 = 5;
+    const static int API_VERSION6 = 6;
+    const static int API_VERSION7 = 7;
 
     // API request key values
     const static int PRODUCE_REQUEST_KEY = 0;
@@ -26,6 +31,8 @@ public:
     const static int SYNC_GROUP_REQUEST_KEY = 14;
     const static int DESCRIBE_GROUPS_REQUEST_KEY = 15;
     const static int LIST_GROUPS_REQUEST_KEY = 16;
+    const static int API_VERSIONS_REQUEST_KEY = 18;
+    const static int INIT_PRODUCER_ID_REQUEST_KEY = 22;
 
     // Message compression attribute values
     const static signed char MESSAGE_COMPRESSION_NONE = 0x00;
@@ -66,9 +73,49 @@ public:
     const static int ERRORCODE_TOPIC_AUTH_FAILED = 29;
     const static int ERRORCODE_GROUP_AUTHRIZATION_FAILED = 30;
     const static int ERRORCODE_CLUSTER_AUTH_FAILED = 31;
+    const static int ERRORCODE_INVALID_TIMESTAMP = 32;
+    const static int ERRORCODE_UNSUPPORTED_SASL_MECHANISM = 33;
+    const static int ERRORCODE_ILLEGAL_SASL_STATE = 34;
+    const static int ERRORCODE_UNSUPPORTED_VERSION = 35;
+    const static int ERRORCODE_TOPIC_ALREADY_EXISTS = 36;
+    const static int ERRORCODE_INVALID_PARTITIONS = 37;
+    const static int ERRORCODE_INVALID_REPLICATION_FACTOR = 38;
+    const static int ERRORCODE_INVALID_REPLICA_ASSIGNMENT = 39;
+    const static int ERRORCODE_INVALID_CONFIG = 40;
+    const static int ERRORCODE_NOT_CONTROLLER = 41;
+    const static int ERRORCODE_INVALID_REQUEST = 42;
+    const static int ERRORCODE_UNSUPPORTED_FOR_MESSAGE_FORMAT = 43;
+    const static int ERRORCODE_POLICY_VIOLATION = 44;
+    const static int ERRORCODE_OUT_OF_ORDER_SEQUENCE_NUMBER = 45;
+    const static int ERRORCODE_DUPLICATE_SEQUENCE_NUMBER = 46;
+    const static int ERRORCODE_INVALID_PRODUCER_EPOCH = 47;
+    const static int ERRORCODE_INVALID_TXN_STATE = 48;
+    const static int ERRORCODE_INVALID_PRODUCER_ID_MAPPING = 49;
+    const static int ERRORCODE_INVALID_TRANSACTION_TIMEOUT = 50;
+    const static int ERRORCODE_CONCURRENT_TRANSACTIONS = 51;
+    const static int ERRORCODE_TRANSACTION_COORDINATOR_FENCED = 52;
+    const static int ERRORCODE_TRANSACTIONAL_ID_AUTH_FAILED = 53;
+    const static int ERRORCODE_SECURITY_DISABLED = 54;
+    const static int ERRORCODE_OPERATION_NOT_ATTEMPTED = 55;
+    const static int ERRORCODE_KAFKA_STORAGE_ERROR = 56;
+    const static int ERRORCODE_LOG_DIR_NOT_FOUND = 57;
+    const static int ERRORCODE_SASL_AUTHENTICATION_FAILED = 58;
+    const static int ERRORCODE_UNKNOWN_PRODUCER_ID = 59;
+    const static int ERRORCODE_REASSIGNMENT_IN_PROGRESS = 60;
+    const static int ERRORCODE_DELEGATION_TOKEN_AUTH_DISABLED = 61;
+    const static int ERRORCODE_DELEGATION_TOKEN_NOT_FOUND = 62;
+    const static int ERRORCODE_DELEGATION_TOKEN_OWNER_MISMATCH = 63;
+    const static int ERRORCODE_DELEGATION_TOKEN_REQUEST_NOT_ALLOWED = 64;
+    const static int ERRORCODE_DELEGATION_TOKEN_AUTH_FAILED = 65;
+    const static int ERRORCODE_DELEGATION_TOKEN_EXPIRED = 66;
+    const static int ERRORCODE_INVALID_PRINCIPAL_TYPE = 67;
+    const static int ERRORCODE_NON_EMPTY_GROUP = 68;
+    const static int ERRORCODE_GROUP_ID_NOT_FOUND = 69;
+    const static int ERRORCODE_FETCH_SESSION_ID_NOT_FOUND = 70;
+    const static int ERRORCODE_INVALID_FETCH_SESSION_EPOCH = 71;
 
     const static int ERRORCODE_MINIMUM = -1;
-    const static int ERRORCODE_MAXIMUM = 31;
+    const static int ERRORCODE_MAXIMUM = 71;
 
     // API error strings
     const static char* ERRORSTRING_NO_ERROR;
@@ -103,6 +150,46 @@ public:
     const static char* ERRORSTRING_TOPIC_AUTH_FAILED;
     const static char* ERRORSTRING_GROUP_AUTHRIZATION_FAILED;
     const static char* ERRORSTRING_CLUSTER_AUTH_FAILED;
+    const static char* ERRORSTRING_INVALID_TIMESTAMP;
+    const static char* ERRORSTRING_UNSUPPORTED_SASL_MECHANISM;
+    const static char* ERRORSTRING_ILLEGAL_SASL_STATE;
+    const static char* ERRORSTRING_UNSUPPORTED_VERSION;
+    const static char* ERRORSTRING_TOPIC_ALREADY_EXISTS;
+    const static char* ERRORSTRING_INVALID_PARTITIONS;
+    const static char* ERRORSTRING_INVALID_REPLICATION_FACTOR;
+    const static char* ERRORSTRING_INVALID_REPLICA_ASSIGNMENT;
+    const static char* ERRORSTRING_INVALID_CONFIG;
+    const static char* ERRORSTRING_NOT_CONTROLLER;
+    const static char* ERRORSTRING_INVALID_REQUEST;
+    const static char* ERRORSTRING_UNSUPPORTED_FOR_MESSAGE_FORMAT;
+    const static char* ERRORSTRING_POLICY_VIOLATION;
+    const static char* ERRORSTRING_OUT_OF_ORDER_SEQUENCE_NUMBER;
+    const static char* ERRORSTRING_DUPLICATE_SEQUENCE_NUMBER;
+    const static char* ERRORSTRING_INVALID_PRODUCER_EPOCH;
+    const static char* ERRORSTRING_INVALID_TXN_STATE;
+    const static char* ERRORSTRING_INVALID_PRODUCER_ID_MAPPING;
+    const static char* ERRORSTRING_INVALID_TRANSACTION_TIMEOUT;
+    const static char* ERRORSTRING_CONCURRENT_TRANSACTIONS;
+    const static char* ERRORSTRING_TRANSACTION_COORDINATOR_FENCED;
+    const static char* ERRORSTRING_TRANSACTIONAL_ID_AUTH_FAILED;
+    const static char* ERRORSTRING_SECURITY_DISABLED;
+    const static char* ERRORSTRING_OPERATION_NOT_ATTEMPTED;
+    const static char* ERRORSTRING_KAFKA_STORAGE_ERROR;
+    const static char* ERRORSTRING_LOG_DIR_NOT_FOUND;
+    const static char* ERRORSTRING_SASL_AUTHENTICATION_FAILED;
+    const static char* ERRORSTRING_UNKNOWN_PRODUCER_ID;
+    const static char* ERRORSTRING_REASSIGNMENT_IN_PROGRESS;
+    const static char* ERRORSTRING_DELEGATION_TOKEN_AUTH_DISABLED;
+    const static char* ERRORSTRING_DELEGATION_TOKEN_NOT_FOUND;
+    const static char* ERRORSTRING_DELEGATION_TOKEN_OWNER_MISMATCH;
+    const static char* ERRORSTRING_DELEGATION_TOKEN_REQUEST_NOT_ALLOWED;
+    const static char* ERRORSTRING_DELEGATION_TOKEN_AUTH_FAILED;
+    const static char* ERRORSTRING_DELEGATION_TOKEN_EXPIRED;
+    const static char* ERRORSTRING_INVALID_PRINCIPAL_TYPE;
+    const static char* ERRORSTRING_NON_EMPTY_GROUP;
+    const static char* ERRORSTRING_GROUP_ID_NOT_FOUND;
+    const static char* ERRORSTRING_FETCH_SESSION_ID_NOT_FOUND;
+    const static char* ERRORSTRING_INVALID_FETCH_SESSION_EPOCH;
 
     const static char* ERRORSTRING_INVALID_ERROR_CODE;
     const static char* ERRORSTRING_UNKNOWN;
@@ -110,6 +197,16 @@ public:
 public:
     static const char * errorStringLookupTable[];
     static const char *getErrorString(int errorCode);
+
+    // First flexible version of an API (KIP-482, Kafka 2.4+), -1 if there is
+    // none known. Flexible versions use compact strings and arrays and end
+    // every struct with tagged fields; their requests carry header v2 and
+    // their responses header v1, except ApiVersions whose response header
+    // stays v0 so any client can read it.
+    static int firstFlexibleVersion(int apikey);
+    static bool isFlexible(int apikey, int apiver);
+    static int requestHeaderVersion(int apikey, int apiver);
+    static int responseHeaderVersion(int apikey, int apiver);
 };
 
 }
@@ -0,0 +1,52 @@
+#include "ApiVersions.h"
+
+using namespace kafkaprotocpp;
+
+bool ApiVersionTable::update(const ApiVersionsResponse& res)
+{
+    if(res.errcode != ApiConstants::ERRORCODE_NO_ERROR)
+        return false;
+
+    m_ranges.clear();
+    for(auto& r : res.apiVersions) {
+        if(r.apikey < 0)
+            continue;
+        if((size_t)r.apikey >= m_ranges.size()) {
+            Range none = { -1, -1 };
+            m_ranges.resize(r.apikey + 1, none);
+        }
+        m_ranges[r.apikey].minver = r.minver;
+        m_ranges[r.apikey].maxver = r.maxver;
+    }
+    m_negotiated = true;
+    return true;
+}
+
+void ApiVersionTable::reset()
+{
+    m_ranges.clear();
+    m_negotiated = false;
+}
+
+bool ApiVersionTable::range(int apikey, int16_t& minver, int16_t& maxver) const
+{
+    if(apikey < 0 || (size_t)apikey >= m_ranges.size() || m_ranges[apikey].maxver < 0)
+        return false;
+    minver = m_ranges[apikey].minver;
+    maxver = m_ranges[apikey].maxver;
+    return true;
+}
+
+int16_t ApiVersionTable::pick(int apikey, int minver, int maxver, int fallback) const
+{
+    if(!m_negotiated)
+        return fallback;
+
+    int16_t bmin, bmax;
+    if(!range(apikey, bmin, bmax))
+        return -1;
+    int16_t ver = maxver < bmax ? maxver : bmax;
+    if(ver < minver || ver < bmin)
+        return -1;
+    return ver;
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "Packet.h"
+#include "Schema.h"
+#include "ApiConstants.h"
+
+namespace kafkaprotocpp {
+
+// v3 is the first flexible version (compact strings, tagged fields). A broker
+// without it answers UNSUPPORTED_VERSION in the v0 layout, listing the
+// versions it has, see ApiVersionsResponse::retryVersion().
+struct ApiVersionsRequest : public Marshallable
+{
+    enum { apikey = ApiConstants::API_VERSIONS_REQUEST_KEY, apiver = ApiConstants::API_VERSION3,
+        apiminver = ApiConstants::API_VERSION0, apimaxver = ApiConstants::API_VERSION3 };
+
+    std::string clientSoftwareName;    // v3+
+    std::string clientSoftwareVersion; // v3+
+
+    ApiVersionsRequest() : clientSoftwareName("kafkaprotocpp"), clientSoftwareVersion("1.0") {}
+
+    typedef Schema<
+        KAFKA_FIELD_V(ApiVersionsRequest, clientSoftwareName, 3, KAFKA_MAX_VER),
+        KAFKA_FIELD_V(ApiVersionsRequest, clientSoftwareVersion, 3, KAFKA_MAX_VER)> schema;
+
+    void marshal(Pack &pk) const
+    {
+        marshal(pk, apiver);
+    }
+
+    void marshal(Pack &pk, int ver) const
+    {
+        schema::encode(pk, *this, flexible_ver(apikey, ver));
+    }
+};
+
+struct ApiVersionRange : public Marshallable
+{
+    int16_t apikey;
+    int16_t minver;
+    int16_t maxver;
+
+    typedef Schema<
+        KAFKA_FIELD(ApiVersionRange, apikey),
+        KAFKA_FIELD(ApiVersionRange, minver),
+        KAFKA_FIELD(ApiVersionRange, maxver)> schema;
+
+    void unmarshal(const Unpack &up)
+    {
+        schema::decode(up, *this);
+    }
+};
+
+struct ApiVersionsResponse : public Marshallable
+{
+    int16_t errcode;
+    std::vector<ApiVersionRange> apiVersions;
+    int32_t throttleTime = 0; // v1+
+
+    typedef Schema<
+        KAFKA_FIELD(ApiVersionsResponse, errcode),
+        KAFKA_FIELD(ApiVersionsResponse, apiVersions),
+        KAFKA_FIELD_V(ApiVersionsResponse, throttleTime, 1, KAFKA_MAX_VER)> schema;
+
+    ApiVersionsResponse() : errcode(0) {}
+
+    void reset()
+    {
+        errcode = 0;
+        apiVersions.clear();
+        throttleTime = 0;
+    }
+
+    void unmarshal(const Unpack &up)
+    {
+        schema::decode(up, *this);
+    }
+
+    void unmarshal(const Unpack &up, int ver)
+    {
+        // UNSUPPORTED_VERSION comes in the v0 layout, whatever was asked
+        if(up.has(2) && load_be16(up.data()) == ApiConstants::ERRORCODE_UNSUPPORTED_VERSION)
+            ver = ApiConstants::API_VERSION0;
+        schema::decode(up, *this, flexible_ver(ApiConstants::API_VERSIONS_REQUEST_KEY, ver));
+    }
+
+    // After UNSUPPORTED_VERSION: the broker's highest ApiVersions version
+    // below ver to ask again with, v0 if it didn't list it (brokers before
+    // 2.4 send an empty list). -1 for any other outcome.
+    int16_t retryVersion(int ver) const
+    {
+        if(errcode != ApiConstants::ERRORCODE_UNSUPPORTED_VERSION)
+            return -1;
+        int16_t maxver = ApiConstants::API_VERSION0;
+        for(auto& r : apiVersions) {
+            if(r.apikey == ApiConstants::API_VERSIONS_REQUEST_KEY)
+                maxver = r.maxver;
+        }
+        return maxver >= 0 && maxver < ver ? maxver : -1;
+    }
+};
+
+// version range a request struct can encode: [apiminver, apimaxver] if it
+// declares them, otherwise just its apiver
+template <class T, class Enable = void>
+struct api_version_range
+{
+    enum { min = T::apiver, max = T::apiver };
+};
+
+template <class T>
+struct api_version_range<T, typename std::enable_if<sizeof(T::apimaxver) != 0>::type>
+{
+    enum { min = T::apiminver, max = T::apimaxver };
+};
+
+// The API versions one broker supports, from its ApiVersionsResponse.
+//
+// pick() gives the highest version both sides support, so a struct covering
+// several versions is encoded in the newest layout the broker understands.
+// Until a response was applied (or for brokers older than 0.10 that have no
+// ApiVersions) the struct's default apiver is used, as before.
+class ApiVersionTable
+{
+public:
+    ApiVersionTable() : m_negotiated(false) {}
+
+    // false if the response carries an error
+    bool update(const ApiVersionsResponse& res);
+    void reset();
+    bool negotiated() const { return m_negotiated; }
+
+    // the broker's range, false if it doesn't support apikey
+    bool range(int apikey, int16_t& minver, int16_t& maxver) const;
+
+    // highest version in [minver, maxver] the broker supports, fallback if
+    // not negotiated, -1 if there is none
+    int16_t pick(int apikey, int minver, int maxver, int fallback) const;
+
+    template <class Req>
+    int16_t pick() const
+    {
+        return pick(Req::apikey, api_version_range<Req>::min, api_version_range<Req>::max, Req::apiver);
+    }
+
+private:
+    struct Range
+    {
+        int16_t minver;
+        int16_t maxver; // -1 if unsupported
+    };
+
+    std::vector<Range> m_ranges; // indexed by apikey
+    bool m_negotiated;
+};
+
+}
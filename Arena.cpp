@@ -0,0 +1,83 @@
+#include "Arena.h"
+
+#include <stdlib.h>
+
+using namespace kafkaprotocpp;
+
+thread_local Arena* Arena::t_current = NULL;
+
+Arena::Arena(size_t blockSize) :
+    m_blockSize(blockSize), m_head(NULL), m_free(NULL), m_ptr(NULL), m_end(NULL), m_retired(0)
+{
+}
+
+Arena::~Arena()
+{
+    for(Block* list : { m_head, m_free }) {
+        while(list) {
+            Block* next = list->next;
+            free(list);
+            list = next;
+        }
+    }
+}
+
+void Arena::use(Block* b)
+{
+    if(m_head)
+        m_retired += m_ptr - m_head->data();
+    b->next = m_head;
+    m_head = b;
+    m_ptr = b->data();
+    m_end = m_ptr + b->size;
+}
+
+void* Arena::allocateSlow(size_t n, size_t align)
+{
+    size_t need = n + align;
+
+    // reuse a kept block if one is big enough
+    for(Block** pp = &m_free; *pp; pp = &(*pp)->next) {
+        if((*pp)->size >= need) {
+            Block* b = *pp;
+            *pp = b->next;
+            use(b);
+            return allocate(n, align);
+        }
+    }
+
+    size_t size = need > m_blockSize ? need : m_blockSize;
+    Block* b = (Block*)malloc(sizeof(Block) + size);
+    if(b == NULL)
+        throw std::bad_alloc();
+    b->size = size;
+    use(b);
+    return allocate(n, align);
+}
+
+void Arena::reset()
+{
+    while(m_head) {
+        Block* next = m_head->next;
+        m_head->next = m_free;
+        m_free = m_head;
+        m_head = next;
+    }
+    m_ptr = m_end = NULL;
+    m_retired = 0;
+}
+
+size_t Arena::used() const
+{
+    return m_retired + (m_head ? m_ptr - m_head->data() : 0);
+}
+
+size_t Arena::capacity() const
+{
+    size_t n = 0;
+    for(Block* list : { m_head, m_free }) {
+        for(Block* b = list; b; b = b->next)
+            n += b->size;
+    }
+    return n;
+}
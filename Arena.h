@@ -0,0 +1,117 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace kafkaprotocpp {
+
+// Monotonic bump allocator. Memory is only given back all at once by
+// reset(), which keeps the blocks for the next round, or by the destructor.
+class Arena
+{
+public:
+    explicit Arena(size_t blockSize = 64 * 1024);
+    ~Arena();
+
+    void* allocate(size_t n, size_t align)
+    {
+        uintptr_t p = ((uintptr_t)m_ptr + align - 1) & ~(uintptr_t)(align - 1);
+        if(p + n <= (uintptr_t)m_end) {
+            m_ptr = (char*)(p + n);
+            return (void*)p;
+        }
+        return allocateSlow(n, align);
+    }
+
+    // release everything allocated so far, keeping the blocks
+    void reset();
+
+    size_t used() const;     // bytes handed out since the last reset
+    size_t capacity() const; // bytes held in blocks
+
+    // the arena that default-constructed ArenaAllocators bind to on this thread
+    static Arena* current() { return t_current; }
+
+private:
+    friend class ArenaScope;
+
+    Arena(const Arena&);
+    Arena& operator = (const Arena&);
+
+    struct Block
+    {
+        Block* next;
+        size_t size;
+        char* data() { return (char*)(this + 1); }
+    };
+
+    void* allocateSlow(size_t n, size_t align);
+    void use(Block* b);
+
+    size_t m_blockSize;
+    Block* m_head;    // blocks in use, newest first
+    Block* m_free;    // blocks kept by reset()
+    char* m_ptr;
+    char* m_end;
+    size_t m_retired; // bytes used in blocks behind m_head
+
+    static thread_local Arena* t_current;
+};
+
+// Makes 'arena' the current arena of this thread for the scope's lifetime.
+class ArenaScope
+{
+public:
+    explicit ArenaScope(Arena& arena) : m_prev(Arena::t_current) { Arena::t_current = &arena; }
+    ~ArenaScope() { Arena::t_current = m_prev; }
+
+private:
+    ArenaScope(const ArenaScope&);
+    ArenaScope& operator = (const ArenaScope&);
+
+    Arena* m_prev;
+};
+
+// Allocator that binds, when default-constructed, to the current arena, so
+// containers created while decoding inside an ArenaScope (including vector
+// elements and their members) all allocate from it. deallocate() is a no-op
+// there. Without a current arena it falls back to the heap.
+template <class T>
+struct ArenaAllocator
+{
+    typedef T value_type;
+
+    Arena* arena;
+
+    ArenaAllocator() : arena(Arena::current()) {}
+    explicit ArenaAllocator(Arena* a) : arena(a) {}
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U>& o) : arena(o.arena) {}
+
+    T* allocate(size_t n)
+    {
+        if(arena)
+            return (T*)arena->allocate(n * sizeof(T), alignof(T));
+        return (T*)::operator new(n * sizeof(T));
+    }
+
+    void deallocate(T* p, size_t)
+    {
+        if(!arena)
+            ::operator delete(p);
+    }
+
+    template <class U>
+    bool operator == (const ArenaAllocator<U>& o) const { return arena == o.arena; }
+    template <class U>
+    bool operator != (const ArenaAllocator<U>& o) const { return arena != o.arena; }
+};
+
+template <class T>
+using ArenaVector = std::vector<T, ArenaAllocator<T> >;
+typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char> > ArenaString;
+
+}
@@ -0,0 +1,242 @@
+#pragma once
+
+#include "Arena.h"
+#include "MessageView.h"
+#include "KafkaMessage.h"
+#include "KafkaConsumerMessage.h"
+#include "Response.h"
+
+namespace kafkaprotocpp {
+
+// Response types whose whole object graph lives in an Arena.
+//
+// Every vector and string below uses ArenaAllocator, so when decoded inside an
+// ArenaScope all of their memory comes from one arena, and messages are
+// MessageViews pointing into the response frame. Freeing the graph is one
+// Arena::reset(). Use them through ArenaDecoded, which keeps the arena, the
+// frame and the decoded object together:
+//
+//     ArenaDecoded<ArenaFetchResponseV2> res;
+//     conn.SendRequest(FetchRequest::apikey, 2, req, res, res.frame());
+//     for(auto& t : res->result) ...
+
+struct ArenaMessageSet : public Marshallable
+{
+    int32_t size; // filled in by the enclosing unit, like MessageSet::size
+    ArenaVector<MessageView> messages;
+
+    ArenaMessageSet() : size(0) {}
+
+    void unmarshal(const Unpack &up)
+    {
+        const char* p = up.pop_fetch_ptr(size);
+        const char* end = p + size;
+        MessageView m;
+        while(m.decode(p, end))
+            messages.push_back(m);
+    }
+};
+
+// the fetch partition layout is FetchPartitionResponseUnitT's, kept in one place
+typedef FetchPartitionResponseUnitT<ArenaMessageSet> ArenaFetchPartition;
+
+struct ArenaFetchTopic : public Marshallable
+{
+    TopicName topic;
+    ArenaVector<ArenaFetchPartition> fetchParResult;
+
+    typedef Schema<
+        KAFKA_FIELD(ArenaFetchTopic, topic),
+        KAFKA_FIELD(ArenaFetchTopic, fetchParResult)> schema;
+};
+
+template <int Ver>
+struct ArenaFetchResponse : public Marshallable
+{
+    enum { apiver = Ver };
+
+    int32_t throttleTime;
+    ArenaVector<ArenaFetchTopic> result;
+
+    typedef Schema<
+        KAFKA_FIELD_V(ArenaFetchResponse, throttleTime, 1, KAFKA_MAX_VER),
+        KAFKA_FIELD(ArenaFetchResponse, result)> schema;
+
+    ArenaFetchResponse() : throttleTime(0) {}
+
+    virtual void unmarshal(const Unpack &up)
+    {
+        schema::decode(up, *this, Ver);
+    }
+};
+
+typedef ArenaFetchResponse<0> ArenaFetchResponseV0;
+typedef ArenaFetchResponse<1> ArenaFetchResponseV1;
+typedef ArenaFetchResponse<2> ArenaFetchResponseV2;
+
+// describe group, same wire layout as DescribeGroupResponse
+
+struct ArenaTopicPartitions : public Marshallable
+{
+    ArenaString topic;
+    ArenaVector<int32_t> partitions;
+};
+
+struct ArenaProtocolMetadata : public Marshallable
+{
+    int32_t size;
+    int16_t version;
+    ArenaVector<ArenaString> topics;
+    ArenaVector<ArenaTopicPartitions> oldSubs; // MemberSubToppars, int16 counts on the wire
+
+    ArenaProtocolMetadata() : size(0), version(0) {}
+
+    void unmarshal(const Unpack &up)
+    {
+        up >> size;
+        Unpack iup(up.pop_fetch_ptr(size), size);
+        FieldCodec<int16_t>::decode(iup, version, 0);
+        FieldCodec<ArenaVector<ArenaString> >::decode(iup, topics, 0);
+
+        int32_t subsSize = iup.pop_int32();
+        if(subsSize <= 0)
+            return;
+        for(int16_t cnt = iup.pop_int16(); cnt > 0; --cnt) {
+            oldSubs.emplace_back();
+            ArenaTopicPartitions& tp = oldSubs.back();
+            FieldCodec<ArenaString>::decode(iup, tp.topic, 0);
+            int16_t parn = iup.pop_int16();
+            tp.partitions.resize(parn > 0 ? parn : 0);
+            iup.pop_int32_array(tp.partitions.data(), tp.partitions.size());
+        }
+    }
+};
+
+struct ArenaTopicPartitionsBlock : public Marshallable
+{
+    ArenaString topic;
+    ArenaVector<int32_t> partitions;
+
+    typedef Schema<
+        KAFKA_FIELD(ArenaTopicPartitionsBlock, topic),
+        KAFKA_FIELD(ArenaTopicPartitionsBlock, partitions)> schema;
+};
+
+struct ArenaMemberAssignment : public Marshallable
+{
+    int32_t size;
+    int16_t version;
+    ArenaVector<ArenaTopicPartitionsBlock> topicAssign;
+    const char* userdata; // into the frame
+    int32_t userdataLen;
+
+    ArenaMemberAssignment() : size(0), version(0), userdata(NULL), userdataLen(0) {}
+
+    void unmarshal(const Unpack &up)
+    {
+        up >> size;
+        if(size <= 0)
+            return;
+
+        Unpack iup(up.pop_fetch_ptr(size), size);
+        FieldCodec<int16_t>::decode(iup, version, 0);
+        FieldCodec<ArenaVector<ArenaTopicPartitionsBlock> >::decode(iup, topicAssign, 0);
+        userdataLen = iup.pop_int32();
+        if(userdataLen > 0)
+            userdata = iup.pop_fetch_ptr(userdataLen);
+    }
+};
+
+struct ArenaGroupMember : public Marshallable
+{
+    ArenaString memberid;
+    ArenaString clientid;
+    ArenaString host;
+    ArenaProtocolMetadata protometa;
+    ArenaMemberAssignment assignment;
+
+    typedef Schema<
+        KAFKA_FIELD(ArenaGroupMember, memberid),
+        KAFKA_FIELD(ArenaGroupMember, clientid),
+        KAFKA_FIELD(ArenaGroupMember, host),
+        KAFKA_FIELD(ArenaGroupMember, protometa),
+        KAFKA_FIELD(ArenaGroupMember, assignment)> schema;
+};
+
+struct ArenaGroupInfo : public Marshallable
+{
+    int16_t errcode;
+    ArenaString groupid;
+    ArenaString state;
+    ArenaString prototype;
+    ArenaString proto;
+    ArenaVector<ArenaGroupMember> members;
+
+    typedef Schema<
+        KAFKA_FIELD(ArenaGroupInfo, errcode),
+        KAFKA_FIELD(ArenaGroupInfo, groupid),
+        KAFKA_FIELD(ArenaGroupInfo, state),
+        KAFKA_FIELD(ArenaGroupInfo, prototype),
+        KAFKA_FIELD(ArenaGroupInfo, proto),
+        KAFKA_FIELD(ArenaGroupInfo, members)> schema;
+};
+
+struct ArenaDescribeGroupResponse : public Marshallable
+{
+    ArenaVector<ArenaGroupInfo> groupInfos;
+
+    typedef Schema<KAFKA_FIELD(ArenaDescribeGroupResponse, groupInfos)> schema;
+
+    void unmarshal(const Unpack &up)
+    {
+        schema::decode(up, *this);
+    }
+};
+
+// Owns an arena, the response frame and one decoded T. Each unmarshal() drops
+// the previous object in one step and reuses the arena's blocks, so a steady
+// stream of responses of similar size stops allocating after the first few.
+template <class T>
+class ArenaDecoded : public Marshallable
+{
+public:
+    explicit ArenaDecoded(size_t blockSize = 64 * 1024) : m_arena(blockSize), m_obj(NULL) {}
+    ~ArenaDecoded() { clear(); }
+
+    // the frame to receive into, see Connection::SendRequest
+    ResponseBuffer& frame() { return m_frame; }
+
+    // decode from up, whose bytes must outlive the object
+    virtual void unmarshal(const Unpack &up)
+    {
+        clear();
+        ArenaScope scope(m_arena);
+        m_obj = new (m_arena.allocate(sizeof(T), alignof(T))) T();
+        m_obj->T::unmarshal(up);
+    }
+
+    void clear()
+    {
+        if(m_obj) {
+            m_obj->~T();
+            m_obj = NULL;
+        }
+        m_arena.reset();
+    }
+
+    T* get() const { return m_obj; }
+    T* operator->() const { return m_obj; }
+    T& operator*() const { return *m_obj; }
+
+    const Arena& arena() const { return m_arena; }
+
+private:
+    ArenaDecoded(const ArenaDecoded&);
+    ArenaDecoded& operator = (const ArenaDecoded&);
+
+    Arena m_arena;
+    ResponseBuffer m_frame;
+    T* m_obj;
+};
+
+}
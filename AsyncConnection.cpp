@@ -0,0 +1,326 @@
+#include "AsyncConnection.h"
+#include "Trace.h"
+
+#include <chrono>
+
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+using namespace kafkaprotocpp;
+
+static int64_t steadyMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+AsyncConnection::AsyncConnection(const std::string& clientid) :
+    m_clientid(clientid), m_fd(-1), m_connecting(false), m_dispatching(false), m_nextCtxid(1),
+    m_negotiate(true), m_requestTimeoutMs(40000), m_nextDeadline(0), m_outPos(0)
+{
+}
+
+AsyncConnection::~AsyncConnection()
+{
+    Close();
+}
+
+int AsyncConnection::Connect(const std::string& host, int port)
+{
+    Close();
+    m_versions.reset();
+
+    struct sockaddr_in addr;
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if(inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+        printf("bad address %s\n", host.c_str());
+        return -1;
+    }
+
+    m_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(m_fd < 0)
+        return -1;
+    fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) | O_NONBLOCK);
+    int one = 1;
+    setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if(connect(m_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        if(errno != EINPROGRESS) {
+            printf("connect %s:%d failed\n", host.c_str(), port);
+            close(m_fd);
+            m_fd = -1;
+            return -1;
+        }
+        m_connecting = true;
+    }
+    // queued ahead of anything the caller sends
+    if(m_negotiate)
+        Negotiate();
+    return 0;
+}
+
+void AsyncConnection::Close()
+{
+    if(m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+    }
+    m_connecting = false;
+    m_out.clear();
+    m_outPos = 0;
+    if(!m_dispatching)
+        m_in.clear();
+    m_nextDeadline = 0;
+
+    // handlers may send again (and fail again), so take the list first
+    std::map<int32_t, Pending> pending;
+    pending.swap(m_pending);
+    Unpack empty(NULL, 0);
+    for(auto& p : pending)
+        p.second.handler(-1, empty);
+}
+
+int32_t AsyncConnection::Send(int apikey, int apiver, Marshallable& req, Handler handler)
+{
+    if(m_fd < 0)
+        return -1;
+
+    int32_t ctxid = m_nextCtxid++;
+    if(m_nextCtxid < 0)
+        m_nextCtxid = 1;
+
+    Request out(ctxid, m_clientid, apikey, apiver, req);
+    m_out.insert(m_out.end(), out.data(), out.data() + out.size());
+
+    Pending& p = m_pending[ctxid];
+    p.apikey = apikey;
+    p.apiver = apiver;
+    p.deadline = m_requestTimeoutMs > 0 ? steadyMs() + m_requestTimeoutMs : 0;
+    p.handler = std::move(handler);
+    if(p.deadline && (m_nextDeadline == 0 || p.deadline < m_nextDeadline))
+        m_nextDeadline = p.deadline;
+    return ctxid;
+}
+
+int AsyncConnection::Expire()
+{
+    if(m_nextDeadline == 0)
+        return 0;
+    int64_t now = steadyMs();
+    if(now < m_nextDeadline)
+        return 0;
+
+    // answered requests may have held the earliest deadline, look again
+    int64_t next = 0;
+    for(auto& it : m_pending) {
+        int64_t deadline = it.second.deadline;
+        if(deadline == 0)
+            continue;
+        if(deadline <= now) {
+            // answers come in order, the ones behind it won't come either
+            int n = m_pending.size();
+            Close();
+            return n;
+        }
+        if(next == 0 || deadline < next)
+            next = deadline;
+    }
+    m_nextDeadline = next;
+    return 0;
+}
+
+int AsyncConnection::ExpireInMs() const
+{
+    if(m_nextDeadline == 0)
+        return -1;
+    int64_t left = m_nextDeadline - steadyMs();
+    return left > 0 ? (int)left : 0;
+}
+
+int32_t AsyncConnection::Negotiate(std::function<void(int err)> done)
+{
+    return Negotiate(ApiVersionsRequest::apiver, done);
+}
+
+// a broker that doesn't support apiver says so, then it is asked again at the
+// highest version it has
+int32_t AsyncConnection::Negotiate(int16_t apiver, std::function<void(int err)> done)
+{
+    ApiVersionsRequest req;
+    return Send(ApiVersionsRequest::apikey, apiver, req,
+            [this, apiver, done](int err, const Unpack& body) {
+                if(err == 0) {
+                    ApiVersionsResponse res;
+                    try {
+                        res.unmarshal(body, apiver);
+                        int16_t lower = res.retryVersion(apiver);
+                        if(lower >= 0 && Negotiate(lower, done) >= 0)
+                            return;
+                        err = m_versions.update(res) ? 0 : -1;
+                    } catch(const PacketError&) {
+                        err = -1;
+                    }
+                }
+                if(done)
+                    done(err);
+            });
+}
+
+short AsyncConnection::Events() const
+{
+    if(m_fd < 0)
+        return 0;
+    if(m_connecting || m_outPos < m_out.size())
+        return POLLIN | POLLOUT;
+    return POLLIN;
+}
+
+int AsyncConnection::Process(short revents)
+{
+    if(m_fd < 0)
+        return -1;
+
+    if(m_connecting && (revents & (POLLOUT | POLLERR | POLLHUP))) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(m_fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if(err != 0) {
+            Close();
+            return -1;
+        }
+        m_connecting = false;
+    }
+    if(m_connecting)
+        return 0;
+
+    if(revents & POLLERR) {
+        Close();
+        return -1;
+    }
+    if(m_outPos < m_out.size() && Flush() < 0) {
+        Close();
+        return -1;
+    }
+    if(revents & (POLLIN | POLLHUP))
+        return Receive();
+    return 0;
+}
+
+int AsyncConnection::Flush()
+{
+    while(m_outPos < m_out.size()) {
+        ssize_t len = write(m_fd, m_out.data() + m_outPos, m_out.size() - m_outPos);
+        if(len < 0) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if(errno == EINTR)
+                continue;
+            return -1;
+        }
+        m_outPos += len;
+    }
+    if(m_outPos == m_out.size()) {
+        m_out.clear();
+        m_outPos = 0;
+    }
+    return 0;
+}
+
+int AsyncConnection::Receive()
+{
+    bool closed = false;
+    for(;;) {
+        size_t old = m_in.size();
+        m_in.resize(old + 64 * 1024);
+        ssize_t len = read(m_fd, m_in.data() + old, 64 * 1024);
+        m_in.resize(old + (len > 0 ? len : 0));
+        if(len > 0)
+            continue;
+        if(len == 0)
+            closed = true;
+        else if(errno == EINTR)
+            continue;
+        else if(errno != EAGAIN && errno != EWOULDBLOCK)
+            closed = true;
+        break;
+    }
+
+    // hand out every complete frame
+    int handled = 0;
+    size_t pos = 0;
+    while(m_in.size() - pos >= 8) {
+        int32_t size = load_be32(m_in.data() + pos);
+        if(size < 4) {
+            closed = true;
+            break;
+        }
+        if(m_in.size() - pos - 4 < (size_t)size)
+            break;
+
+        int32_t ctxid = load_be32(m_in.data() + pos + 4);
+        auto it = m_pending.find(ctxid);
+        if(it != m_pending.end()) {
+            Pending p = std::move(it->second);
+            m_pending.erase(it);
+            KAFKA_TRACE(ctxid, p.apikey, TRACE_FRAME_DONE);
+            // decoded straight from the read buffer, which Send() doesn't touch
+            // and Close() leaves alone while m_dispatching
+            Unpack body(m_in.data() + pos + 8, size - 4);
+            int err = 0;
+            if(ApiConstants::responseHeaderVersion(p.apikey, p.apiver) >= 1) {
+                try {
+                    body.skip_tagged_fields();
+                } catch(const PacketError&) {
+                    err = -1;
+                    body.reset(NULL, 0);
+                }
+            }
+            m_dispatching = true;
+            p.handler(err, body);
+            m_dispatching = false;
+            pos += 4 + size;
+            KAFKA_TRACE(ctxid, p.apikey, TRACE_DECODE_DONE);
+            ++handled;
+            if(m_fd < 0) { // closed by the handler
+                m_in.clear();
+                return handled;
+            }
+        } else {
+            pos += 4 + size; // nobody waits for it
+        }
+    }
+    m_in.erase(m_in.begin(), m_in.begin() + pos);
+
+    if(closed) {
+        Close();
+        return -1;
+    }
+    return handled;
+}
+
+int AsyncConnection::Poll(int timeoutMs)
+{
+    if(m_fd < 0)
+        return -1;
+    int expireIn = ExpireInMs();
+    if(expireIn >= 0 && (timeoutMs < 0 || expireIn < timeoutMs))
+        timeoutMs = expireIn;
+    struct pollfd pfd;
+    pfd.fd = m_fd;
+    pfd.events = Events();
+    pfd.revents = 0;
+    int ret = poll(&pfd, 1, timeoutMs);
+    if(ret < 0)
+        return errno == EINTR ? 0 : -1;
+    if(ret > 0 && Process(pfd.revents) < 0)
+        return -1;
+    return Expire() > 0 ? -1 : ret;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "Packet.h"
+#include "Request.h"
+#include "ApiVersions.h"
+
+#include <functional>
+#include <map>
+#include <vector>
+
+namespace kafkaprotocpp {
+
+// Non-blocking connection for an event loop.
+//
+// Send() encodes the request, queues it and returns at once; the handler runs
+// from Process() when the response with the same correlation id (ctxid)
+// arrives, with the response body (after size and ctxid) to decode. Any
+// number of requests may be outstanding. Drive it either by adding Fd() with
+// Events() to the caller's own poll/epoll set and calling Process() with the
+// returned events, or with Poll() for a loop that only has this connection.
+//
+// Every request has a deadline, RequestTimeout() after it was sent. A broker
+// that is past it without an answer is taken as stuck: the connection is closed
+// and all outstanding handlers get -1. Poll() checks deadlines itself; an own
+// loop calls Expire() and waits at most ExpireInMs().
+class AsyncConnection
+{
+public:
+    // err is 0 with the body, or -1 with an empty body if the connection
+    // failed before the response came; body is only valid during the call
+    typedef std::function<void(int err, const Unpack& body)> Handler;
+
+    explicit AsyncConnection(const std::string& clientid = "kafkaprotocpp");
+    ~AsyncConnection();
+
+    // starts connecting, Send() may be called right away; with negotiation
+    // on, an ApiVersionsRequest goes out first
+    int Connect(const std::string& host, int port);
+    // fails every outstanding request
+    void Close();
+
+    // returns the ctxid, or -1 if not connected
+    int32_t Send(int apikey, int apiver, Marshallable& req, Handler handler);
+
+    // queue an ApiVersionsRequest; Versions() is filled in when it returns and
+    // done (if any) gets 0, or -1 if it failed. Requests sent before that use
+    // their default versions.
+    int32_t Negotiate(std::function<void(int err)> done = std::function<void(int)>());
+    const ApiVersionTable& Versions() const { return m_versions; }
+    // Negotiate() on every Connect(); on by default. Brokers before 0.10
+    // close the connection on an ApiVersionsRequest, turn it off for them.
+    void SetNegotiate(bool on) { m_negotiate = on; }
+
+    // ms from Send() to the answer, 0 for no deadline; applies to requests
+    // sent afterwards. 40 s by default, more than a request that waits on the
+    // broker side (a produce's ack timeout, a fetch's max wait) should ask for.
+    void SetRequestTimeout(int timeoutMs) { m_requestTimeoutMs = timeoutMs; }
+    int RequestTimeout() const { return m_requestTimeoutMs; }
+    // close the connection if a request is overdue, failing every outstanding
+    // one; returns the number failed
+    int Expire();
+    // ms until the earliest deadline, -1 if there is none
+    int ExpireInMs() const;
+
+    int Fd() const { return m_fd; }
+    short Events() const;        // POLLIN, plus POLLOUT while there is something to write
+    int Process(short revents);  // responses handled, -1 if the connection failed
+
+    // wait up to timeoutMs for this connection and process it
+    int Poll(int timeoutMs);
+
+    bool Connected() const { return m_fd >= 0 && !m_connecting; }
+    size_t Outstanding() const { return m_pending.size(); }
+
+private:
+    AsyncConnection(const AsyncConnection&);
+    AsyncConnection& operator = (const AsyncConnection&);
+
+    struct Pending
+    {
+        int16_t apikey;
+        int16_t apiver;
+        int64_t deadline; // steady clock ms, 0 for none
+        Handler handler;
+    };
+
+    int32_t Negotiate(int16_t apiver, std::function<void(int err)> done);
+
+    int Flush();
+    int Receive();
+
+    std::string m_clientid;
+    int m_fd;
+    bool m_connecting;
+    bool m_dispatching;
+    int32_t m_nextCtxid;
+    bool m_negotiate;
+    int m_requestTimeoutMs;
+    int64_t m_nextDeadline;  // at or before the earliest pending deadline, 0 for none
+
+    std::vector<char> m_out; // encoded requests not yet written
+    size_t m_outPos;
+    std::vector<char> m_in;  // bytes read, possibly a partial frame at the end
+    std::map<int32_t, Pending> m_pending;
+    ApiVersionTable m_versions; // of the broker connected to
+};
+
+}
@@ -87,6 +87,7 @@ public:
 	bool resize(size_t n, char c=0);
 	bool reserve(size_t n);
 	bool append(const char * app, size_t len);
+	char * extend(size_t len); // grow by len bytes left uninitialized, NULL on overflow
 	bool replace(size_t pos, const char * rep, size_t n);
 	void erase(size_t pos=0, size_t n=npos, bool hold=false);
 
@@ -144,6 +145,16 @@ inline bool BlockBuffer<BlockAllocator, MaxBlocks >::append(const char * app, si
 	return false;
 }
 
+template <typename BlockAllocator, unsigned MaxBlocks>
+inline char * BlockBuffer<BlockAllocator, MaxBlocks >::extend(size_t len)
+{
+	if (!increase_capacity(len))
+		return NULL;
+	char * p = tail();
+	m_size += len;
+	return p;
+}
+
 template <typename BlockAllocator, unsigned MaxBlocks>
 inline bool BlockBuffer<BlockAllocator, MaxBlocks >::reserve(size_t n)
 {
@@ -0,0 +1,129 @@
+#include "BrokerPool.h"
+
+#include <errno.h>
+
+using namespace kafkaprotocpp;
+
+BrokerPool::BrokerPool(const std::string& clientid) : m_clientid(clientid), m_next(0), m_requestTimeoutMs(40000), m_negotiate(true)
+{
+}
+
+BrokerPool::~BrokerPool()
+{
+}
+
+void BrokerPool::addBroker(int32_t nodeid, const std::string& host, int32_t port)
+{
+    Node& node = m_nodes[nodeid];
+    if(node.host == host && node.port == port)
+        return;
+    node.host = host;
+    node.port = port;
+    if(node.conn)
+        node.conn->Close();
+}
+
+void BrokerPool::setBrokers(const MetadataSnapshot& snap)
+{
+    for(auto& it : snap.brokers)
+        addBroker(it.first, it.second.host, it.second.port);
+}
+
+AsyncConnection* BrokerPool::get(int32_t nodeid)
+{
+    auto it = m_nodes.find(nodeid);
+    if(it == m_nodes.end())
+        return NULL;
+    Node& node = it->second;
+    if(!node.conn) {
+        node.conn.reset(new AsyncConnection(m_clientid));
+        node.conn->SetRequestTimeout(m_requestTimeoutMs);
+    }
+    node.conn->SetNegotiate(m_negotiate);
+    if(node.conn->Fd() < 0 && node.conn->Connect(node.host, node.port) < 0)
+        return NULL;
+    return node.conn.get();
+}
+
+AsyncConnection* BrokerPool::any()
+{
+    if(m_nodes.empty())
+        return NULL;
+    // prefer a broker we are already connected to
+    for(auto& it : m_nodes) {
+        if(it.second.conn && it.second.conn->Fd() >= 0)
+            return it.second.conn.get();
+    }
+    for(size_t i = 0; i < m_nodes.size(); ++i) {
+        auto it = m_nodes.begin();
+        std::advance(it, m_next++ % m_nodes.size());
+        AsyncConnection* conn = get(it->first);
+        if(conn)
+            return conn;
+    }
+    return NULL;
+}
+
+void BrokerPool::setRequestTimeout(int timeoutMs)
+{
+    m_requestTimeoutMs = timeoutMs;
+    for(auto& it : m_nodes) {
+        if(it.second.conn)
+            it.second.conn->SetRequestTimeout(timeoutMs);
+    }
+}
+
+void BrokerPool::setNegotiate(bool on)
+{
+    m_negotiate = on;
+}
+
+int BrokerPool::poll(int timeoutMs)
+{
+    m_fds.clear();
+    m_polled.clear();
+    for(auto& it : m_nodes) {
+        AsyncConnection* conn = it.second.conn.get();
+        if(!conn || conn->Fd() < 0)
+            continue;
+        // wake up for the earliest deadline
+        int expireIn = conn->ExpireInMs();
+        if(expireIn >= 0 && (timeoutMs < 0 || expireIn < timeoutMs))
+            timeoutMs = expireIn;
+        struct pollfd pfd;
+        pfd.fd = conn->Fd();
+        pfd.events = conn->Events();
+        pfd.revents = 0;
+        m_fds.push_back(pfd);
+        m_polled.push_back(conn);
+    }
+    if(m_fds.empty())
+        return 0;
+
+    int ret = ::poll(m_fds.data(), m_fds.size(), timeoutMs);
+    if(ret < 0 && errno != EINTR)
+        return -1;
+
+    int handled = 0;
+    for(size_t i = 0; ret > 0 && i < m_fds.size(); ++i) {
+        if(m_fds[i].revents == 0)
+            continue;
+        int n = m_polled[i]->Process(m_fds[i].revents);
+        if(n > 0)
+            handled += n;
+    }
+    // handlers may have connected more, those have no deadline passed yet
+    for(size_t i = 0; i < m_polled.size(); ++i)
+        handled += m_polled[i]->Expire();
+    return handled;
+}
+
+size_t BrokerPool::outstanding() const
+{
+    size_t n = 0;
+    for(auto& it : m_nodes) {
+        if(it.second.conn)
+            n += it.second.conn->Outstanding();
+    }
+    return n;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "AsyncConnection.h"
+#include "MetadataCache.h"
+
+#include <map>
+#include <memory>
+#include <poll.h>
+
+namespace kafkaprotocpp {
+
+// One AsyncConnection per broker, opened on first use, polled together.
+//
+// Requests for different brokers go out and complete concurrently from a
+// single thread: send on get(nodeid), then poll() until the handlers ran.
+// poll() also expires requests a broker has left unanswered for too long (see
+// AsyncConnection), so every handler runs eventually.
+class BrokerPool
+{
+public:
+    explicit BrokerPool(const std::string& clientid = "kafkaprotocpp");
+    ~BrokerPool();
+
+    // a changed address closes the old connection
+    void addBroker(int32_t nodeid, const std::string& host, int32_t port);
+    void setBrokers(const MetadataSnapshot& snap);
+
+    // connection to the broker, connecting if needed; NULL if the broker is
+    // unknown or the connect failed right away
+    AsyncConnection* get(int32_t nodeid);
+    // some broker, for requests any broker can answer
+    AsyncConnection* any();
+
+    // for every connection, see AsyncConnection::SetRequestTimeout()
+    void setRequestTimeout(int timeoutMs);
+    // from each connection's next connect, see AsyncConnection::SetNegotiate()
+    void setNegotiate(bool on);
+
+    // wait up to timeoutMs for any connection, returns the handlers run,
+    // including those of expired requests
+    int poll(int timeoutMs);
+    size_t outstanding() const;
+
+private:
+    BrokerPool(const BrokerPool&);
+    BrokerPool& operator = (const BrokerPool&);
+
+    struct Node
+    {
+        std::string host;
+        int32_t port;
+        std::unique_ptr<AsyncConnection> conn;
+
+        Node() : port(0) {}
+    };
+
+    std::string m_clientid;
+    std::map<int32_t, Node> m_nodes;
+    size_t m_next; // round robin for any()
+    int m_requestTimeoutMs;
+    bool m_negotiate;
+    std::vector<struct pollfd> m_fds;
+    std::vector<AsyncConnection*> m_polled;
+};
+
+}
@@ -0,0 +1,182 @@
+#include "ByteSwap.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KAFKA_X86_KERNELS 1
+#endif
+
+using namespace kafkaprotocpp;
+
+namespace {
+
+typedef void (*SwapFn)(char* dst, const char* src, size_t n);
+
+// every kernel reverses the bytes of each W-byte element, which is both the
+// load (wire -> host) and the store (host -> wire) direction
+
+template <class U, U (*Swap)(U)>
+void swap_scalar(char* dst, const char* src, size_t n)
+{
+    for(size_t i = 0; i < n; ++i) {
+        U v;
+        memcpy(&v, src + i * sizeof(U), sizeof(U));
+        v = Swap(v);
+        memcpy(dst + i * sizeof(U), &v, sizeof(U));
+    }
+}
+
+void swap16_scalar(char* dst, const char* src, size_t n) { swap_scalar<uint16_t, bswap16>(dst, src, n); }
+void swap32_scalar(char* dst, const char* src, size_t n) { swap_scalar<uint32_t, bswap32>(dst, src, n); }
+void swap64_scalar(char* dst, const char* src, size_t n) { swap_scalar<uint64_t, bswap64>(dst, src, n); }
+
+#ifdef KAFKA_X86_KERNELS
+
+// pshufb masks reversing each 2/4/8-byte lane of a 16-byte block
+#define MASK16 14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1
+#define MASK32 12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3
+#define MASK64 8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7
+
+__attribute__((target("ssse3")))
+void swap_ssse3(char* dst, const char* src, size_t bytes, __m128i mask, size_t width, SwapFn tail)
+{
+    size_t i = 0;
+    for(; i + 16 <= bytes; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_shuffle_epi8(v, mask));
+    }
+    tail(dst + i, src + i, (bytes - i) / width);
+}
+
+__attribute__((target("ssse3")))
+void swap16_ssse3(char* dst, const char* src, size_t n)
+{
+    swap_ssse3(dst, src, n * 2, _mm_set_epi8(MASK16), 2, swap16_scalar);
+}
+
+__attribute__((target("ssse3")))
+void swap32_ssse3(char* dst, const char* src, size_t n)
+{
+    swap_ssse3(dst, src, n * 4, _mm_set_epi8(MASK32), 4, swap32_scalar);
+}
+
+__attribute__((target("ssse3")))
+void swap64_ssse3(char* dst, const char* src, size_t n)
+{
+    swap_ssse3(dst, src, n * 8, _mm_set_epi8(MASK64), 8, swap64_scalar);
+}
+
+__attribute__((target("avx2")))
+void swap_avx2(char* dst, const char* src, size_t bytes, __m256i mask, size_t width, SwapFn tail)
+{
+    size_t i = 0;
+    for(; i + 64 <= bytes; i += 64) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(src + i + 32));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_shuffle_epi8(a, mask));
+        _mm256_storeu_si256((__m256i*)(dst + i + 32), _mm256_shuffle_epi8(b, mask));
+    }
+    for(; i + 32 <= bytes; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(src + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_shuffle_epi8(a, mask));
+    }
+    tail(dst + i, src + i, (bytes - i) / width);
+}
+
+__attribute__((target("avx2")))
+void swap16_avx2(char* dst, const char* src, size_t n)
+{
+    swap_avx2(dst, src, n * 2, _mm256_set_epi8(MASK16, MASK16), 2, swap16_scalar);
+}
+
+__attribute__((target("avx2")))
+void swap32_avx2(char* dst, const char* src, size_t n)
+{
+    swap_avx2(dst, src, n * 4, _mm256_set_epi8(MASK32, MASK32), 4, swap32_scalar);
+}
+
+__attribute__((target("avx2")))
+void swap64_avx2(char* dst, const char* src, size_t n)
+{
+    swap_avx2(dst, src, n * 8, _mm256_set_epi8(MASK64, MASK64), 8, swap64_scalar);
+}
+
+#endif
+
+struct Kernels
+{
+    const char* name;
+    SwapFn swap16;
+    SwapFn swap32;
+    SwapFn swap64;
+};
+
+const Kernels& kernels()
+{
+    static const Kernels s_kernels = []() {
+#ifdef KAFKA_X86_KERNELS
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2")) {
+            Kernels k = { "avx2", swap16_avx2, swap32_avx2, swap64_avx2 };
+            return k;
+        }
+        if(__builtin_cpu_supports("ssse3")) {
+            Kernels k = { "ssse3", swap16_ssse3, swap32_ssse3, swap64_ssse3 };
+            return k;
+        }
+#endif
+        Kernels k = { "scalar", swap16_scalar, swap32_scalar, swap64_scalar };
+        return k;
+    }();
+    return s_kernels;
+}
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+inline void swap16(char* dst, const char* src, size_t n) { memcpy(dst, src, n * 2); }
+inline void swap32(char* dst, const char* src, size_t n) { memcpy(dst, src, n * 4); }
+inline void swap64(char* dst, const char* src, size_t n) { memcpy(dst, src, n * 8); }
+#else
+inline void swap16(char* dst, const char* src, size_t n) { kernels().swap16(dst, src, n); }
+inline void swap32(char* dst, const char* src, size_t n) { kernels().swap32(dst, src, n); }
+inline void swap64(char* dst, const char* src, size_t n) { kernels().swap64(dst, src, n); }
+#endif
+
+}
+
+void kafkaprotocpp::load_be16_array(int16_t* dst, const char* src, size_t n)
+{
+    swap16((char*)dst, src, n);
+}
+
+void kafkaprotocpp::load_be32_array(int32_t* dst, const char* src, size_t n)
+{
+    swap32((char*)dst, src, n);
+}
+
+void kafkaprotocpp::load_be64_array(int64_t* dst, const char* src, size_t n)
+{
+    swap64((char*)dst, src, n);
+}
+
+void kafkaprotocpp::store_be16_array(char* dst, const int16_t* src, size_t n)
+{
+    swap16(dst, (const char*)src, n);
+}
+
+void kafkaprotocpp::store_be32_array(char* dst, const int32_t* src, size_t n)
+{
+    swap32(dst, (const char*)src, n);
+}
+
+void kafkaprotocpp::store_be64_array(char* dst, const int64_t* src, size_t n)
+{
+    swap64(dst, (const char*)src, n);
+}
+
+const char* kafkaprotocpp::byteswap_kernel()
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return "none";
+#else
+    return kernels().name;
+#endif
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+
+namespace kafkaprotocpp {
+
+// Well-defined unaligned big-endian loads/stores; memcpy compiles to a single
+// mov (plus bswap) on targets that allow unaligned access.
+
+inline uint16_t bswap16(uint16_t v) { return __builtin_bswap16(v); }
+inline uint32_t bswap32(uint32_t v) { return __builtin_bswap32(v); }
+inline uint64_t bswap64(uint64_t v) { return __builtin_bswap64(v); }
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+inline uint16_t be16(uint16_t v) { return v; }
+inline uint32_t be32(uint32_t v) { return v; }
+inline uint64_t be64(uint64_t v) { return v; }
+#else
+inline uint16_t be16(uint16_t v) { return bswap16(v); }
+inline uint32_t be32(uint32_t v) { return bswap32(v); }
+inline uint64_t be64(uint64_t v) { return bswap64(v); }
+#endif
+
+inline int16_t load_be16(const void* p)
+{
+    uint16_t v;
+    memcpy(&v, p, 2);
+    return (int16_t)be16(v);
+}
+
+inline int32_t load_be32(const void* p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return (int32_t)be32(v);
+}
+
+inline int64_t load_be64(const void* p)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return (int64_t)be64(v);
+}
+
+inline void store_be16(void* p, int16_t v)
+{
+    uint16_t u = be16((uint16_t)v);
+    memcpy(p, &u, 2);
+}
+
+inline void store_be32(void* p, int32_t v)
+{
+    uint32_t u = be32((uint32_t)v);
+    memcpy(p, &u, 4);
+}
+
+inline void store_be64(void* p, int64_t v)
+{
+    uint64_t u = be64((uint64_t)v);
+    memcpy(p, &u, 8);
+}
+
+// Bulk conversion between big-endian wire arrays and host arrays. src and dst
+// may have any alignment but must not overlap. The kernel (AVX2, SSSE3 or
+// scalar) is picked once at runtime from what the CPU supports.
+void load_be16_array(int16_t* dst, const char* src, size_t n);
+void load_be32_array(int32_t* dst, const char* src, size_t n);
+void load_be64_array(int64_t* dst, const char* src, size_t n);
+void store_be16_array(char* dst, const int16_t* src, size_t n);
+void store_be32_array(char* dst, const int32_t* src, size_t n);
+void store_be64_array(char* dst, const int64_t* src, size_t n);
+
+// name of the kernel in use: "avx2", "ssse3" or "scalar"
+const char* byteswap_kernel();
+
+}
@@ -1,4 +1,5 @@
 #include "Connection.h"
+#include "Trace.h"
 
 #include <stdio.h>
 #include <unistd.h>
@@ -25,7 +26,7 @@ static int send_request(int skfd, const char* data, size_t size)
     return 0;
 }
 
-static char* read_response(int skfd)
+static char* read_response(int skfd, int32_t ctxid, int16_t apikey)
 {
     // read response
     int size = 0;
@@ -35,6 +36,7 @@ static char* read_response(int skfd)
         return NULL;
     }
     size = htonl(size);
+    KAFKA_TRACE(ctxid, apikey, TRACE_FIRST_BYTE);
 
     int n = 0;
     char* buffer = (char*)malloc(size+4);
@@ -48,6 +50,7 @@ static char* read_response(int skfd)
         }
         n += len;
     }
+    KAFKA_TRACE(ctxid, apikey, TRACE_FRAME_DONE);
     return buffer;
 
 err:
@@ -79,14 +82,48 @@ int Connection::Connect(const std::string& host, int port)
 }
 
 int Connection::SendRequest(int apikey, int apiver, kafkaprotocpp::Marshallable& req, kafkaprotocpp::Marshallable& res)
+{
+    kafkaprotocpp::ResponseBuffer frame;
+    return SendRequest(apikey, apiver, req, res, frame);
+}
+
+int Connection::SendRequest(int apikey, int apiver, kafkaprotocpp::Marshallable& req, kafkaprotocpp::Marshallable& res,
+        kafkaprotocpp::ResponseBuffer& frame)
+{
+    if(sockfd <= 0) {
+        return -1;
+    }
+
+    const int32_t ctxid = 1;
+    kafkaprotocpp::Request outreq(ctxid, "inner_test", apikey, apiver, req);
+    return Roundtrip(ctxid, apikey, outreq.data(), outreq.size(), res, frame);
+}
+
+int Connection::SendFrame(int apikey, const char* data, size_t size, kafkaprotocpp::Marshallable& res)
+{
+    kafkaprotocpp::ResponseBuffer frame;
+    return SendFrame(apikey, data, size, res, frame);
+}
+
+int Connection::SendFrame(int apikey, const char* data, size_t size, kafkaprotocpp::Marshallable& res,
+        kafkaprotocpp::ResponseBuffer& frame)
 {
     if(sockfd <= 0) {
         return -1;
     }
+    if(size < 12)
+        return -1;
+
+    int32_t ctxid = kafkaprotocpp::load_be32(data + 8);
+    return Roundtrip(ctxid, apikey, data, size, res, frame);
+}
 
-    kafkaprotocpp::Request outreq(1, "inner_test", apikey, apiver, req);
-    if(send_request(sockfd, outreq.data(), outreq.size()) < 0)
+int Connection::Roundtrip(int32_t ctxid, int apikey, const char* data, size_t size,
+        kafkaprotocpp::Marshallable& res, kafkaprotocpp::ResponseBuffer& frame)
+{
+    if(send_request(sockfd, data, size) < 0)
         return -1;
+    KAFKA_TRACE(ctxid, apikey, TRACE_WRITE_DONE);
 
     struct timeval tv;
     tv.tv_sec = 5;
@@ -102,19 +139,38 @@ int Connection::SendRequest(int apikey, int apiver, kafkaprotocpp::Marshallable&
         return -1;
     }
 
-    auto buf = read_response(sockfd);
-    auto len = kafkaprotocpp::Response::peeklen(buf);
+    auto buf = read_response(sockfd, ctxid, apikey);
     if(buf == NULL)
         return -1;
+    auto len = kafkaprotocpp::Response::peeklen(buf);
+    frame.reset(buf, len);
 
     kafkaprotocpp::Response resp(buf, len);
-    resp.head();
-    res.unmarshal(resp.up);
-    free(buf);
+    int16_t apiver = kafkaprotocpp::load_be16(data + 6);
+    resp.head(apikey, apiver);
+    res.unmarshal(resp.up, apiver);
+    KAFKA_TRACE(ctxid, apikey, TRACE_DECODE_DONE);
 
     return 0;
 }
 
+int Connection::Negotiate()
+{
+    m_versions.reset();
+    ApiVersionsRequest req;
+    int16_t apiver = ApiVersionsRequest::apiver;
+    for(;;) {
+        ApiVersionsResponse res;
+        if(SendRequest(ApiVersionsRequest::apikey, apiver, req, res) < 0)
+            return -1;
+        // a broker that doesn't support apiver says so, ask again at its highest
+        int16_t lower = res.retryVersion(apiver);
+        if(lower < 0)
+            return m_versions.update(res) ? 0 : -1;
+        apiver = lower;
+    }
+}
+
 Connection::~Connection()
 {
     if(sockfd > 0) {
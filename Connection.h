@@ -4,6 +4,7 @@
 #include "Packet.h"
 #include "Request.h"
 #include "Response.h"
+#include "ApiVersions.h"
 
 namespace kafkaprotocpp {
 
@@ -15,9 +16,35 @@ public:
 
     int Connect(const std::string& host, int port);
     int SendRequest(int apikey, int apiver, kafkaprotocpp::Marshallable& req, kafkaprotocpp::Marshallable& res);
+    // same, but the response frame is handed to 'frame' instead of being freed,
+    // for responses that reference it (LazyMessageSet and friends)
+    int SendRequest(int apikey, int apiver, kafkaprotocpp::Marshallable& req, kafkaprotocpp::Marshallable& res,
+            kafkaprotocpp::ResponseBuffer& frame);
+    // send an already encoded request frame, e.g. from ProduceBuilder
+    int SendFrame(int apikey, const char* data, size_t size, kafkaprotocpp::Marshallable& res);
+    int SendFrame(int apikey, const char* data, size_t size, kafkaprotocpp::Marshallable& res,
+            kafkaprotocpp::ResponseBuffer& frame);
+
+    // ask the broker for its supported API versions, Send() uses them after
+    int Negotiate();
+    const kafkaprotocpp::ApiVersionTable& Versions() const { return m_versions; }
+
+    // send at the highest version of Req both sides support, -1 if there is none
+    template <class Req>
+    int Send(Req& req, kafkaprotocpp::Marshallable& res)
+    {
+        int16_t ver = m_versions.pick<Req>();
+        if(ver < 0)
+            return -1;
+        return SendRequest(Req::apikey, ver, req, res);
+    }
 
 private:
+    int Roundtrip(int32_t ctxid, int apikey, const char* data, size_t size,
+            kafkaprotocpp::Marshallable& res, kafkaprotocpp::ResponseBuffer& frame);
+
     int sockfd = 0;
+    kafkaprotocpp::ApiVersionTable m_versions;
 };
 
 }
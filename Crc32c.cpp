@@ -0,0 +1,117 @@
+#include "Crc32c.h"
+
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#define KAFKA_X86_KERNELS 1
+#endif
+
+using namespace kafkaprotocpp;
+
+namespace {
+
+typedef uint32_t (*CrcFn)(uint32_t crc, const unsigned char* p, size_t len);
+
+// slicing-by-8 tables for the reflected polynomial 0x82F63B78
+struct Tables
+{
+    uint32_t t[8][256];
+
+    Tables()
+    {
+        for(uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for(int k = 0; k < 8; ++k)
+                c = (c >> 1) ^ (0x82F63B78u & (0u - (c & 1)));
+            t[0][i] = c;
+        }
+        for(uint32_t i = 0; i < 256; ++i) {
+            for(int k = 1; k < 8; ++k)
+                t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+        }
+    }
+};
+
+const Tables& tables()
+{
+    static const Tables s_tables;
+    return s_tables;
+}
+
+uint32_t crc_table(uint32_t crc, const unsigned char* p, size_t len)
+{
+    const uint32_t (*t)[256] = tables().t;
+    while(len >= 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        lo = __builtin_bswap32(lo);
+        hi = __builtin_bswap32(hi);
+#endif
+        lo ^= crc;
+        crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24]
+            ^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while(len--)
+        crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+    return crc;
+}
+
+#ifdef KAFKA_X86_KERNELS
+
+__attribute__((target("sse4.2")))
+uint32_t crc_sse42(uint32_t crc, const unsigned char* p, size_t len)
+{
+    uint64_t c = crc;
+    while(len >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c = _mm_crc32_u64(c, v);
+        p += 8;
+        len -= 8;
+    }
+    uint32_t c32 = (uint32_t)c;
+    while(len--)
+        c32 = _mm_crc32_u8(c32, *p++);
+    return c32;
+}
+
+#endif
+
+struct Kernel
+{
+    const char* name;
+    CrcFn fn;
+};
+
+const Kernel& kernel()
+{
+    static const Kernel s_kernel = []() {
+#ifdef KAFKA_X86_KERNELS
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("sse4.2")) {
+            Kernel k = { "sse4.2", crc_sse42 };
+            return k;
+        }
+#endif
+        Kernel k = { "table", crc_table };
+        return k;
+    }();
+    return s_kernel;
+}
+
+}
+
+uint32_t kafkaprotocpp::crc32c(uint32_t crc, const void* data, size_t len)
+{
+    return ~kernel().fn(~crc, (const unsigned char*)data, len);
+}
+
+const char* kafkaprotocpp::crc32c_kernel()
+{
+    return kernel().name;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace kafkaprotocpp {
+
+// CRC-32C (Castagnoli), the checksum of RecordBatch v2. Pass the previous
+// result as crc to continue over several pieces, 0 to start.
+uint32_t crc32c(uint32_t crc, const void* data, size_t len);
+
+// the kernel in use: "sse4.2" or "table"
+const char* crc32c_kernel();
+
+}
@@ -0,0 +1,168 @@
+#include "FetchSession.h"
+
+#include <limits.h>
+
+using namespace kafkaprotocpp;
+
+enum
+{
+    INITIAL_EPOCH = 0,
+    FINAL_EPOCH = -1,
+};
+
+FetchSession::FetchSession(bool sessions) :
+    m_sessions(sessions), m_id(0), m_epoch(sessions ? INITIAL_EPOCH : FINAL_EPOCH), m_sentEpoch(FINAL_EPOCH),
+    m_lastSent(0)
+{
+}
+
+void FetchSession::set(const TopicName& topic, int32_t parn, int64_t offset, int32_t maxBytes, int64_t logStartOffset)
+{
+    Key key(topic, parn);
+    auto it = m_parts.find(key);
+    if(it == m_parts.end()) {
+        Entry& e = m_parts[key];
+        e.offset = offset;
+        e.logStartOffset = logStartOffset;
+        e.maxBytes = maxBytes;
+        e.sent = false;
+        m_forgotten.erase(key);
+        m_dirty.insert(key);
+        return;
+    }
+    Entry& e = it->second;
+    if(e.offset == offset && e.logStartOffset == logStartOffset && e.maxBytes == maxBytes)
+        return;
+    e.offset = offset;
+    e.logStartOffset = logStartOffset;
+    e.maxBytes = maxBytes;
+    m_dirty.insert(key);
+}
+
+bool FetchSession::advance(const TopicName& topic, int32_t parn, int64_t offset)
+{
+    Key key(topic, parn);
+    auto it = m_parts.find(key);
+    if(it == m_parts.end())
+        return false;
+    if(it->second.offset != offset) {
+        it->second.offset = offset;
+        m_dirty.insert(key);
+    }
+    return true;
+}
+
+void FetchSession::remove(const TopicName& topic, int32_t parn)
+{
+    Key key(topic, parn);
+    auto it = m_parts.find(key);
+    if(it == m_parts.end())
+        return;
+    if(it->second.sent)
+        m_forgotten.insert(key);
+    m_dirty.erase(key);
+    m_parts.erase(it);
+}
+
+void FetchSession::clear()
+{
+    for(auto& it : m_parts) {
+        if(it.second.sent)
+            m_forgotten.insert(it.first);
+    }
+    m_parts.clear();
+    m_dirty.clear();
+}
+
+bool FetchSession::contains(const TopicName& topic, int32_t parn) const
+{
+    return m_parts.count(Key(topic, parn)) > 0;
+}
+
+int64_t FetchSession::offset(const TopicName& topic, int32_t parn) const
+{
+    auto it = m_parts.find(Key(topic, parn));
+    return it == m_parts.end() ? -1 : it->second.offset;
+}
+
+void FetchSession::addUnit(FetchRequest& req, const Key& key, Entry& e)
+{
+    if(req.fetchTopicVec.empty() || req.fetchTopicVec.back().topicStr != key.first)
+        req.fetchTopicVec.push_back(FetchTopicRequestUnit(key.first));
+    FetchPartitionRequestUnit pu(key.second, e.offset, e.maxBytes);
+    pu.logStartOffset = e.logStartOffset;
+    req.fetchTopicVec.back().fetchParVec.push_back(pu);
+    e.sent = true;
+    ++m_lastSent;
+}
+
+// Keys are ordered by topic then partition, so units of one topic come out
+// next to each other.
+void FetchSession::build(FetchRequest& req)
+{
+    req.sessionId = m_id;
+    req.sessionEpoch = m_epoch;
+    req.fetchTopicVec.clear();
+    req.forgottenTopics.clear();
+    m_sentEpoch = m_epoch;
+    m_lastSent = 0;
+
+    if(nextIsFull()) {
+        // a full request replaces whatever the broker had
+        for(auto& it : m_parts)
+            addUnit(req, it.first, it.second);
+        m_dirty.clear();
+        m_forgotten.clear();
+        return;
+    }
+
+    for(auto& key : m_dirty)
+        addUnit(req, key, m_parts[key]);
+    m_dirty.clear();
+
+    for(auto& key : m_forgotten) {
+        if(req.forgottenTopics.empty() || req.forgottenTopics.back().topic != key.first.str()) {
+            req.forgottenTopics.emplace_back();
+            req.forgottenTopics.back().topic = key.first;
+        }
+        req.forgottenTopics.back().partitions.push_back(key.second);
+    }
+    m_forgotten.clear();
+}
+
+bool FetchSession::handleResponse(int16_t errcode, int32_t sessionId)
+{
+    if(errcode != ApiConstants::ERRORCODE_NO_ERROR) {
+        if(errcode == ApiConstants::ERRORCODE_FETCH_SESSION_ID_NOT_FOUND)
+            m_id = 0;
+        // INVALID_FETCH_SESSION_EPOCH and the rest: replace the session
+        m_epoch = m_sessions ? INITIAL_EPOCH : FINAL_EPOCH;
+        return false;
+    }
+
+    if(m_sentEpoch == FINAL_EPOCH) {
+        m_id = 0; // closed, or never had one
+        m_epoch = m_sessions ? INITIAL_EPOCH : FINAL_EPOCH;
+    } else if(m_sentEpoch == INITIAL_EPOCH) {
+        // 0 if the broker didn't create one (e.g. its cache is full), then
+        // keep asking with full requests
+        m_id = sessionId;
+        m_epoch = sessionId != 0 ? 1 : INITIAL_EPOCH;
+    } else {
+        m_epoch = m_epoch == INT_MAX ? 1 : m_epoch + 1;
+    }
+    return true;
+}
+
+void FetchSession::handleError()
+{
+    // the broker may or may not have seen it, start over
+    if(m_sentEpoch != FINAL_EPOCH)
+        m_epoch = INITIAL_EPOCH;
+}
+
+void FetchSession::close()
+{
+    m_sessions = false;
+    m_epoch = FINAL_EPOCH;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "KafkaMessage.h"
+
+#include <map>
+#include <set>
+
+namespace kafkaprotocpp {
+
+// Client side of an incremental fetch session (Fetch v7) with one broker.
+//
+// The first fetch lists every partition and asks the broker to open a
+// session. After that each FetchRequestV7 only lists the partitions whose
+// offset or limits changed plus the ones dropped (forgottenTopics), and the
+// broker only answers with partitions that have records or errors, so the
+// cost of a fetch follows the active partitions instead of the assigned ones.
+//
+//     FetchSession session;
+//     session.set(topic, parn, offset, 1 << 20);   // for each partition
+//     for(;;) {
+//         FetchRequestV7 req;                      // replicaId, maxWaitTimeMs, ...
+//         session.build(req);
+//         if(conn.SendRequest(FetchRequestV7::apikey, FetchRequestV7::apiver, req, res, frame) < 0)
+//             session.handleError();
+//         else if(session.handleResponse(res))
+//             ... consume, then advance() the partitions that returned records
+//     }
+//
+// One fetch per session may be outstanding at a time. Any failure makes the
+// next request a full one, which replaces the broker's session.
+class FetchSession
+{
+public:
+    // sessions false fetches without a session (full requests, sessionId 0
+    // and epoch -1) with the same interface
+    explicit FetchSession(bool sessions = true);
+
+    // fetch topic/parn from offset, sent with the next request only if new or changed
+    void set(const TopicName& topic, int32_t parn, int64_t offset, int32_t maxBytes, int64_t logStartOffset = -1);
+    // move the fetch offset, false if the partition isn't in the session
+    bool advance(const TopicName& topic, int32_t parn, int64_t offset);
+    // stop fetching it, the broker is told with the next request
+    void remove(const TopicName& topic, int32_t parn);
+    void clear();
+
+    bool contains(const TopicName& topic, int32_t parn) const;
+    // -1 if not in the session
+    int64_t offset(const TopicName& topic, int32_t parn) const;
+    size_t partitions() const { return m_parts.size(); }
+
+    // fill sessionId, sessionEpoch, fetchTopicVec and forgottenTopics of req
+    void build(FetchRequest& req);
+
+    // false if the response carries a session error and must be dropped; the
+    // next request is then a full one
+    bool handleResponse(int16_t errcode, int32_t sessionId);
+    template <class RS>
+    bool handleResponse(const FetchResponseV7T<RS>& res) { return handleResponse(res.errcode, res.sessionId); }
+    // the request got no response
+    void handleError();
+    // the next request closes the session, later ones go without
+    void close();
+
+    int32_t sessionId() const { return m_id; }
+    int32_t epoch() const { return m_epoch; }
+    bool nextIsFull() const { return m_epoch <= 0; }
+    // partitions listed in the last request built
+    size_t lastSent() const { return m_lastSent; }
+
+private:
+    typedef std::pair<TopicName, int32_t> Key;
+
+    struct Entry
+    {
+        int64_t offset;
+        int64_t logStartOffset;
+        int32_t maxBytes;
+        bool sent; // the broker's session has these values
+    };
+
+    void addUnit(FetchRequest& req, const Key& key, Entry& e);
+
+    bool m_sessions;
+    int32_t m_id;        // 0 while there is no session
+    int32_t m_epoch;     // of the next request: 0 opens a session, -1 none
+    int32_t m_sentEpoch; // of the request outstanding
+    size_t m_lastSent;
+
+    std::map<Key, Entry> m_parts;
+    std::set<Key> m_dirty;     // changed since they were last sent
+    std::set<Key> m_forgotten; // removed, but still in the broker's session
+};
+
+}
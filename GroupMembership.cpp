@@ -0,0 +1,279 @@
+#include "GroupMembership.h"
+
+using namespace kafkaprotocpp;
+
+GroupMembership::GroupMembership(AsyncConnection& coordinator, const Options& opts) :
+    m_conn(coordinator), m_opts(opts), m_state(UNJOINED), m_epoch(0), m_genid(-1), m_assigned(false),
+    m_now(0), m_retryAt(0), m_nextHeartbeat(0), m_lastHeartbeatOk(0), m_heartbeatInFlight(false)
+{
+}
+
+void GroupMembership::poll(int64_t nowMs)
+{
+    m_now = nowMs;
+    switch(m_state) {
+    case UNJOINED:
+        if(nowMs >= m_retryAt)
+            join(nowMs);
+        break;
+    case STABLE:
+        if(nowMs - m_lastHeartbeatOk >= m_opts.sessionTimeoutMs) {
+            // the coordinator has dropped us by now
+            rejoin(false);
+            join(nowMs);
+        } else if(!m_heartbeatInFlight && nowMs >= m_nextHeartbeat) {
+            heartbeat(nowMs);
+        }
+        break;
+    default:
+        break; // waiting for a response
+    }
+}
+
+int64_t GroupMembership::nextTimeoutMs(int64_t nowMs) const
+{
+    int64_t at = nowMs + m_opts.sessionTimeoutMs;
+    switch(m_state) {
+    case UNJOINED:
+        at = m_retryAt;
+        break;
+    case STABLE:
+        at = m_lastHeartbeatOk + m_opts.sessionTimeoutMs;
+        if(!m_heartbeatInFlight && m_nextHeartbeat < at)
+            at = m_nextHeartbeat;
+        break;
+    default:
+        break;
+    }
+    return at > nowMs ? at - nowMs : 0;
+}
+
+void GroupMembership::join(int64_t nowMs)
+{
+    m_now = nowMs;
+    m_state = JOINING;
+    uint64_t epoch = ++m_epoch;
+
+    JoinGroupRequest req;
+    req.groupid = m_opts.groupid;
+    req.timeout = m_opts.sessionTimeoutMs;
+    req.memberid = m_memberid;
+    req.prototype = "consumer";
+    req.protocols.resize(1);
+    GroupProtocol& gp = req.protocols[0];
+    gp.name = m_opts.protocol;
+    gp.meta.version = 0;
+    gp.meta.topics = m_opts.topics;
+    gp.meta.oldSubs = m_owned; // what we had, so the leader can keep it here
+
+    if(m_conn.Send(JoinGroupRequest::apikey, JoinGroupRequest::apiver, req,
+                [this, epoch](int err, const Unpack& body) { onJoin(epoch, err, body); }) < 0)
+        fail(-1);
+}
+
+void GroupMembership::onJoin(uint64_t epoch, int err, const Unpack& body)
+{
+    if(epoch != m_epoch || m_state != JOINING)
+        return;
+    if(err < 0) {
+        fail(-1);
+        return;
+    }
+
+    JoinGroupResponse res;
+    try {
+        res.unmarshal(body);
+    } catch(const PacketError&) {
+        fail(-1);
+        return;
+    }
+
+    switch(res.errcode) {
+    case ApiConstants::ERRORCODE_NO_ERROR:
+        m_genid = res.genid;
+        m_memberid = res.memberid;
+        m_leaderid = res.leaderid;
+        sync(res);
+        break;
+    case ApiConstants::ERRORCODE_UNKNOWN_MEMBERID:
+        m_memberid.clear();
+        rejoin(false);
+        break;
+    default:
+        fail(res.errcode);
+        break;
+    }
+}
+
+void GroupMembership::sync(const JoinGroupResponse& res)
+{
+    m_state = SYNCING;
+    uint64_t epoch = m_epoch;
+
+    SyncGroupRequest req;
+    req.groupid = m_opts.groupid;
+    req.genid = m_genid;
+    req.memberid = m_memberid;
+    if(leader()) {
+        if(m_assignor) {
+            m_assignor(res, req.assignments);
+        } else {
+            StickyAssignor assignor;
+            assignor.assign(res.members, m_counts, req.assignments);
+        }
+    }
+
+    if(m_conn.Send(SyncGroupRequest::apikey, SyncGroupRequest::apiver, req,
+                [this, epoch](int err, const Unpack& body) { onSync(epoch, err, body); }) < 0)
+        fail(-1);
+}
+
+void GroupMembership::onSync(uint64_t epoch, int err, const Unpack& body)
+{
+    if(epoch != m_epoch || m_state != SYNCING)
+        return;
+    if(err < 0) {
+        fail(-1);
+        return;
+    }
+
+    SyncGroupResponse res;
+    try {
+        res.unmarshal(body);
+    } catch(const PacketError&) {
+        fail(-1);
+        return;
+    }
+
+    switch(res.errcode) {
+    case ApiConstants::ERRORCODE_NO_ERROR:
+        m_assignment = std::move(res.assignment);
+        m_assigned = true;
+        m_state = STABLE;
+        m_heartbeatInFlight = false;
+        m_lastHeartbeatOk = m_now;
+        m_nextHeartbeat = m_now + m_opts.heartbeatIntervalMs;
+        if(m_onAssigned)
+            m_onAssigned(m_assignment);
+        break;
+    case ApiConstants::ERRORCODE_UNKNOWN_MEMBERID:
+        m_memberid.clear();
+        rejoin(false);
+        break;
+    case ApiConstants::ERRORCODE_GROUP_REBALANCE_IN_PROGRESS:
+    case ApiConstants::ERRORCODE_ILLEGAL_GENERATION:
+        rejoin(false);
+        break;
+    default:
+        fail(res.errcode);
+        break;
+    }
+}
+
+void GroupMembership::heartbeat(int64_t nowMs)
+{
+    m_heartbeatInFlight = true;
+    m_nextHeartbeat = nowMs + m_opts.heartbeatIntervalMs;
+    uint64_t epoch = m_epoch;
+
+    HeartbeatRequest req;
+    req.groupid = m_opts.groupid;
+    req.genid = m_genid;
+    req.memberid = m_memberid;
+
+    if(m_conn.Send(HeartbeatRequest::apikey, HeartbeatRequest::apiver, req,
+                [this, epoch](int err, const Unpack& body) { onHeartbeat(epoch, err, body); }) < 0)
+        fail(-1);
+}
+
+void GroupMembership::onHeartbeat(uint64_t epoch, int err, const Unpack& body)
+{
+    if(epoch != m_epoch || m_state != STABLE)
+        return;
+    m_heartbeatInFlight = false;
+    if(err < 0) {
+        fail(-1);
+        return;
+    }
+
+    HeartbeatResponse res;
+    try {
+        res.unmarshal(body);
+    } catch(const PacketError&) {
+        fail(-1);
+        return;
+    }
+
+    switch(res.errcode) {
+    case ApiConstants::ERRORCODE_NO_ERROR:
+        m_lastHeartbeatOk = m_now;
+        break;
+    case ApiConstants::ERRORCODE_UNKNOWN_MEMBERID:
+        m_memberid.clear();
+        rejoin(false);
+        break;
+    case ApiConstants::ERRORCODE_GROUP_REBALANCE_IN_PROGRESS:
+    case ApiConstants::ERRORCODE_ILLEGAL_GENERATION:
+        rejoin(false);
+        break;
+    default:
+        fail(res.errcode);
+        break;
+    }
+}
+
+void GroupMembership::rejoin(bool backoff)
+{
+    revoke();
+    ++m_epoch;
+    m_state = UNJOINED;
+    m_heartbeatInFlight = false;
+    m_retryAt = backoff ? m_now + m_opts.retryBackoffMs : m_now;
+}
+
+void GroupMembership::revoke()
+{
+    if(!m_assigned)
+        return;
+    m_assigned = false;
+    if(m_onRevoked)
+        m_onRevoked();
+
+    m_owned.toppars.swap(m_assignment.topicAssign);
+    m_assignment.reset();
+}
+
+void GroupMembership::fail(int16_t errcode)
+{
+    if(m_state == STABLE) {
+        // keep the assignment and retry the heartbeat; only the session
+        // timeout takes the partitions away
+        m_heartbeatInFlight = false;
+        m_nextHeartbeat = m_now + m_opts.retryBackoffMs;
+    } else if(m_state != LEFT) {
+        ++m_epoch;
+        m_state = UNJOINED;
+        m_retryAt = m_now + m_opts.retryBackoffMs;
+    }
+    if(m_onError)
+        m_onError(errcode);
+}
+
+void GroupMembership::leave()
+{
+    if(m_state == LEFT)
+        return;
+    revoke();
+    ++m_epoch;
+    m_state = LEFT;
+    m_heartbeatInFlight = false;
+    if(m_memberid.empty())
+        return;
+
+    LeaveGroupRequest req;
+    req.groupid = m_opts.groupid;
+    req.memberid = m_memberid;
+    m_conn.Send(LeaveGroupRequest::apikey, LeaveGroupRequest::apiver, req, [](int, const Unpack&) {});
+    m_memberid.clear();
+    m_genid = -1;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "AsyncConnection.h"
+#include "StickyAssignor.h"
+
+namespace kafkaprotocpp {
+
+// Consumer group membership as a state machine on an AsyncConnection to the
+// group coordinator.
+//
+// Join, sync, heartbeat and leave requests are all sent without blocking and
+// their responses handled in the connection's Process(); poll(nowMs) only
+// fires timers. Run both from the event loop that also fetches:
+//
+//     for(;;) {
+//         coordinator.Poll(std::min<int64_t>(group.nextTimeoutMs(now), fetchWait));
+//         group.poll(now);
+//         ... fetch and process with group.assignment()
+//     }
+//
+// A slow fetch or slow processing then only delays heartbeats by one loop
+// iteration. When the coordinator answers a heartbeat with
+// GROUP_REBALANCE_IN_PROGRESS (or the generation/member is no longer valid)
+// the member calls onRevoked, rejoins and, once synced, onAssigned, all
+// driven from the same loop: fetching of the old assignment goes on until
+// onRevoked, nothing waits for the rebalance.
+class GroupMembership
+{
+public:
+    enum State
+    {
+        UNJOINED, // waiting to (re)join, possibly after a backoff
+        JOINING,  // JoinGroupRequest in flight
+        SYNCING,  // SyncGroupRequest in flight
+        STABLE,   // assigned, heartbeating
+        LEFT,     // after leave()
+    };
+
+    struct Options
+    {
+        std::string groupid;
+        std::vector<std::string> topics;
+        std::string protocol;        // assignment strategy name sent in the join
+        int32_t sessionTimeoutMs;
+        int64_t heartbeatIntervalMs;
+        int64_t retryBackoffMs;
+
+        Options() : protocol("sticky"), sessionTimeoutMs(30000), heartbeatIntervalMs(3000), retryBackoffMs(500) {}
+    };
+
+    // leader side: compute everyone's assignment from the join response
+    typedef std::function<void(const JoinGroupResponse&, StickyAssignor::Assignments&)> Assignor;
+    typedef std::function<void(const MemberAssignment&)> AssignedCallback;
+    typedef std::function<void()> RevokedCallback;
+    typedef std::function<void(int16_t errcode)> ErrorCallback;
+
+    GroupMembership(AsyncConnection& coordinator, const Options& opts);
+
+    // Without an assignor the leader runs a StickyAssignor over the counts
+    // given to setPartitionCounts().
+    void setAssignor(Assignor assignor) { m_assignor = assignor; }
+    void setPartitionCounts(const StickyAssignor::PartitionCounts& counts) { m_counts = counts; }
+
+    void onAssigned(AssignedCallback cb) { m_onAssigned = cb; }
+    void onRevoked(RevokedCallback cb) { m_onRevoked = cb; }
+    // coordinator or transport trouble; the member retries after a backoff,
+    // the caller may want to find the coordinator again
+    void onError(ErrorCallback cb) { m_onError = cb; }
+
+    // fire due timers: join, heartbeat, session expiry
+    void poll(int64_t nowMs);
+    // ms until poll() has something to do, for the event loop's wait
+    int64_t nextTimeoutMs(int64_t nowMs) const;
+
+    // leave the group, giving the partitions up
+    void leave();
+
+    State state() const { return m_state; }
+    int32_t generation() const { return m_genid; }
+    const std::string& memberid() const { return m_memberid; }
+    bool leader() const { return !m_memberid.empty() && m_leaderid == m_memberid; }
+    const MemberAssignment& assignment() const { return m_assignment; }
+
+private:
+    GroupMembership(const GroupMembership&);
+    GroupMembership& operator = (const GroupMembership&);
+
+    void join(int64_t nowMs);
+    void sync(const JoinGroupResponse& res);
+    void heartbeat(int64_t nowMs);
+
+    void onJoin(uint64_t epoch, int err, const Unpack& body);
+    void onSync(uint64_t epoch, int err, const Unpack& body);
+    void onHeartbeat(uint64_t epoch, int err, const Unpack& body);
+
+    // give the assignment up and join again, after a backoff if 'backoff'
+    void rejoin(bool backoff);
+    void revoke();
+    void fail(int16_t errcode);
+
+    AsyncConnection& m_conn;
+    Options m_opts;
+
+    Assignor m_assignor;
+    StickyAssignor::PartitionCounts m_counts;
+    AssignedCallback m_onAssigned;
+    RevokedCallback m_onRevoked;
+    ErrorCallback m_onError;
+
+    State m_state;
+    uint64_t m_epoch;            // bumped on every (re)join, stale responses are ignored
+    int32_t m_genid;
+    std::string m_memberid;
+    std::string m_leaderid;
+    MemberAssignment m_assignment;
+    bool m_assigned;
+    MemberSubToppars m_owned;    // last assignment, sent as oldSubs when rejoining
+
+    int64_t m_now;
+    int64_t m_retryAt;           // UNJOINED: when to join
+    int64_t m_nextHeartbeat;     // STABLE: when to send the next heartbeat
+    int64_t m_lastHeartbeatOk;   // STABLE: for session expiry
+    bool m_heartbeatInFlight;
+};
+
+}
@@ -0,0 +1,429 @@
+#include "IdempotentProducer.h"
+
+#include <algorithm>
+#include <chrono>
+
+using namespace kafkaprotocpp;
+
+enum
+{
+    MAX_IN_FLIGHT = 5,     // batches per partition the broker keeps sequences of
+    RECORD_OVERHEAD = 16,  // length, attributes, deltas and lengths of a small record
+};
+
+static int64_t steadyMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int32_t addSequence(int32_t seq, int32_t n)
+{
+    int64_t next = (int64_t)seq + n;
+    return next > INT32_MAX ? (int32_t)(next - INT32_MAX - 1) : (int32_t)next;
+}
+
+static int32_t subSequence(int32_t seq, int32_t n)
+{
+    int64_t prev = (int64_t)seq - n;
+    return prev < 0 ? (int32_t)(prev + INT32_MAX + 1) : (int32_t)prev;
+}
+
+// whether a comes before b, across the wrap; a partition's unanswered
+// batches span far less than half the sequence space
+static bool sequenceBefore(int32_t a, int32_t b)
+{
+    int32_t distance = subSequence(b, a);
+    return distance != 0 && distance < (1 << 30);
+}
+
+IdempotentProducer::IdempotentProducer(BrokerPool& pool, const MetadataCache& meta, const Options& opts) :
+    m_pool(pool), m_meta(meta), m_opts(opts), m_producerId(-1), m_producerEpoch(-1), m_initSent(false),
+    m_resetting(false), m_initAt(0), m_now(0), m_pending(0), m_inFlight(0), m_retries(0), m_resets(0)
+{
+    m_opts.maxInFlight = std::max(1, std::min<int>(m_opts.maxInFlight, MAX_IN_FLIGHT));
+}
+
+void IdempotentProducer::send(const TopicName& topic, int32_t parn, int64_t timestamp, const std::string& key,
+        const std::string& value, Delivery delivery)
+{
+    Partition& p = m_parts[std::make_pair(topic, parn)];
+    if(p.topic != topic) {
+        p.topic = topic;
+        p.parn = parn;
+    }
+    p.open.emplace_back();
+    Record& r = p.open.back();
+    r.timestamp = timestamp;
+    r.key = key;
+    r.value = value;
+    r.delivery = std::move(delivery);
+    ++m_pending;
+}
+
+void IdempotentProducer::poll(int64_t nowMs)
+{
+    m_now = nowMs;
+    MetadataCache::Reader snap = m_meta.read();
+    m_pool.setBrokers(*snap);
+
+    if(m_resetting) {
+        while(drain(*snap))
+            ;
+        if(m_inFlight > 0 || !resolved())
+            return;
+        m_resetting = false;
+        m_producerId = -1;
+    }
+    if(m_producerId < 0) {
+        if(!m_initSent && nowMs >= m_initAt)
+            initProducerId();
+        return;
+    }
+
+    while(drain(*snap))
+        ;
+}
+
+bool IdempotentProducer::flush(int timeoutMs)
+{
+    int64_t start = steadyMs();
+    for(;;) {
+        int64_t now = steadyMs();
+        poll(now);
+        if(m_pending == 0)
+            return true;
+        int64_t left = start + timeoutMs - now;
+        if(left <= 0)
+            return false;
+        m_pool.poll(std::min<int64_t>(left, m_opts.retryBackoffMs));
+    }
+}
+
+void IdempotentProducer::initProducerId()
+{
+    AsyncConnection* conn = m_pool.any();
+    InitProducerIdRequest req;
+    if(!conn || conn->Send(InitProducerIdRequest::apikey, InitProducerIdRequest::apiver, req,
+                [this](int err, const Unpack& body) { onInitProducerId(err, body); }) < 0) {
+        m_initAt = m_now + m_opts.retryBackoffMs;
+        return;
+    }
+    m_initSent = true;
+}
+
+void IdempotentProducer::onInitProducerId(int err, const Unpack& body)
+{
+    m_initSent = false;
+
+    InitProducerIdResponse res;
+    res.errcode = ApiConstants::ERRORCODE_UNKNOWN;
+    if(err == 0) {
+        try {
+            res.unmarshal(body);
+        } catch(const PacketError&) {
+            res.errcode = ApiConstants::ERRORCODE_UNKNOWN;
+        }
+    }
+    if(res.errcode != ApiConstants::ERRORCODE_NO_ERROR) {
+        m_initAt = m_now + m_opts.retryBackoffMs;
+        return;
+    }
+
+    m_producerId = res.producerId;
+    m_producerEpoch = res.producerEpoch;
+    renumber();
+}
+
+// Sequences start over with a new producer id. Nothing is in flight here, so
+// the queued batches are all there is to renumber.
+void IdempotentProducer::renumber()
+{
+    for(auto& it : m_parts) {
+        Partition& p = it.second;
+        p.nextSequence = 0;
+        p.stale = false;
+        for(auto& b : p.queue) {
+            b->sequence = p.nextSequence;
+            RecordBatchWriter::setProducer(&b->bytes[0], b->bytes.size(), m_producerId, m_producerEpoch, b->sequence);
+            p.nextSequence = addSequence(p.nextSequence, b->records());
+        }
+    }
+}
+
+// Every partition the broker still has sequences for got its unanswered
+// batches through, so none is written twice once they are renumbered.
+bool IdempotentProducer::resolved() const
+{
+    for(auto& it : m_parts) {
+        if(!it.second.stale && !it.second.queue.empty())
+            return false;
+    }
+    return true;
+}
+
+// One request per leader with the next batch of every partition it leads, as
+// long as its connection has room. True if anything was sent.
+bool IdempotentProducer::drain(const MetadataSnapshot& snap)
+{
+    std::map<int32_t, std::pair<ProduceRequestV3, std::shared_ptr<SentList> > > byLeader;
+    std::map<int32_t, AsyncConnection*> conns;
+
+    for(auto& it : m_parts) {
+        Partition& p = it.second;
+        if(p.open.empty() && p.queue.empty())
+            continue;
+        int32_t leader = snap.leader(p.topic, p.parn);
+        if(leader < 0)
+            continue;
+        // a partition's batches stay on one broker until they are answered
+        if(!p.inFlight.empty() && p.node != leader)
+            continue;
+
+        auto cit = conns.find(leader);
+        if(cit == conns.end()) {
+            AsyncConnection* conn = m_pool.get(leader);
+            if(conn && conn->Outstanding() >= (size_t)m_opts.maxInFlight)
+                conn = NULL;
+            cit = conns.insert(std::make_pair(leader, conn)).first;
+        }
+        if(!cit->second)
+            continue;
+
+        BatchPtr b = nextBatch(p);
+        if(!b)
+            continue;
+
+        auto& entry = byLeader[leader];
+        ProduceRequestV3& req = entry.first;
+        if(!entry.second) {
+            req.ack = m_opts.ack;
+            req.timeout = m_opts.timeoutMs;
+            entry.second = std::make_shared<SentList>();
+        }
+        if(req.topicRecords.empty() || req.topicRecords.back().topic != p.topic) {
+            req.topicRecords.emplace_back();
+            req.topicRecords.back().topic = p.topic;
+        }
+        req.topicRecords.back().parRecords.emplace_back();
+        ProducePartitionRecordsUnit& unit = req.topicRecords.back().parRecords.back();
+        unit.parn = p.parn;
+        unit.records = LazyRecordSet(b->bytes.data(), b->bytes.size());
+
+        p.inFlight.push_back(b);
+        p.node = leader;
+        ++m_inFlight;
+        Sent s = { &p, b };
+        entry.second->push_back(s);
+    }
+
+    for(auto& it : byLeader) {
+        std::shared_ptr<SentList> sentList = it.second.second;
+        if(conns[it.first]->Send(ProduceRequestV3::apikey, ProduceRequestV3::apiver, it.second.first,
+                    [this, sentList](int err, const Unpack& body) { onProduce(*sentList, err, body); }) < 0)
+            onProduce(*sentList, -1, Unpack(NULL, 0));
+    }
+    return !byLeader.empty();
+}
+
+IdempotentProducer::BatchPtr IdempotentProducer::nextBatch(Partition& p)
+{
+    // while resetting only retries under the old id
+    if(m_resetting && (p.stale || p.queue.empty()))
+        return BatchPtr();
+    // retries go one at a time, lowest sequence first
+    if(!p.queue.empty()) {
+        if(!p.inFlight.empty() || p.queue.front()->retryAt > m_now)
+            return BatchPtr();
+        BatchPtr b = p.queue.front();
+        p.queue.pop_front();
+        ++m_retries;
+        return b;
+    }
+    if(p.recovering) {
+        if(!p.inFlight.empty())
+            return BatchPtr();
+        p.recovering = false;
+    }
+    if(p.inFlight.size() >= MAX_IN_FLIGHT || p.open.empty())
+        return BatchPtr();
+    return seal(p);
+}
+
+IdempotentProducer::BatchPtr IdempotentProducer::seal(Partition& p)
+{
+    BatchPtr b = std::make_shared<Batch>();
+    b->sequence = p.nextSequence;
+    b->retries = 0;
+    b->retryAt = 0;
+
+    m_scratch.resize(0);
+    Pack pk(m_scratch);
+    RecordBatchWriter w(pk);
+    w.begin(m_producerId, m_producerEpoch, b->sequence);
+    size_t bytes = 0;
+    while(!p.open.empty()) {
+        Record& r = p.open.front();
+        size_t rb = r.key.size() + r.value.size() + RECORD_OVERHEAD;
+        if(!b->deliveries.empty() && bytes + rb > m_opts.batchBytes)
+            break;
+        w.append(r.timestamp, r.key.data(), r.key.empty() ? -1 : r.key.size(), r.value.data(), r.value.size());
+        b->deliveries.push_back(std::move(r.delivery));
+        bytes += rb;
+        p.open.pop_front();
+    }
+    w.end();
+    b->bytes.assign(pk.data(), pk.size());
+    p.nextSequence = addSequence(p.nextSequence, b->records());
+    return b;
+}
+
+void IdempotentProducer::onProduce(const SentList& sent, int err, const Unpack& body)
+{
+    ProduceResponseV3 res;
+    if(err == 0) {
+        try {
+            res.unmarshal(body);
+        } catch(const PacketError&) {
+            err = -1;
+        }
+    }
+
+    for(auto& s : sent) {
+        --m_inFlight;
+        Partition& p = *s.part;
+        const BatchPtr& b = s.batch;
+
+        int16_t errcode = ApiConstants::ERRORCODE_UNKNOWN;
+        int64_t offset = -1;
+        for(auto& topic : res.topicRespVec) {
+            if(topic.topic != p.topic)
+                continue;
+            for(auto& pr : topic.parRespVec) {
+                if(pr.parn == p.parn) {
+                    errcode = pr.errcode;
+                    offset = pr.offset;
+                }
+            }
+        }
+        // no answer for it: it may or may not have been written, which the
+        // sequence sorts out when it is resent
+        if(err < 0) {
+            retry(p, b, errcode);
+            continue;
+        }
+
+        switch(errcode) {
+        case ApiConstants::ERRORCODE_NO_ERROR:
+            completed(p, b, offset);
+            break;
+        case ApiConstants::ERRORCODE_DUPLICATE_SEQUENCE_NUMBER:
+            completed(p, b, -1); // written by an earlier try
+            break;
+        case ApiConstants::ERRORCODE_OUT_OF_ORDER_SEQUENCE_NUMBER:
+            // behind a batch that failed: wait for it. Otherwise the broker
+            // misses sequences it should have, start over with a new id.
+            if(!p.recovering && !p.inFlight.empty() && p.inFlight.front() == b)
+                resetProducer(p);
+            retry(p, b, errcode);
+            break;
+        case ApiConstants::ERRORCODE_UNKNOWN_PRODUCER_ID:
+        case ApiConstants::ERRORCODE_INVALID_PRODUCER_EPOCH:
+            resetProducer(p);
+            retry(p, b, errcode);
+            break;
+        default:
+            if(retriable(errcode))
+                retry(p, b, errcode);
+            else
+                failed(p, b, errcode);
+            break;
+        }
+    }
+}
+
+void IdempotentProducer::completed(Partition& p, const BatchPtr& b, int64_t offset)
+{
+    takeOut(p, b);
+    for(size_t i = 0; i < b->deliveries.size(); ++i) {
+        if(b->deliveries[i])
+            b->deliveries[i](ApiConstants::ERRORCODE_NO_ERROR, offset < 0 ? -1 : offset + (int64_t)i);
+    }
+    m_pending -= b->records();
+}
+
+void IdempotentProducer::retry(Partition& p, const BatchPtr& b, int16_t errcode)
+{
+    takeOut(p, b);
+    if(b->retries >= m_opts.maxRetries) {
+        failed(p, b, errcode);
+        return;
+    }
+    ++b->retries;
+    b->retryAt = m_now + m_opts.retryBackoffMs;
+    auto pos = std::upper_bound(p.queue.begin(), p.queue.end(), b, [](const BatchPtr& x, const BatchPtr& y) {
+        return sequenceBefore(x->sequence, y->sequence);
+    });
+    p.queue.insert(pos, b);
+    p.recovering = true;
+}
+
+// The batch is dropped, so the ones after it move down by its record count
+// to leave no gap; those in flight come back out of order and are resent.
+void IdempotentProducer::failed(Partition& p, const BatchPtr& b, int16_t errcode)
+{
+    takeOut(p, b);
+    for(auto& d : b->deliveries) {
+        if(d)
+            d(errcode, -1);
+    }
+    m_pending -= b->records();
+
+    int32_t n = b->records();
+    for(auto* list : { &p.inFlight, &p.queue }) {
+        for(auto& later : *list) {
+            if(!sequenceBefore(b->sequence, later->sequence))
+                continue;
+            later->sequence = subSequence(later->sequence, n);
+            RecordBatchWriter::setProducer(&later->bytes[0], later->bytes.size(), m_producerId, m_producerEpoch,
+                    later->sequence);
+        }
+    }
+    p.nextSequence = subSequence(p.nextSequence, n);
+    p.recovering = true;
+}
+
+void IdempotentProducer::takeOut(Partition& p, const BatchPtr& b)
+{
+    auto it = std::find(p.inFlight.begin(), p.inFlight.end(), b);
+    if(it != p.inFlight.end())
+        p.inFlight.erase(it);
+}
+
+// No new batches until every one in flight is answered and the other
+// partitions resent theirs, then a new id.
+void IdempotentProducer::resetProducer(Partition& p)
+{
+    p.stale = true;
+    if(m_resetting)
+        return;
+    m_resetting = true;
+    ++m_resets;
+}
+
+bool IdempotentProducer::retriable(int16_t errcode)
+{
+    switch(errcode) {
+    case ApiConstants::ERRORCODE_UNKNOWN_TOPIC_OR_PARTITION:
+    case ApiConstants::ERRORCODE_LEADER_NOT_AVAILABLE:
+    case ApiConstants::ERRORCODE_NOT_LEADER_FOR_PARTITION:
+    case ApiConstants::ERRORCODE_REQUEST_TIMED_OUT:
+    case ApiConstants::ERRORCODE_BROKER_NOT_AVAILABLE:
+    case ApiConstants::ERRORCODE_NOT_ENOUGH_REPLICAS:
+    case ApiConstants::ERRORCODE_NOT_ENOUGH_REPLICAS_AFTER_APPEND:
+    case ApiConstants::ERRORCODE_KAFKA_STORAGE_ERROR:
+        return true;
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "BrokerPool.h"
+#include "RecordBatch.h"
+
+#include <deque>
+#include <map>
+#include <memory>
+
+namespace kafkaprotocpp {
+
+// Idempotent producer over a BrokerPool.
+//
+// It gets a producer id with InitProducerIdRequest and stamps every
+// RecordBatch with it and a per-partition sequence number, so the broker drops
+// duplicates of a retried batch and rejects batches that would arrive out of
+// order. That makes it safe to keep several ProduceRequestV3 in flight per
+// connection (Options::maxInFlight, at most 5, which is what brokers track per
+// partition) while retries still keep each partition in order:
+//
+//   - a batch keeps its sequence and bytes across retries;
+//   - after a failure the partition's batches are resent one at a time, lowest
+//     sequence first, until it is back in order; the batches that were behind
+//     the failed one come back OUT_OF_ORDER_SEQUENCE and are retried as well;
+//   - a batch failing for good (message too large, ...) shifts the sequences
+//     of the ones after it down so the partition can go on;
+//   - if the broker lost a partition's producer state (UNKNOWN_PRODUCER_ID, a
+//     sequence gap) the other partitions first resend their unanswered batches
+//     under the old id, so the broker can still tell duplicates; then a new
+//     producer id is fetched and queued batches are renumbered from 0 under it.
+//
+// Routing comes from the MetadataCache at each poll(); refreshing it after
+// NOT_LEADER errors is up to the caller. Single threaded: call poll() from the
+// loop that polls the pool, and keep the producer alive until nothing is in
+// flight.
+//
+//     IdempotentProducer producer(pool, cache);
+//     producer.send("topic", 0, ts, key, value, [](int16_t err, int64_t offset) { ... });
+//     producer.flush(5000);       // or poll(now) + pool.poll() in your loop
+class IdempotentProducer
+{
+public:
+    struct Options
+    {
+        int16_t ack;           // -1 (all in-sync replicas) is required for idempotence
+        int32_t timeoutMs;     // broker side ack timeout
+        size_t batchBytes;     // records per batch, by size
+        int maxInFlight;       // produce requests per connection, 1 to 5
+        int retryBackoffMs;
+        int maxRetries;        // per batch; failing a batch whose outcome is unknown may leave a gap
+
+        Options() : ack(-1), timeoutMs(30000), batchBytes(1 << 20), maxInFlight(5), retryBackoffMs(100),
+            maxRetries(0x7fffffff) {}
+    };
+
+    // errcode 0 with the record's offset (-1 if the broker only said it was a
+    // duplicate), or the error the record failed with
+    typedef std::function<void(int16_t errcode, int64_t offset)> Delivery;
+
+    IdempotentProducer(BrokerPool& pool, const MetadataCache& meta, const Options& opts = Options());
+
+    // queue a record, an empty key is sent as null
+    void send(const TopicName& topic, int32_t parn, int64_t timestamp, const std::string& key,
+            const std::string& value, Delivery delivery = Delivery());
+
+    // get the producer id and send every batch that may go now
+    void poll(int64_t nowMs);
+    // poll and poll the pool until every record was delivered, false on timeout
+    bool flush(int timeoutMs);
+
+    bool ready() const { return m_producerId >= 0 && !m_resetting; }
+    int64_t producerId() const { return m_producerId; }
+    int16_t producerEpoch() const { return m_producerEpoch; }
+
+    size_t pending() const { return m_pending; }    // records not delivered yet
+    size_t inFlight() const { return m_inFlight; }  // batches sent and not answered
+    size_t retries() const { return m_retries; }    // batches resent so far
+    size_t resets() const { return m_resets; }      // producer ids fetched again
+
+private:
+    IdempotentProducer(const IdempotentProducer&);
+    IdempotentProducer& operator = (const IdempotentProducer&);
+
+    struct Record
+    {
+        int64_t timestamp;
+        std::string key;
+        std::string value;
+        Delivery delivery;
+    };
+
+    struct Batch
+    {
+        std::string bytes; // the encoded RecordBatch
+        int32_t sequence;
+        std::vector<Delivery> deliveries;
+        int retries;
+        int64_t retryAt;
+
+        int32_t records() const { return deliveries.size(); }
+    };
+    typedef std::shared_ptr<Batch> BatchPtr;
+
+    struct Partition
+    {
+        TopicName topic;
+        int32_t parn;
+        int32_t nextSequence;
+        std::deque<Record> open;       // not in a batch yet
+        std::deque<BatchPtr> queue;    // to resend, by sequence
+        std::deque<BatchPtr> inFlight; // by sequence
+        int32_t node;                  // of the batches in flight
+        bool recovering;               // one batch at a time until back in order
+        bool stale;                    // the broker lost its sequences, wait for a new id
+
+        Partition() : parn(0), nextSequence(0), node(-1), recovering(false), stale(false) {}
+    };
+
+    struct Sent
+    {
+        Partition* part;
+        BatchPtr batch;
+    };
+    typedef std::vector<Sent> SentList;
+
+    void initProducerId();
+    void onInitProducerId(int err, const Unpack& body);
+    void renumber();
+    bool resolved() const;
+
+    bool drain(const MetadataSnapshot& snap);
+    BatchPtr nextBatch(Partition& p);
+    BatchPtr seal(Partition& p);
+
+    void onProduce(const SentList& sent, int err, const Unpack& body);
+    void completed(Partition& p, const BatchPtr& b, int64_t offset);
+    void retry(Partition& p, const BatchPtr& b, int16_t errcode);
+    void failed(Partition& p, const BatchPtr& b, int16_t errcode);
+    void takeOut(Partition& p, const BatchPtr& b);
+    void resetProducer(Partition& p);
+
+    static bool retriable(int16_t errcode);
+
+    BrokerPool& m_pool;
+    const MetadataCache& m_meta;
+    Options m_opts;
+
+    int64_t m_producerId;  // -1 until InitProducerId answered
+    int16_t m_producerEpoch;
+    bool m_initSent;
+    bool m_resetting;      // resolving unanswered batches before a new id
+    int64_t m_initAt;      // no InitProducerId before this
+    int64_t m_now;
+
+    std::map<std::pair<TopicName, int32_t>, Partition> m_parts;
+    PackBuffer m_scratch;
+
+    size_t m_pending;
+    size_t m_inFlight;
+    size_t m_retries;
+    size_t m_resets;
+};
+
+}
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "Packet.h"
+#include "Schema.h"
 #include "ApiConstants.h"
+#include "PartitionSet.h"
 #include <iostream>
 #include <map>
 #include <set>
@@ -14,9 +16,11 @@ struct QueryGroupCoordinator : public Marshallable
 
     std::string groupid;
 
+    typedef Schema<KAFKA_FIELD(QueryGroupCoordinator, groupid)> schema;
+
     void marshal(Pack &pk) const
     {
-        pk << groupid;
+        schema::encode(pk, *this);
     }
 };
 
@@ -28,9 +32,15 @@ struct QueryGroupCoordinatorRes : public Marshallable
     std::string coordHost;
     int32_t coordPort;
 
-    void unmarshal(const Unpack & up)
+    typedef Schema<
+        KAFKA_FIELD(QueryGroupCoordinatorRes, errcode),
+        KAFKA_FIELD(QueryGroupCoordinatorRes, coordinatorId),
+        KAFKA_FIELD(QueryGroupCoordinatorRes, coordHost),
+        KAFKA_FIELD(QueryGroupCoordinatorRes, coordPort)> schema;
+
+    void unmarshal(const Unpack &up)
     {
-        up >> errcode >> coordinatorId >> coordHost >> coordPort;
+        schema::decode(up, *this);
     }
 };
 
@@ -40,9 +50,14 @@ struct PartitionOffsetMeta : public Marshallable
     int64_t offset;
     std::string meta;
 
+    typedef Schema<
+        KAFKA_FIELD(PartitionOffsetMeta, parn),
+        KAFKA_FIELD(PartitionOffsetMeta, offset),
+        KAFKA_FIELD(PartitionOffsetMeta, meta)> schema;
+
     void marshal(Pack &pk) const
     {
-        pk << parn << offset << meta;
+        schema::encode(pk, *this);
     }
 };
 
@@ -51,9 +66,13 @@ struct TopicOffsetMeta : public Marshallable
     std::string topic;
     std::vector<PartitionOffsetMeta> parOffsetMetas;
 
+    typedef Schema<
+        KAFKA_FIELD(TopicOffsetMeta, topic),
+        KAFKA_FIELD(TopicOffsetMeta, parOffsetMetas)> schema;
+
     void marshal(Pack &pk) const
     {
-        pk << topic << parOffsetMetas;
+        schema::encode(pk, *this);
     }
 };
 
@@ -67,9 +86,16 @@ struct OffsetCommitRequest : public Marshallable
     int64_t retentionTime;
     std::vector<TopicOffsetMeta> offsets;
 
+    typedef Schema<
+        KAFKA_FIELD(OffsetCommitRequest, groupid),
+        KAFKA_FIELD(OffsetCommitRequest, generationId),
+        KAFKA_FIELD(OffsetCommitRequest, consumerId),
+        KAFKA_FIELD(OffsetCommitRequest, retentionTime),
+        KAFKA_FIELD(OffsetCommitRequest, offsets)> schema;
+
     void marshal(Pack &pk) const
     {
-        pk << groupid << generationId << consumerId << retentionTime << offsets;
+        schema::encode(pk, *this);
     }
 };
 
@@ -79,14 +105,18 @@ struct TopicBlock : public Marshallable
     std::string topic;
     std::vector<T> block;
 
+    typedef Schema<
+        KAFKA_FIELD(TopicBlock, topic),
+        KAFKA_FIELD(TopicBlock, block)> schema;
+
     void marshal(Pack &pk) const
-    { 
-        pk << topic << block;
+    {
+        schema::encode(pk, *this);
     }
 
     void unmarshal(const Unpack &up)
     {
-        up >> topic >> block;
+        schema::decode(up, *this);
     }
 };
 
@@ -96,9 +126,13 @@ struct PartitionErrcode : public Marshallable
     int32_t parn;
     int16_t errcode;
 
-    void unmarshal(const Unpack &up) 
+    typedef Schema<
+        KAFKA_FIELD(PartitionErrcode, parn),
+        KAFKA_FIELD(PartitionErrcode, errcode)> schema;
+
+    void unmarshal(const Unpack &up)
     {
-        up >> parn >> errcode;
+        schema::decode(up, *this);
     }
 };
 
@@ -106,51 +140,34 @@ struct OffsetCommitResponse : public Marshallable
 {
     std::vector<TopicBlock<PartitionErrcode>> result;
 
+    typedef Schema<KAFKA_FIELD(OffsetCommitResponse, result)> schema;
+
+    void reset() { result.clear(); }
+
     void unmarshal(const Unpack &up)
     {
-        up >> result;
+        schema::decode(up, *this);
     }
 };
 
 struct MemberSubToppars : public Marshallable
 {
     int32_t totalSize = 0;
-    std::map<std::string,std::set<int>> toppars;
+    PartitionSet toppars;
 
     void marshal(Pack &pk) const {
         size_t sizeHead = pk.size();
         pk << totalSize;
-        int16_t cnt = toppars.size();
-        pk << (int16_t)(toppars.size());
-        for(auto& parset : toppars) {
-            pk << parset.first;
-            pk << (int16_t)(parset.second.size());
-            for(auto par : parset.second) {
-                pk << (int32_t)par;
-            }
-        }
+        toppars.marshal16(pk);
         pk.replace_int32(sizeHead, pk.size() - sizeHead - 4);
     }
 
     void unmarshal(const Unpack & up) {
+        toppars.clear();
         up >> totalSize;
         if(totalSize <=0 )
             return;
-
-        int16_t cnt;
-        up >> cnt;
-        for(auto i = 0; i < cnt; ++i) {
-            std::string topic;
-            up >> topic;
-            std::set<int>& parset = toppars[topic];
-            int16_t parn;
-            up >> parn;
-            for(auto j = 0; j < parn; ++j) {
-                int32_t par;
-                up >> par;
-                parset.insert(par);
-            }
-        }
+        toppars.unmarshal16(up);
     }
 };
 
@@ -195,8 +212,15 @@ struct JoinGroupRequest : public Marshallable
     std::string prototype;
     std::vector<GroupProtocol> protocols;
 
+    typedef Schema<
+        KAFKA_FIELD(JoinGroupRequest, groupid),
+        KAFKA_FIELD(JoinGroupRequest, timeout),
+        KAFKA_FIELD(JoinGroupRequest, memberid),
+        KAFKA_FIELD(JoinGroupRequest, prototype),
+        KAFKA_FIELD(JoinGroupRequest, protocols)> schema;
+
     void marshal(Pack &pk) const {
-        pk << groupid << timeout << memberid << prototype << protocols;
+        schema::encode(pk, *this);
     }
 };
 
@@ -205,8 +229,12 @@ struct GroupMemberMeta : public Marshallable
     std::string memberid;
     ProtocolMetadata meta;
 
-    void unmarshal(const Unpack& up) {
-        up >> memberid >> meta;
+    typedef Schema<
+        KAFKA_FIELD(GroupMemberMeta, memberid),
+        KAFKA_FIELD(GroupMemberMeta, meta)> schema;
+
+    void unmarshal(const Unpack &up) {
+        schema::decode(up, *this);
     }
 };
 
@@ -219,23 +247,29 @@ struct JoinGroupResponse : public Marshallable
     std::string memberid;
     std::vector<GroupMemberMeta> members;
 
-    void unmarshal(const Unpack& up)
-    {
-        up >> errcode >> genid >> proto >> leaderid >> memberid >> members;
-    }
-};
+    typedef Schema<
+        KAFKA_FIELD(JoinGroupResponse, errcode),
+        KAFKA_FIELD(JoinGroupResponse, genid),
+        KAFKA_FIELD(JoinGroupResponse, proto),
+        KAFKA_FIELD(JoinGroupResponse, leaderid),
+        KAFKA_FIELD(JoinGroupResponse, memberid),
+        KAFKA_FIELD(JoinGroupResponse, members)> schema;
 
-struct TopicPartitionsBlock : public Marshallable
-{
-    std::string topic;
-    std::vector<int32_t> partitions;
+    JoinGroupResponse() : errcode(0), genid(-1) {}
 
-    void marshal(Pack &pk) const {
-        pk << topic << partitions;
+    void reset()
+    {
+        errcode = 0;
+        genid = -1;
+        proto.clear();
+        leaderid.clear();
+        memberid.clear();
+        members.clear();
     }
 
-    void unmarshal(const Unpack &up) {
-        up >> topic >> partitions;
+    void unmarshal(const Unpack &up)
+    {
+        schema::decode(up, *this);
     }
 };
 
@@ -243,9 +277,19 @@ struct MemberAssignment : public Marshallable
 {
     int32_t size;
     int16_t version;
-    std::vector<TopicPartitionsBlock> topicAssign;
+    PartitionSet topicAssign;
     std::string userdata;
 
+    MemberAssignment() : size(0), version(0) {}
+
+    void reset()
+    {
+        size = 0;
+        version = 0;
+        topicAssign.clear();
+        userdata.clear();
+    }
+
     void marshal(Pack &pk) const
     {
         size_t sizeHead = pk.size();
@@ -257,14 +301,18 @@ struct MemberAssignment : public Marshallable
 
     void unmarshal(const Unpack &up) {
         up >> size;
-        if(size <= 0)
+        if(size <= 0) {
+            version = 0;
+            topicAssign.clear();
+            userdata.clear();
             return;
+        }
 
         Unpack iup(up.data(), size);
         up.reset(up.data()+size, up.size() - size); // skip
 
         iup >> version >> topicAssign;
-        userdata = iup.pop_bytes();
+        iup.pop_bytes(userdata);
     }
 };
 
@@ -291,8 +339,20 @@ struct SyncGroupResponse : public Marshallable
     int16_t errcode;
     MemberAssignment assignment;
 
-    void unmarshal(const Unpack& up) {
-        up >> errcode >> assignment;
+    typedef Schema<
+        KAFKA_FIELD(SyncGroupResponse, errcode),
+        KAFKA_FIELD(SyncGroupResponse, assignment)> schema;
+
+    SyncGroupResponse() : errcode(0) {}
+
+    void reset()
+    {
+        errcode = 0;
+        assignment.reset();
+    }
+
+    void unmarshal(const Unpack &up) {
+        schema::decode(up, *this);
     }
 };
 
@@ -303,8 +363,13 @@ struct HeartbeatRequest : public Marshallable
     int32_t genid;
     std::string memberid;
 
+    typedef Schema<
+        KAFKA_FIELD(HeartbeatRequest, groupid),
+        KAFKA_FIELD(HeartbeatRequest, genid),
+        KAFKA_FIELD(HeartbeatRequest, memberid)> schema;
+
     void marshal(Pack &pk) const {
-        pk << groupid << genid << memberid;
+        schema::encode(pk, *this);
     }
 };
 
@@ -312,6 +377,9 @@ struct HeartbeatResponse : public Marshallable
 {
     int16_t errcode;
 
+    HeartbeatResponse() : errcode(0) {}
+    void reset() { errcode = 0; }
+
     void unmarshal(const Unpack& up) {
         up >> errcode;
     }
@@ -324,8 +392,12 @@ struct LeaveGroupRequest : public Marshallable
     std::string groupid;
     std::string memberid;
 
+    typedef Schema<
+        KAFKA_FIELD(LeaveGroupRequest, groupid),
+        KAFKA_FIELD(LeaveGroupRequest, memberid)> schema;
+
     void marshal(Pack &pk) const {
-        pk << groupid << memberid;
+        schema::encode(pk, *this);
     }
 };
 
@@ -333,6 +405,9 @@ struct LeaveGroupResponse : public Marshallable
 {
     int16_t errcode;
 
+    LeaveGroupResponse() : errcode(0) {}
+    void reset() { errcode = 0; }
+
     void unmarshal(const Unpack& up) {
         up >> errcode;
     }
@@ -342,8 +417,12 @@ struct GroupProtoInfo : public Marshallable {
     std::string groupid;
     std::string prototype;
 
-    void unmarshal(const Unpack& up) {
-        up >> groupid >> prototype;
+    typedef Schema<
+        KAFKA_FIELD(GroupProtoInfo, groupid),
+        KAFKA_FIELD(GroupProtoInfo, prototype)> schema;
+
+    void unmarshal(const Unpack &up) {
+        schema::decode(up, *this);
     }
 };
 
@@ -357,8 +436,20 @@ struct ListGroupResponse : public Marshallable
     int16_t errcode;
     std::vector<GroupProtoInfo> groups;
 
-    void unmarshal(const Unpack& up) {
-        up >> errcode >> groups;
+    typedef Schema<
+        KAFKA_FIELD(ListGroupResponse, errcode),
+        KAFKA_FIELD(ListGroupResponse, groups)> schema;
+
+    ListGroupResponse() : errcode(0) {}
+
+    void reset()
+    {
+        errcode = 0;
+        groups.clear();
+    }
+
+    void unmarshal(const Unpack &up) {
+        schema::decode(up, *this);
     }
 };
 
@@ -368,8 +459,10 @@ struct DescribeGroupRequest : public Marshallable
 
     std::vector<std::string> groupids;
 
+    typedef Schema<KAFKA_FIELD(DescribeGroupRequest, groupids)> schema;
+
     void marshal(Pack &pk) const {
-        pk << groupids;
+        schema::encode(pk, *this);
     }
 };
 
@@ -381,10 +474,16 @@ struct GroupMember : public Marshallable
     ProtocolMetadata protometa;
     MemberAssignment assignment;
 
-    void unmarshal(const Unpack& up)
+    typedef Schema<
+        KAFKA_FIELD(GroupMember, memberid),
+        KAFKA_FIELD(GroupMember, clientid),
+        KAFKA_FIELD(GroupMember, host),
+        KAFKA_FIELD(GroupMember, protometa),
+        KAFKA_FIELD(GroupMember, assignment)> schema;
+
+    void unmarshal(const Unpack &up)
     {
-        up >> memberid >> clientid >> host;
-        up >> protometa >> assignment;
+        schema::decode(up, *this);
     }
 };
 
@@ -396,9 +495,17 @@ struct GroupInfo : public Marshallable {
     std::string proto;
     std::vector<GroupMember> members;
 
+    typedef Schema<
+        KAFKA_FIELD(GroupInfo, errcode),
+        KAFKA_FIELD(GroupInfo, groupid),
+        KAFKA_FIELD(GroupInfo, state),
+        KAFKA_FIELD(GroupInfo, prototype),
+        KAFKA_FIELD(GroupInfo, proto),
+        KAFKA_FIELD(GroupInfo, members)> schema;
+
     void unmarshal(const Unpack &up)
     {
-        up >> errcode >> groupid >> state >> prototype >> proto >> members;
+        schema::decode(up, *this);
     }
 };
 
@@ -406,8 +513,12 @@ struct DescribeGroupResponse : public Marshallable
 {
     std::vector<GroupInfo> groupInfos;
 
+    typedef Schema<KAFKA_FIELD(DescribeGroupResponse, groupInfos)> schema;
+
+    void reset() { groupInfos.clear(); }
+
     void unmarshal(const Unpack &up) {
-        up >> groupInfos;
+        schema::decode(up, *this);
     }
 };
 
@@ -419,8 +530,12 @@ struct FetchGroupOffsetRequest : public Marshallable
     std::string groupid;
     std::vector<TopicPartitionsBlock> toppars;
 
+    typedef Schema<
+        KAFKA_FIELD(FetchGroupOffsetRequest, groupid),
+        KAFKA_FIELD(FetchGroupOffsetRequest, toppars)> schema;
+
     void marshal(Pack &pk) const {
-        pk << groupid << toppars;
+        schema::encode(pk, *this);
     }
 };
 
@@ -431,9 +546,15 @@ struct PartitionOffsetMetaRes : public Marshallable
     std::string meta;
     int16_t errcode;
 
-    void unmarshal(const Unpack &up) 
+    typedef Schema<
+        KAFKA_FIELD(PartitionOffsetMetaRes, parn),
+        KAFKA_FIELD(PartitionOffsetMetaRes, offset),
+        KAFKA_FIELD(PartitionOffsetMetaRes, meta),
+        KAFKA_FIELD(PartitionOffsetMetaRes, errcode)> schema;
+
+    void unmarshal(const Unpack &up)
     {
-        up >> parn >> offset >> meta >> errcode;
+        schema::decode(up, *this);
     }
 };
 
@@ -442,8 +563,12 @@ struct TopicPartitionsOffsetBlock : public Marshallable
     std::string topic;
     std::vector<PartitionOffsetMetaRes> partitionOffsets;
 
+    typedef Schema<
+        KAFKA_FIELD(TopicPartitionsOffsetBlock, topic),
+        KAFKA_FIELD(TopicPartitionsOffsetBlock, partitionOffsets)> schema;
+
     void unmarshal(const Unpack &up) {
-        up >> topic >> partitionOffsets;
+        schema::decode(up, *this);
     }
 };
 
@@ -452,8 +577,12 @@ struct FetchGroupOffsetResponse : public Marshallable
     std::string groupid; // not packed
     std::vector<TopicPartitionsOffsetBlock> offsets;
 
+    typedef Schema<KAFKA_FIELD(FetchGroupOffsetResponse, offsets)> schema;
+
+    void reset() { offsets.clear(); } // groupid is the caller's
+
     void unmarshal(const Unpack &up) {
-        up >> offsets;
+        schema::decode(up, *this);
     }
 };
 
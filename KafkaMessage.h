@@ -1,7 +1,9 @@
 #pragma once
 
 #include "Packet.h"
+#include "Schema.h"
 #include "ApiConstants.h"
+#include "PartitionSet.h"
 #include <iostream>
 
 namespace kafkaprotocpp {
@@ -11,15 +13,22 @@ struct Broker : public Marshallable
     int32_t nodeid;
     std::string host;
     int32_t port;
+    std::string rack; // since v1, empty if the broker has none
+
+    typedef Schema<
+        KAFKA_FIELD(Broker, nodeid),
+        KAFKA_FIELD(Broker, host),
+        KAFKA_FIELD(Broker, port),
+        KAFKA_FIELD_V(Broker, rack, 1, KAFKA_MAX_VER)> schema;
 
     virtual void marshal(Pack &pk) const
     {
-        pk << nodeid << host << port;
+        schema::encode(pk, *this);
     }
 
     virtual void unmarshal(const Unpack &up)
     {
-        up >> nodeid >> host >> port;
+        schema::decode(up, *this);
     }
 };
 
@@ -31,68 +40,116 @@ struct PartitionMetadata : public Marshallable
     std::vector<int32_t> replicas;
     std::vector<int32_t> isr;
 
+    typedef Schema<
+        KAFKA_FIELD(PartitionMetadata, errcode),
+        KAFKA_FIELD(PartitionMetadata, parid),
+        KAFKA_FIELD(PartitionMetadata, leader),
+        KAFKA_FIELD(PartitionMetadata, replicas),
+        KAFKA_FIELD(PartitionMetadata, isr)> schema;
+
     virtual void marshal(Pack &pk) const
     {
-        pk << errcode << parid << leader;
-        marshal_container(pk, replicas);
-        marshal_container(pk, isr);
+        schema::encode(pk, *this);
     }
 
     virtual void unmarshal(const Unpack &up)
     {
-        up >> errcode >> parid >> leader;
-        unmarshal_container(up, std::back_inserter(replicas));
-        unmarshal_container(up, std::back_inserter(isr));
+        schema::decode(up, *this);
     }
 };
 
 struct TopicMetadata : public Marshallable
 {
     int16_t errcode;
-    std::string strTopic;
+    TopicName strTopic;
+    int8_t isInternal = 0; // since v1
     std::vector<PartitionMetadata> vecParMeta;
 
+    typedef Schema<
+        KAFKA_FIELD(TopicMetadata, errcode),
+        KAFKA_FIELD(TopicMetadata, strTopic),
+        KAFKA_FIELD_V(TopicMetadata, isInternal, 1, KAFKA_MAX_VER),
+        KAFKA_FIELD(TopicMetadata, vecParMeta)> schema;
+
     virtual void marshal(Pack &pk) const
     {
-        pk << errcode << strTopic << vecParMeta;
+        schema::encode(pk, *this);
     }
 
     virtual void unmarshal(const Unpack &up)
     {
-        up >> errcode >> strTopic >> vecParMeta;
+        schema::decode(up, *this);
     }
 };
 
 struct MetadataRequest : public Marshallable
 {
-    enum { apikey = ApiConstants::METADATA_REQUEST_KEY, apiver = ApiConstants::API_VERSION0};
+    enum { apikey = ApiConstants::METADATA_REQUEST_KEY, apiver = ApiConstants::API_VERSION0,
+        apiminver = ApiConstants::API_VERSION0, apimaxver = ApiConstants::API_VERSION1};
 
-    std::vector<std::string> vecTopic;
+    std::vector<std::string> vecTopic; // empty for all topics
+
+    typedef Schema<KAFKA_FIELD(MetadataRequest, vecTopic)> schema;
 
     virtual void marshal(Pack &pk) const
     {
-        pk << vecTopic;
+        schema::encode(pk, *this);
+    }
+    // since v1 an empty array means no topics, all topics is a null array
+    virtual void marshal(Pack &pk, int ver) const
+    {
+        if(ver >= 1 && vecTopic.empty())
+            pk.push_int32(-1);
+        else
+            schema::encode(pk, *this, ver);
     }
     virtual void unmarshal(const Unpack &up)
     {
-        up >> vecTopic;
+        schema::decode(up, *this);
     }
 
 };
 
+// Reusing response objects: decoding resizes every vector to the count on the
+// wire and decodes over the elements already there, so an object decoded again
+// without reset() keeps the capacity of all its nested vectors and strings;
+// that is the allocation-free path. reset() empties a response (scalars back to
+// their defaults, vectors cleared, their own capacity kept), for callers that
+// need it empty between uses, e.g. to drop an answer that failed to decode.
 struct MetadataResponse : public Marshallable
 {
     std::vector<Broker> vecBroker;
+    int32_t controllerId = -1; // since v1
     std::vector<TopicMetadata> vecTopicMeta;
 
+    void reset()
+    {
+        vecBroker.clear();
+        controllerId = -1;
+        vecTopicMeta.clear();
+    }
+
+    typedef Schema<
+        KAFKA_FIELD(MetadataResponse, vecBroker),
+        KAFKA_FIELD_V(MetadataResponse, controllerId, 1, KAFKA_MAX_VER),
+        KAFKA_FIELD(MetadataResponse, vecTopicMeta)> schema;
+
     virtual void marshal(Pack &pk) const
     {
-        pk << vecBroker << vecTopicMeta;
+        schema::encode(pk, *this);
+    }
+    virtual void marshal(Pack &pk, int ver) const
+    {
+        schema::encode(pk, *this, ver);
     }
 
     virtual void unmarshal(const Unpack &up)
     {
-        up >> vecBroker >> vecTopicMeta;
+        schema::decode(up, *this);
+    }
+    virtual void unmarshal(const Unpack &up, int ver)
+    {
+        schema::decode(up, *this, ver);
     }
 };
 
@@ -122,7 +179,7 @@ struct Message : public Marshallable
 
     Message() : offset(0), size(0), timestamp(-1) {}
     Message(int8_t magic_, int8_t attr_, int64_t ts_, std::string&& key_, std::string&& value_) :
-        offset(0), magicByte(magic_), attr(attr_), timestamp(ts_), key(key_), value(value_) {
+        offset(0), magicByte(magic_), attr(attr_), timestamp(ts_), key(std::move(key_)), value(std::move(value_)) {
             size = 8 + 4 + 4 + 1 + 1 + 8 + 4 + key.length() + 4 + value.length();
         }
 
@@ -142,19 +199,62 @@ struct Message : public Marshallable
     }
 
     virtual void unmarshal(const Unpack &up) {
-        if(up.size() < 8 + 4)
-            throw IncompletePacket("offset and size of this msg is missing");
-        
-        up >> offset >> size;
-        if(up.size() < size) // incomplete message, just ignore it
+        switch(decode(up)) {
+        case DECODE_INCOMPLETE:
             throw IncompletePacket("msg is incomplete");
+        case DECODE_MALFORMED:
+            throw UnpackError("msg is malformed");
+        default:
+            break;
+        }
+    }
 
-        up >> crc >> magicByte >> attr;
+    // Non-throwing decode. The whole message is bounds-checked once, fields
+    // are then read unchecked. On error up is left where it was.
+    DecodeStatus decode(const Unpack &up) {
+        if(!up.has(8 + 4))
+            return DECODE_INCOMPLETE;
+        int64_t off = load_be64(up.data());
+        int32_t sz = load_be32(up.data() + 8);
+        if(sz < 0)
+            return DECODE_MALFORMED;
+        if(up.size() - 12 < (size_t)sz)
+            return DECODE_INCOMPLETE;
+
+        Unpack mup(up.data() + 12, sz);
+        // crc, magic, attr, key length
+        if(!mup.has(4 + 1 + 1 + 4))
+            return DECODE_MALFORMED;
+        crc = mup.take_int32();
+        magicByte = mup.take_int8();
+        attr = mup.take_int8();
+        timestamp = -1;
         if(version() == 1) {
-            up >> timestamp;
-        } 
-        key = up.pop_bytes();
-        value = up.pop_bytes();
+            if(!mup.has(8 + 4))
+                return DECODE_MALFORMED;
+            timestamp = mup.take_int64();
+        }
+        if(!take_bytes(mup, key) || !mup.has(4) || !take_bytes(mup, value))
+            return DECODE_MALFORMED;
+
+        offset = off;
+        size = sz;
+        up.take_ptr(12 + sz);
+        return DECODE_OK;
+    }
+
+private:
+    // length already known to be there
+    static bool take_bytes(const Unpack &up, std::string &s) {
+        int32_t len = up.take_int32();
+        if(len <= 0) {
+            s.clear();
+            return true;
+        }
+        if(!up.has(len))
+            return false;
+        s.assign(up.take_ptr(len), len);
+        return true;
     }
 };
 
@@ -167,29 +267,57 @@ struct MessageSet : public Marshallable
 
     void pushMessage(Message&& msg) {
         size += msg.size;
-        msgSet.emplace_back(msg);
+        msgSet.emplace_back(std::move(msg));
+    }
+
+    // empty the set for reuse, keeping its capacity
+    void reset() {
+        size = 0;
+        msgSet.clear();
     }
 
     virtual void marshal(Pack &pk) const 
     {
-        for(auto msg : msgSet) {
-            msg.marshal(pk);
+        for(auto& msg : msgSet) {
+            msg.Message::marshal(pk);
         }
     }
 
     virtual void unmarshal(const Unpack &up)
     {
-        Unpack iup(up.data(), size);
-        up.reset(up.data()+size, up.size() - size); // skip this messageset
+        switch(decode(up)) {
+        case DECODE_INCOMPLETE:
+            throw UnpackError("MessageSet: not enough data");
+        case DECODE_MALFORMED:
+            throw UnpackError("MessageSet: malformed message");
+        default: // a truncated tail is just ignored
+            break;
+        }
+    }
+
+    // Non-throwing decode of 'size' bytes. Decodes over the messages already
+    // held, so their key/value strings are reused when the set is decoded
+    // again. Returns DECODE_TRUNCATED if the set ends in a partial message.
+    DecodeStatus decode(const Unpack &up)
+    {
+        if(size < 0)
+            return DECODE_MALFORMED;
+        if(!up.has(size))
+            return DECODE_INCOMPLETE;
+        Unpack iup(up.take_ptr(size), size);
+
+        DecodeStatus st = DECODE_OK;
+        size_t n = 0;
         while(! iup.empty()) {
-            Message msg;
-            try {
-                msg.unmarshal(iup);
-                msgSet.push_back(msg);
-            } catch(IncompletePacket& ipe) {
-                iup.reset(iup.data()+iup.size(), 0);
-            }
+            if(n == msgSet.size())
+                msgSet.emplace_back();
+            st = msgSet[n].decode(iup);
+            if(st != DECODE_OK)
+                break;
+            ++n;
         }
+        msgSet.resize(n);
+        return st == DECODE_INCOMPLETE ? DECODE_TRUNCATED : st;
     }
 };
 
@@ -197,42 +325,77 @@ struct FetchPartitionRequestUnit : public Marshallable
 {
     int32_t parn;
     int64_t offset;
+    int64_t logStartOffset; // since v5, -1 from consumers
     int32_t maxBytes;
 
-    FetchPartitionRequestUnit(int32_t p, int64_t o, int32_t mb) : parn(p), offset(o), maxBytes(mb) {}
+    FetchPartitionRequestUnit(int32_t p, int64_t o, int32_t mb) : parn(p), offset(o), logStartOffset(-1), maxBytes(mb) {}
+
+    typedef Schema<
+        KAFKA_FIELD(FetchPartitionRequestUnit, parn),
+        KAFKA_FIELD(FetchPartitionRequestUnit, offset),
+        KAFKA_FIELD_V(FetchPartitionRequestUnit, logStartOffset, 5, KAFKA_MAX_VER),
+        KAFKA_FIELD(FetchPartitionRequestUnit, maxBytes)> schema;
 
     void marshal(Pack &pk) const
     {
-        pk << parn << offset << maxBytes;
+        schema::encode(pk, *this);
     }
 };
 
 struct FetchTopicRequestUnit : public Marshallable
 {
-    std::string topicStr;
+    TopicName topicStr;
     std::vector<FetchPartitionRequestUnit> fetchParVec;
 
-    FetchTopicRequestUnit(const std::string& t) : topicStr(t) {}
+    FetchTopicRequestUnit(const TopicName& t) : topicStr(t) {}
+
+    typedef Schema<
+        KAFKA_FIELD(FetchTopicRequestUnit, topicStr),
+        KAFKA_FIELD(FetchTopicRequestUnit, fetchParVec)> schema;
 
     void marshal(Pack &pk) const
     {
-        pk << topicStr << fetchParVec;
+        schema::encode(pk, *this);
     }
 };
 
 // FetchRequest有3个版本:v0/v1/v2，3个版本的请求格式一样，但是回包格式不一样
 // 其中v0版本的回包没有ThrottleTime字段;
 // 其中v0/v1只能拉回来v0版本的Message, v2可以拉回来v0/v1版本的Message
+// v3请求增加了maxBytes(整个回包的上限)，回包格式与v2相同
+// v4起回包按存储格式返回(可能是RecordBatch)，v7增加了增量fetch session，见FetchRequestV7
 struct FetchRequest : public Marshallable
 {
+    enum { apiminver = ApiConstants::API_VERSION0, apimaxver = ApiConstants::API_VERSION3};
+
     int32_t replicaId;
     int32_t maxWaitTimeMs;
     int32_t minBytes;
+    int32_t maxBytes = 0x7fffffff; // since v3
+    int8_t isolationLevel = 0;     // since v4, 0 read uncommitted, 1 read committed
+    int32_t sessionId = 0;         // since v7
+    int32_t sessionEpoch = -1;     // since v7, -1 without a session
     std::vector<FetchTopicRequestUnit> fetchTopicVec;
+    std::vector<TopicPartitionsBlock> forgottenTopics; // since v7, dropped from the session
+
+    typedef Schema<
+        KAFKA_FIELD(FetchRequest, replicaId),
+        KAFKA_FIELD(FetchRequest, maxWaitTimeMs),
+        KAFKA_FIELD(FetchRequest, minBytes),
+        KAFKA_FIELD_V(FetchRequest, maxBytes, 3, KAFKA_MAX_VER),
+        KAFKA_FIELD_V(FetchRequest, isolationLevel, 4, KAFKA_MAX_VER),
+        KAFKA_FIELD_V(FetchRequest, sessionId, 7, KAFKA_MAX_VER),
+        KAFKA_FIELD_V(FetchRequest, sessionEpoch, 7, KAFKA_MAX_VER),
+        KAFKA_FIELD(FetchRequest, fetchTopicVec),
+        KAFKA_FIELD_V(FetchRequest, forgottenTopics, 7, KAFKA_MAX_VER)> schema;
 
     void marshal(Pack &pk) const
     {
-        pk << replicaId << maxWaitTimeMs << minBytes << fetchTopicVec;
+        schema::encode(pk, *this);
+    }
+    void marshal(Pack &pk, int ver) const
+    {
+        schema::encode(pk, *this, ver);
     }
 };
 
@@ -251,12 +414,41 @@ struct FetchRequestV2 : public FetchRequest
     enum { apikey = ApiConstants::FETCH_REQUEST_KEY, apiver = ApiConstants::API_VERSION2};
 };
 
-struct FetchPartitionResponseUnit : public Marshallable
+struct FetchRequestV3 : public FetchRequest
+{
+    enum { apikey = ApiConstants::FETCH_REQUEST_KEY, apiver = ApiConstants::API_VERSION3};
+
+    using FetchRequest::marshal;
+    void marshal(Pack &pk) const
+    {
+        schema::encode(pk, *this, apiver);
+    }
+};
+
+// With a session (see FetchSession) only partitions that changed are listed,
+// and the response only carries partitions with records or errors.
+struct FetchRequestV7 : public FetchRequest
+{
+    enum { apikey = ApiConstants::FETCH_REQUEST_KEY, apiver = ApiConstants::API_VERSION7,
+        apiminver = ApiConstants::API_VERSION7, apimaxver = ApiConstants::API_VERSION7};
+
+    using FetchRequest::marshal;
+    void marshal(Pack &pk) const
+    {
+        schema::encode(pk, *this, apiver);
+    }
+};
+
+// The fetch response structs are templates over the message-set decoder, so
+// the same layout can decode into MessageSet or any alternative such as
+// MessageColumns. The plain names below keep using MessageSet.
+template <class MS>
+struct FetchPartitionResponseUnitT : public Marshallable
 {
     int32_t parn;
     int16_t errcode;
     int64_t highWatherMarkOffset;
-    MessageSet msgSet;
+    MS msgSet;
 
     void unmarshal(const Unpack &up)
     {
@@ -264,51 +456,244 @@ struct FetchPartitionResponseUnit : public Marshallable
         up >> msgSet.size;
         up >> msgSet;
     }
+
+    // non-throwing, for message sets that have decode()
+    DecodeStatus decode(const Unpack &up)
+    {
+        // parn, errcode, high watermark, set size
+        if(!up.has(4 + 2 + 8 + 4))
+            return DECODE_INCOMPLETE;
+        parn = up.take_int32();
+        errcode = up.take_int16();
+        highWatherMarkOffset = up.take_int64();
+        msgSet.size = up.take_int32();
+        return msgSet.decode(up);
+    }
 };
 
-struct FetchTopicResponseUnit : public Marshallable
+template <class MS>
+struct FetchTopicResponseUnitT : public Marshallable
 {
-    std::string topic;
-    std::vector<FetchPartitionResponseUnit> fetchParResult;
+    TopicName topic;
+    std::vector<FetchPartitionResponseUnitT<MS> > fetchParResult;
+
+    typedef Schema<
+        KAFKA_FIELD(FetchTopicResponseUnitT, topic),
+        KAFKA_FIELD(FetchTopicResponseUnitT, fetchParResult)> schema;
 
     void unmarshal(const Unpack &up)
     {
-        up >> topic >> fetchParResult;
+        schema::decode(up, *this);
+    }
+
+    DecodeStatus decode(const Unpack &up)
+    {
+        if(!up.has(2))
+            return DECODE_INCOMPLETE;
+        int16_t len = up.take_int16();
+        if(len < 0)
+            len = 0;
+        if(!up.has(len))
+            return DECODE_INCOMPLETE;
+        topic = len > 0 ? TopicName(up.take_ptr(len), len) : TopicName();
+        return decode_vector(up, fetchParResult);
     }
 };
 
-struct FetchResponseV0 : public Marshallable
+// all fetch response versions in one struct, throttleTime exists since v1
+template <class MS, int Ver>
+struct FetchResponseT : public Marshallable
 {
-    std::vector<FetchTopicResponseUnit> result;
+    enum { apiver = Ver };
+
+    int32_t throttleTime;
+    std::vector<FetchTopicResponseUnitT<MS> > result;
+
+    typedef Schema<
+        KAFKA_FIELD_V(FetchResponseT, throttleTime, 1, KAFKA_MAX_VER),
+        KAFKA_FIELD(FetchResponseT, result)> schema;
+
+    FetchResponseT() : throttleTime(0) {}
+
+    void reset()
+    {
+        throttleTime = 0;
+        result.clear();
+    }
 
     virtual void unmarshal(const Unpack &up)
     {
-        up >> result;
+        schema::decode(up, *this, Ver);
+    }
+    // the version actually requested, which may be newer than Ver
+    virtual void unmarshal(const Unpack &up, int ver)
+    {
+        schema::decode(up, *this, ver);
+    }
+
+    // Non-throwing decode, for message sets that have decode() (MessageSet,
+    // LazyMessageSet). DECODE_TRUNCATED means at least one partition's set
+    // ended in a partial message, which the broker does routinely.
+    DecodeStatus decode(const Unpack &up)
+    {
+        if(Ver >= 1) {
+            if(!up.has(4))
+                return DECODE_INCOMPLETE;
+            throttleTime = up.take_int32();
+        }
+        return decode_vector(up, result);
     }
 };
 
-struct FetchResponseV1 : public FetchResponseV0
+template <class MS> using FetchResponseV0T = FetchResponseT<MS, 0>;
+template <class MS> using FetchResponseV1T = FetchResponseT<MS, 1>;
+template <class MS> using FetchResponseV2T = FetchResponseT<MS, 2>;
+template <class MS> using FetchResponseV3T = FetchResponseT<MS, 3>;
+
+typedef FetchPartitionResponseUnitT<MessageSet> FetchPartitionResponseUnit;
+typedef FetchTopicResponseUnitT<MessageSet> FetchTopicResponseUnit;
+typedef FetchResponseV0T<MessageSet> FetchResponseV0;
+typedef FetchResponseV1T<MessageSet> FetchResponseV1;
+typedef FetchResponseV2T<MessageSet> FetchResponseV2;
+typedef FetchResponseV3T<MessageSet> FetchResponseV3;
+
+struct AbortedTransaction : public Marshallable
 {
-    int32_t throttleTime;
+    int64_t producerId;
+    int64_t firstOffset;
 
-    virtual void unmarshal(const Unpack &up)
+    typedef Schema<
+        KAFKA_FIELD(AbortedTransaction, producerId),
+        KAFKA_FIELD(AbortedTransaction, firstOffset)> schema;
+
+    void unmarshal(const Unpack &up)
+    {
+        schema::decode(up, *this);
+    }
+};
+
+// Fetch v7 response, templated like FetchResponseT. Records are in the format
+// they were stored in, so RS is normally LazyRecordSet (RecordBatch.h), or
+// MessageSet when every producer writes magic 0/1.
+template <class RS>
+struct FetchPartitionResponseUnitV7T : public Marshallable
+{
+    int32_t parn;
+    int16_t errcode;
+    int64_t highWatherMarkOffset;
+    int64_t lastStableOffset;
+    int64_t logStartOffset;
+    std::vector<AbortedTransaction> abortedTransactions;
+    RS records;
+
+    void unmarshal(const Unpack &up)
     {
-        up >> throttleTime;
-        FetchResponseV0::unmarshal(up);
+        up >> parn >> errcode >> highWatherMarkOffset >> lastStableOffset >> logStartOffset;
+        FieldCodec<std::vector<AbortedTransaction> >::decode(up, abortedTransactions, ApiConstants::API_VERSION7);
+        up >> records.size;
+        if(records.size < 0) // null records
+            records.size = 0;
+        up >> records;
+    }
+
+    DecodeStatus decode(const Unpack &up)
+    {
+        if(!up.has(4 + 2 + 8 + 8 + 8 + 4))
+            return DECODE_INCOMPLETE;
+        parn = up.take_int32();
+        errcode = up.take_int16();
+        highWatherMarkOffset = up.take_int64();
+        lastStableOffset = up.take_int64();
+        logStartOffset = up.take_int64();
+        int32_t count = up.take_int32();
+        if(count < 0)
+            count = 0;
+        if(!up.has((size_t)count * 16 + 4))
+            return DECODE_INCOMPLETE;
+        abortedTransactions.resize(count);
+        for(auto& at : abortedTransactions) {
+            at.producerId = up.take_int64();
+            at.firstOffset = up.take_int64();
+        }
+        records.size = up.take_int32();
+        if(records.size < 0)
+            records.size = 0;
+        return records.decode(up);
     }
 };
 
-struct FetchResponseV2 : public FetchResponseV0
+template <class RS>
+struct FetchTopicResponseUnitV7T : public Marshallable
 {
+    TopicName topic;
+    std::vector<FetchPartitionResponseUnitV7T<RS> > fetchParResult;
+
+    typedef Schema<
+        KAFKA_FIELD(FetchTopicResponseUnitV7T, topic),
+        KAFKA_FIELD(FetchTopicResponseUnitV7T, fetchParResult)> schema;
+
+    void unmarshal(const Unpack &up)
+    {
+        schema::decode(up, *this);
+    }
+
+    DecodeStatus decode(const Unpack &up)
+    {
+        if(!up.has(2))
+            return DECODE_INCOMPLETE;
+        int16_t len = up.take_int16();
+        if(len < 0)
+            len = 0;
+        if(!up.has(len))
+            return DECODE_INCOMPLETE;
+        topic = len > 0 ? TopicName(up.take_ptr(len), len) : TopicName();
+        return decode_vector(up, fetchParResult);
+    }
+};
+
+// errcode is the session's: FETCH_SESSION_ID_NOT_FOUND or
+// INVALID_FETCH_SESSION_EPOCH mean the next fetch must be a full one
+template <class RS>
+struct FetchResponseV7T : public Marshallable
+{
+    enum { apiver = ApiConstants::API_VERSION7 };
+
     int32_t throttleTime;
+    int16_t errcode;
+    int32_t sessionId;
+    std::vector<FetchTopicResponseUnitV7T<RS> > result;
+
+    typedef Schema<
+        KAFKA_FIELD(FetchResponseV7T, throttleTime),
+        KAFKA_FIELD(FetchResponseV7T, errcode),
+        KAFKA_FIELD(FetchResponseV7T, sessionId),
+        KAFKA_FIELD(FetchResponseV7T, result)> schema;
+
+    FetchResponseV7T() : throttleTime(0), errcode(0), sessionId(0) {}
+
+    void reset()
+    {
+        throttleTime = 0;
+        errcode = 0;
+        sessionId = 0;
+        result.clear();
+    }
 
     virtual void unmarshal(const Unpack &up)
     {
-        up >> throttleTime;
-        FetchResponseV0::unmarshal(up);
+        schema::decode(up, *this, apiver);
     }
-};
 
+    DecodeStatus decode(const Unpack &up)
+    {
+        if(!up.has(4 + 2 + 4))
+            return DECODE_INCOMPLETE;
+        throttleTime = up.take_int32();
+        errcode = up.take_int16();
+        sessionId = up.take_int32();
+        return decode_vector(up, result);
+    }
+};
 
 struct MessageExtraInfo {
     void* opaque;
@@ -332,12 +717,16 @@ struct ProducePartitionReqUnit : public Marshallable
 
 struct ProduceTopicReqUnit : public Marshallable
 {
-    std::string topic;
+    TopicName topic;
     std::vector<ProducePartitionReqUnit> parMsgSets;
 
+    typedef Schema<
+        KAFKA_FIELD(ProduceTopicReqUnit, topic),
+        KAFKA_FIELD(ProduceTopicReqUnit, parMsgSets)> schema;
+
     void marshal(Pack &pk) const
     {
-        pk << topic << parMsgSets;
+        schema::encode(pk, *this);
     }
 };
 
@@ -350,9 +739,14 @@ struct ProduceRequest : public Marshallable
     int32_t timeout; // max time in milliseconds the server can await the receipt of the number of ack.
     std::vector<ProduceTopicReqUnit> topicMsgSets;
 
+    typedef Schema<
+        KAFKA_FIELD(ProduceRequest, ack),
+        KAFKA_FIELD(ProduceRequest, timeout),
+        KAFKA_FIELD(ProduceRequest, topicMsgSets)> schema;
+
     void marshal(Pack &pk) const
     {
-        pk << ack << timeout << topicMsgSets;
+        schema::encode(pk, *this);
     };
 };
 
@@ -363,20 +757,30 @@ struct ProducePartitionResUnit : public Marshallable
     int64_t offset;
     int64_t timestamp; // if LogAppendTime is used on Broker, this field return the LogAppendTime of the fir message in msgset
 
+    typedef Schema<
+        KAFKA_FIELD(ProducePartitionResUnit, parn),
+        KAFKA_FIELD(ProducePartitionResUnit, errcode),
+        KAFKA_FIELD(ProducePartitionResUnit, offset),
+        KAFKA_FIELD(ProducePartitionResUnit, timestamp)> schema;
+
     void unmarshal(const Unpack &up)
     {
-        up >> parn >> errcode >> offset >> timestamp;
+        schema::decode(up, *this);
     }
 };
 
 struct ProduceTopicResUnit : public Marshallable
 {
-    std::string topic;
+    TopicName topic;
     std::vector<ProducePartitionResUnit> parRespVec;
 
+    typedef Schema<
+        KAFKA_FIELD(ProduceTopicResUnit, topic),
+        KAFKA_FIELD(ProduceTopicResUnit, parRespVec)> schema;
+
     void unmarshal(const Unpack &up)
     {
-        up >> topic >> parRespVec;
+        schema::decode(up, *this);
     }
 };
 
@@ -385,9 +789,74 @@ struct ProduceResponseV2 : public Marshallable
     std::vector<ProduceTopicResUnit> topicRespVec;
     int32_t throttleTime;
 
+    typedef Schema<
+        KAFKA_FIELD(ProduceResponseV2, topicRespVec),
+        KAFKA_FIELD(ProduceResponseV2, throttleTime)> schema;
+
+    ProduceResponseV2() : throttleTime(0) {}
+
+    void reset()
+    {
+        topicRespVec.clear();
+        throttleTime = 0;
+    }
+
     void unmarshal(const Unpack& up)
     {
-        up >> topicRespVec >> throttleTime;
+        schema::decode(up, *this);
+    }
+};
+
+// produce v3 answers in the v2 layout
+typedef ProduceResponseV2 ProduceResponseV3;
+
+// Asks for the producer id and epoch an idempotent producer stamps its
+// batches with; no transactionalId for a plain idempotent producer.
+struct InitProducerIdRequest : public Marshallable
+{
+    enum { apikey = ApiConstants::INIT_PRODUCER_ID_REQUEST_KEY, apiver = ApiConstants::API_VERSION0};
+
+    std::string transactionalId; // empty for none (null on the wire)
+    int32_t transactionTimeoutMs;
+
+    InitProducerIdRequest() : transactionTimeoutMs(60000) {}
+
+    void marshal(Pack &pk) const
+    {
+        if(transactionalId.empty())
+            pk.push_int16(-1);
+        else
+            pk.push_string(transactionalId);
+        pk.push_int32(transactionTimeoutMs);
+    }
+};
+
+struct InitProducerIdResponse : public Marshallable
+{
+    int32_t throttleTime;
+    int16_t errcode;
+    int64_t producerId;
+    int16_t producerEpoch;
+
+    typedef Schema<
+        KAFKA_FIELD(InitProducerIdResponse, throttleTime),
+        KAFKA_FIELD(InitProducerIdResponse, errcode),
+        KAFKA_FIELD(InitProducerIdResponse, producerId),
+        KAFKA_FIELD(InitProducerIdResponse, producerEpoch)> schema;
+
+    InitProducerIdResponse() { reset(); }
+
+    void reset()
+    {
+        throttleTime = 0;
+        errcode = 0;
+        producerId = -1;
+        producerEpoch = -1;
+    }
+
+    void unmarshal(const Unpack &up)
+    {
+        schema::decode(up, *this);
     }
 };
 
@@ -395,34 +864,55 @@ struct ListOffsetReqPartitionUnit : public Marshallable
 {
     int32_t parn;
     int64_t time_before; // req the offset before a certain time(ms), -1 means the latest offset, -2 means the oldest offset
+    int32_t maxNumOffsets; // v0 only
+
+    ListOffsetReqPartitionUnit() : parn(0), time_before(-1), maxNumOffsets(1) {}
+
+    typedef Schema<
+        KAFKA_FIELD(ListOffsetReqPartitionUnit, parn),
+        KAFKA_FIELD(ListOffsetReqPartitionUnit, time_before),
+        KAFKA_FIELD_V(ListOffsetReqPartitionUnit, maxNumOffsets, 0, 0)> schema;
 
     void marshal(Pack &pk) const
     {
-        pk << parn << time_before;
+        schema::encode(pk, *this, ApiConstants::API_VERSION1);
     }
 };
 
 struct ListOffsetReqTopicUnit : public Marshallable
 {
-    std::string topic;
+    TopicName topic;
     std::vector<ListOffsetReqPartitionUnit> parReqVec;
 
+    typedef Schema<
+        KAFKA_FIELD(ListOffsetReqTopicUnit, topic),
+        KAFKA_FIELD(ListOffsetReqTopicUnit, parReqVec)> schema;
+
     void marshal(Pack & pk) const
     {
-        pk << topic << parReqVec;
+        schema::encode(pk, *this, ApiConstants::API_VERSION1);
     }
 };
 
 struct ListOffsetRequest : public Marshallable
 {
-    enum { apikey = ApiConstants::LIST_OFFSET_REQUEST_KEY, apiver = ApiConstants::API_VERSION1};
+    enum { apikey = ApiConstants::LIST_OFFSET_REQUEST_KEY, apiver = ApiConstants::API_VERSION1,
+        apiminver = ApiConstants::API_VERSION0, apimaxver = ApiConstants::API_VERSION1};
 
     int32_t replicaId;
     std::vector<ListOffsetReqTopicUnit> topicReqVec;
 
+    typedef Schema<
+        KAFKA_FIELD(ListOffsetRequest, replicaId),
+        KAFKA_FIELD(ListOffsetRequest, topicReqVec)> schema;
+
     void marshal(Pack &pk) const
     {
-        pk << replicaId << topicReqVec;
+        schema::encode(pk, *this, apiver);
+    }
+    void marshal(Pack &pk, int ver) const
+    {
+        schema::encode(pk, *this, ver);
     }
 };
 
@@ -430,23 +920,35 @@ struct PartitionOffsets : public Marshallable
 {
     int32_t parn;
     int16_t errcode;
+    std::vector<int64_t> offsets; // v0 only
     int64_t timestamp;
     int64_t offset;
 
+    typedef Schema<
+        KAFKA_FIELD(PartitionOffsets, parn),
+        KAFKA_FIELD(PartitionOffsets, errcode),
+        KAFKA_FIELD_V(PartitionOffsets, offsets, 0, 0),
+        KAFKA_FIELD_V(PartitionOffsets, timestamp, 1, KAFKA_MAX_VER),
+        KAFKA_FIELD_V(PartitionOffsets, offset, 1, KAFKA_MAX_VER)> schema;
+
     void unmarshal(const Unpack &up)
     {
-        up >> parn >> errcode >> timestamp >> offset;
+        schema::decode(up, *this, ApiConstants::API_VERSION1);
     }
 };
 
 struct TopicOffsets : public Marshallable
 {
-    std::string topic;
+    TopicName topic;
     std::vector<PartitionOffsets> parOffsets;
 
+    typedef Schema<
+        KAFKA_FIELD(TopicOffsets, topic),
+        KAFKA_FIELD(TopicOffsets, parOffsets)> schema;
+
     void unmarshal(const Unpack &up)
     {
-        up >> topic >> parOffsets;
+        schema::decode(up, *this, ApiConstants::API_VERSION1);
     }
 };
 
@@ -454,9 +956,26 @@ struct ListOffsetResponse : public Marshallable
 {
     std::vector<TopicOffsets> offsets;
 
+    typedef Schema<KAFKA_FIELD(ListOffsetResponse, offsets)> schema;
+
+    void reset() { offsets.clear(); }
+
     void unmarshal(const Unpack & up)
     {
-        up >> offsets;
+        unmarshal(up, ListOffsetRequest::apiver);
+    }
+    // v0 answers are moved into timestamp/offset so callers see one layout
+    void unmarshal(const Unpack & up, int ver)
+    {
+        schema::decode(up, *this, ver);
+        if(ver >= ApiConstants::API_VERSION1)
+            return;
+        for(auto& topic : offsets) {
+            for(auto& po : topic.parOffsets) {
+                po.timestamp = -1;
+                po.offset = po.offsets.empty() ? -1 : po.offsets[0];
+            }
+        }
     }
 };
 
@@ -0,0 +1,370 @@
+#include "LagMonitor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+using namespace kafkaprotocpp;
+
+typedef std::vector<std::pair<TopicName, int32_t> > PartitionList;
+
+static int64_t steadyMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+LagMonitor::LagMonitor(BrokerPool& pool, const MetadataCache& meta, const Options& opts) :
+    m_pool(pool), m_meta(meta), m_opts(opts), m_now(0), m_outstanding(0), m_lookups(0), m_requests(0)
+{
+}
+
+void LagMonitor::watch(const std::string& groupid, const std::vector<std::string>& topics)
+{
+    Group& g = m_groups[groupid];
+    g.topics.assign(topics.begin(), topics.end());
+}
+
+void LagMonitor::unwatch(const std::string& groupid)
+{
+    m_groups.erase(groupid);
+}
+
+bool LagMonitor::scan(int64_t nowMs)
+{
+    if(m_outstanding > 0)
+        return false;
+    m_now = nowMs;
+    m_lookups = 0;
+    m_requests = 0;
+
+    MetadataCache::Reader snap = m_meta.read();
+    m_pool.setBrokers(*snap);
+
+    m_partitions.clear();
+    for(auto& it : m_groups) {
+        for(auto& topic : it.second.topics) {
+            const TopicRoute* route = snap->topic(topic);
+            m_partitions[topic] = route ? route->partitions.size() : 0;
+        }
+    }
+    for(auto it = m_logEnd.begin(); it != m_logEnd.end(); ) {
+        if(m_partitions.count(it->first))
+            ++it;
+        else
+            it = m_logEnd.erase(it);
+    }
+
+    listOffsets(*snap);
+
+    for(auto& it : m_groups) {
+        Group& g = it.second;
+        g.retries = 0;
+        if(g.coordinator < 0 || nowMs - g.coordinatorAt >= m_opts.coordinatorTtlMs)
+            lookupCoordinator(it.first, g);
+        else
+            fetchOffsets(it.first, g);
+    }
+    return true;
+}
+
+bool LagMonitor::run(int timeoutMs)
+{
+    int64_t start = steadyMs();
+    scan(start);
+    for(;;) {
+        if(!scanning())
+            return true;
+        int64_t left = start + timeoutMs - steadyMs();
+        if(left <= 0)
+            return false;
+        if(m_pool.poll(left) < 0)
+            return false;
+    }
+}
+
+// one request per leader with every watched partition it leads
+void LagMonitor::listOffsets(const MetadataSnapshot& snap)
+{
+    std::map<int32_t, std::pair<ListOffsetRequest, std::shared_ptr<PartitionList> > > byLeader;
+
+    for(auto& it : m_partitions) {
+        const TopicName& topic = it.first;
+        std::vector<LogEnd>& ends = m_logEnd[topic];
+        ends.resize(it.second);
+
+        const TopicRoute* route = snap.topic(topic);
+        for(int32_t parn = 0; parn < it.second; ++parn) {
+            int32_t leader = route->partitions[parn].leader;
+            if(leader < 0) {
+                ends[parn].errcode = ApiConstants::ERRORCODE_LEADER_NOT_AVAILABLE;
+                continue;
+            }
+
+            auto& entry = byLeader[leader];
+            ListOffsetRequest& req = entry.first;
+            if(!entry.second) {
+                req.replicaId = -1;
+                entry.second = std::make_shared<PartitionList>();
+            }
+            if(req.topicReqVec.empty() || req.topicReqVec.back().topic != topic) {
+                req.topicReqVec.emplace_back();
+                req.topicReqVec.back().topic = topic;
+            }
+            ListOffsetReqPartitionUnit pu;
+            pu.parn = parn;
+            pu.time_before = -1;
+            req.topicReqVec.back().parReqVec.push_back(pu);
+            entry.second->push_back(std::make_pair(topic, parn));
+        }
+    }
+
+    for(auto& it : byLeader) {
+        std::shared_ptr<PartitionList> sentList = it.second.second;
+        AsyncConnection* conn = m_pool.get(it.first);
+        int32_t ctxid = -1;
+        if(conn) {
+            sent();
+            ctxid = conn->Send(ListOffsetRequest::apikey, ListOffsetRequest::apiver, it.second.first,
+                    [this, sentList](int err, const Unpack& body) { onListOffsets(*sentList, err, body); });
+            if(ctxid < 0)
+                done();
+        }
+        if(ctxid < 0) {
+            for(auto& tp : *sentList)
+                m_logEnd[tp.first][tp.second].errcode = ApiConstants::ERRORCODE_BROKER_NOT_AVAILABLE;
+        }
+    }
+}
+
+void LagMonitor::onListOffsets(const PartitionList& sentList, int err, const Unpack& body)
+{
+    done();
+
+    ListOffsetResponse res;
+    if(err == 0) {
+        try {
+            res.unmarshal(body);
+        } catch(const PacketError&) {
+            err = -1;
+        }
+    }
+    if(err < 0) {
+        for(auto& tp : sentList) {
+            auto it = m_logEnd.find(tp.first);
+            if(it != m_logEnd.end() && (size_t)tp.second < it->second.size())
+                it->second[tp.second].errcode = ApiConstants::ERRORCODE_UNKNOWN;
+        }
+        return;
+    }
+
+    for(auto& topic : res.offsets) {
+        auto it = m_logEnd.find(topic.topic);
+        if(it == m_logEnd.end())
+            continue;
+        for(auto& po : topic.parOffsets) {
+            if(po.parn < 0 || (size_t)po.parn >= it->second.size())
+                continue;
+            LogEnd& end = it->second[po.parn];
+            end.errcode = po.errcode;
+            if(po.errcode == ApiConstants::ERRORCODE_NO_ERROR)
+                end.offset = po.offset;
+        }
+    }
+}
+
+void LagMonitor::lookupCoordinator(const std::string& groupid, Group& g)
+{
+    g.coordinator = -1;
+    AsyncConnection* conn = m_pool.any();
+    if(!conn) {
+        groupFailed(g, ApiConstants::ERRORCODE_GROUP_COORDINATOR_NOT_AVAIBLE);
+        return;
+    }
+
+    QueryGroupCoordinator req;
+    req.groupid = groupid;
+    sent();
+    ++m_lookups;
+    if(conn->Send(QueryGroupCoordinator::apikey, QueryGroupCoordinator::apiver, req,
+                [this, groupid](int err, const Unpack& body) { onCoordinator(groupid, err, body); }) < 0) {
+        done();
+        groupFailed(g, ApiConstants::ERRORCODE_GROUP_COORDINATOR_NOT_AVAIBLE);
+    }
+}
+
+void LagMonitor::onCoordinator(const std::string& groupid, int err, const Unpack& body)
+{
+    done();
+    auto it = m_groups.find(groupid);
+    if(it == m_groups.end())
+        return;
+    Group& g = it->second;
+
+    QueryGroupCoordinatorRes res;
+    res.errcode = ApiConstants::ERRORCODE_UNKNOWN;
+    if(err == 0) {
+        try {
+            res.unmarshal(body);
+        } catch(const PacketError&) {
+            res.errcode = ApiConstants::ERRORCODE_UNKNOWN;
+        }
+    }
+    if(res.errcode != ApiConstants::ERRORCODE_NO_ERROR) {
+        groupFailed(g, res.errcode);
+        return;
+    }
+
+    m_pool.addBroker(res.coordinatorId, res.coordHost, res.coordPort);
+    g.coordinator = res.coordinatorId;
+    g.coordinatorAt = m_now;
+    fetchOffsets(groupid, g);
+}
+
+void LagMonitor::fetchOffsets(const std::string& groupid, Group& g)
+{
+    FetchGroupOffsetRequest req;
+    req.groupid = groupid;
+    for(auto& topic : g.topics) {
+        int32_t count = m_partitions[topic];
+        g.committed[topic].resize(count);
+        if(count <= 0)
+            continue;
+        req.toppars.emplace_back();
+        TopicPartitionsBlock& block = req.toppars.back();
+        block.topic = topic;
+        block.partitions.resize(count);
+        for(int32_t parn = 0; parn < count; ++parn)
+            block.partitions[parn] = parn;
+    }
+    if(req.toppars.empty())
+        return;
+
+    AsyncConnection* conn = m_pool.get(g.coordinator);
+    if(conn) {
+        sent();
+        if(conn->Send(FetchGroupOffsetRequest::apikey, FetchGroupOffsetRequest::apiver, req,
+                    [this, groupid](int err, const Unpack& body) { onOffsets(groupid, err, body); }) >= 0)
+            return;
+        done();
+    }
+    g.coordinator = -1;
+    groupFailed(g, ApiConstants::ERRORCODE_GROUP_COORDINATOR_NOT_AVAIBLE);
+}
+
+void LagMonitor::onOffsets(const std::string& groupid, int err, const Unpack& body)
+{
+    done();
+    auto git = m_groups.find(groupid);
+    if(git == m_groups.end())
+        return;
+    Group& g = git->second;
+
+    FetchGroupOffsetResponse res;
+    if(err == 0) {
+        try {
+            res.unmarshal(body);
+        } catch(const PacketError&) {
+            err = -1;
+        }
+    }
+    if(err < 0) {
+        g.coordinator = -1; // look it up again next scan
+        groupFailed(g, ApiConstants::ERRORCODE_UNKNOWN);
+        return;
+    }
+
+    bool moved = false;
+    for(auto& topic : res.offsets) {
+        auto it = g.committed.find(TopicName(topic.topic));
+        if(it == g.committed.end())
+            continue;
+        for(auto& po : topic.partitionOffsets) {
+            if(po.parn < 0 || (size_t)po.parn >= it->second.size())
+                continue;
+            Committed& c = it->second[po.parn];
+            c.errcode = po.errcode;
+            if(po.errcode == ApiConstants::ERRORCODE_NO_ERROR)
+                c.offset = po.offset;
+            else if(po.errcode == ApiConstants::ERRORCODE_GROUP_NOT_COORDINATOR
+                    || po.errcode == ApiConstants::ERRORCODE_GROUP_COORDINATOR_NOT_AVAIBLE)
+                moved = true;
+        }
+    }
+
+    if(moved) {
+        g.coordinator = -1;
+        if(g.retries < m_opts.maxRetries) {
+            ++g.retries;
+            lookupCoordinator(groupid, g);
+        }
+    }
+}
+
+void LagMonitor::groupFailed(Group& g, int16_t errcode)
+{
+    for(auto& topic : g.topics) {
+        std::vector<Committed>& committed = g.committed[topic];
+        committed.resize(m_partitions[topic]);
+        for(auto& c : committed)
+            c.errcode = errcode;
+    }
+}
+
+void LagMonitor::table(std::vector<Row>& rows) const
+{
+    static const std::vector<Committed> s_noCommitted;
+    static const std::vector<LogEnd> s_noLogEnd;
+
+    for(auto& it : m_groups) {
+        const Group& g = it.second;
+        for(auto& topic : g.topics) {
+            auto pit = m_partitions.find(topic);
+            int32_t count = pit == m_partitions.end() ? 0 : pit->second;
+            auto cit = g.committed.find(topic);
+            const std::vector<Committed>& committed = cit == g.committed.end() ? s_noCommitted : cit->second;
+            auto eit = m_logEnd.find(topic);
+            const std::vector<LogEnd>& ends = eit == m_logEnd.end() ? s_noLogEnd : eit->second;
+
+            for(int32_t parn = 0; parn < count; ++parn) {
+                Row row;
+                row.groupid = &it.first;
+                row.topic = topic;
+                row.parn = parn;
+                row.committed = (size_t)parn < committed.size() ? committed[parn].offset : -1;
+                row.logEnd = (size_t)parn < ends.size() ? ends[parn].offset : -1;
+                row.lag = -1;
+                if(row.committed >= 0 && row.logEnd >= 0)
+                    row.lag = row.logEnd > row.committed ? row.logEnd - row.committed : 0;
+                row.errcode = (size_t)parn < committed.size() ? committed[parn].errcode : 0;
+                if(row.errcode == 0 && (size_t)parn < ends.size())
+                    row.errcode = ends[parn].errcode;
+                rows.push_back(row);
+            }
+        }
+    }
+}
+
+int64_t LagMonitor::groupLag(const std::string& groupid) const
+{
+    auto git = m_groups.find(groupid);
+    if(git == m_groups.end())
+        return -1;
+    const Group& g = git->second;
+
+    int64_t total = 0;
+    for(auto& topic : g.topics) {
+        auto cit = g.committed.find(topic);
+        auto eit = m_logEnd.find(topic);
+        if(cit == g.committed.end() || eit == m_logEnd.end())
+            continue;
+        size_t n = std::min(cit->second.size(), eit->second.size());
+        for(size_t parn = 0; parn < n; ++parn) {
+            int64_t committed = cit->second[parn].offset;
+            int64_t end = eit->second[parn].offset;
+            if(committed >= 0 && end > committed)
+                total += end - committed;
+        }
+    }
+    return total;
+}
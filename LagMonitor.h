@@ -0,0 +1,131 @@
+#pragma once
+
+#include "BrokerPool.h"
+#include "KafkaConsumerMessage.h"
+
+#include <map>
+#include <unordered_map>
+
+namespace kafkaprotocpp {
+
+// Consumer lag for many groups at once.
+//
+// A scan asks every watched group's coordinator for its committed offsets
+// (one FetchGroupOffsetRequest per group, pipelined per coordinator) and every
+// partition leader for its log-end offsets (one ListOffsetRequest per broker
+// covering all watched partitions it leads, shared by all groups). All of it
+// goes out at once over the BrokerPool and completes concurrently.
+// Coordinators are cached between scans, so a steady state scan only looks up
+// groups that are new, expired or were told NOT_COORDINATOR.
+//
+// The table is updated in place as responses arrive: a partition whose
+// request failed keeps its last values with its errcode set, so one slow or
+// failed broker does not blank the rest of the table.
+//
+//     LagMonitor mon(pool, cache);
+//     mon.watch("group", {"topic1", "topic2"});
+//     mon.run(1000);                 // or scan(now) + pool.poll() in your loop
+//     mon.table(rows);
+class LagMonitor
+{
+public:
+    struct Options
+    {
+        int64_t coordinatorTtlMs; // look coordinators up again after this long
+        int maxRetries;           // coordinator lookups per group and scan
+
+        Options() : coordinatorTtlMs(10 * 60 * 1000), maxRetries(2) {}
+    };
+
+    struct Row
+    {
+        const std::string* groupid;
+        TopicName topic;
+        int32_t parn;
+        int64_t committed; // -1 if the group has no offset
+        int64_t logEnd;    // -1 if unknown
+        int64_t lag;       // -1 if either is unknown
+        int16_t errcode;   // last error for this partition, 0 if none
+    };
+
+    LagMonitor(BrokerPool& pool, const MetadataCache& meta, const Options& opts = Options());
+
+    // partitions come from the metadata at each scan
+    void watch(const std::string& groupid, const std::vector<std::string>& topics);
+    void unwatch(const std::string& groupid);
+
+    // send every request of a new scan, false if one is still running
+    bool scan(int64_t nowMs);
+    bool scanning() const { return m_outstanding > 0; }
+    // scan and poll the pool until it finished or timeoutMs passed
+    bool run(int timeoutMs);
+
+    // every watched partition, by group then topic then partition
+    void table(std::vector<Row>& rows) const;
+    // sum of known lags, -1 if the group isn't watched
+    int64_t groupLag(const std::string& groupid) const;
+
+    // of the last scan
+    size_t coordinatorLookups() const { return m_lookups; }
+    size_t requests() const { return m_requests; }
+
+private:
+    LagMonitor(const LagMonitor&);
+    LagMonitor& operator = (const LagMonitor&);
+
+    struct Committed
+    {
+        int64_t offset;
+        int16_t errcode;
+
+        Committed() : offset(-1), errcode(0) {}
+    };
+
+    struct LogEnd
+    {
+        int64_t offset;
+        int16_t errcode;
+
+        LogEnd() : offset(-1), errcode(0) {}
+    };
+
+    struct Group
+    {
+        std::vector<TopicName> topics;
+        std::unordered_map<TopicName, std::vector<Committed> > committed;
+        int32_t coordinator;      // -1 if unknown
+        int64_t coordinatorAt;    // when it was looked up
+        int retries;
+
+        Group() : coordinator(-1), coordinatorAt(0), retries(0) {}
+    };
+
+    void lookupCoordinator(const std::string& groupid, Group& g);
+    void fetchOffsets(const std::string& groupid, Group& g);
+    void listOffsets(const MetadataSnapshot& snap);
+
+    void onCoordinator(const std::string& groupid, int err, const Unpack& body);
+    void onOffsets(const std::string& groupid, int err, const Unpack& body);
+    void onListOffsets(const std::vector<std::pair<TopicName, int32_t> >& sent, int err, const Unpack& body);
+
+    // marks the partitions of a request that got no answer
+    void groupFailed(Group& g, int16_t errcode);
+
+    void sent() { ++m_outstanding; ++m_requests; }
+    void done() { --m_outstanding; }
+
+    BrokerPool& m_pool;
+    const MetadataCache& m_meta;
+    Options m_opts;
+
+    std::map<std::string, Group> m_groups;
+    std::unordered_map<TopicName, std::vector<LogEnd> > m_logEnd;
+    std::unordered_map<TopicName, int32_t> m_partitions; // partition counts as of this scan
+
+    int64_t m_now;
+    size_t m_outstanding;
+    size_t m_lookups;
+    size_t m_requests;
+};
+
+}
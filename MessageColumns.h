@@ -0,0 +1,142 @@
+#pragma once
+
+#include "MessageView.h"
+
+namespace kafkaprotocpp {
+
+// Columnar (structure-of-arrays) decode target for a message set.
+//
+// Every message becomes one row across contiguous columns, with key and value
+// kept as offset/length into the message-set bytes, which are not copied:
+// like LazyMessageSet, the columns point into the response buffer, which must
+// outlive them. Scans over offsets or timestamps and key filters touch only
+// the columns they need and vectorize.
+//
+// Decoding again into the same object keeps the columns' capacity. Inside a
+// FetchResponseT decoded over (not a fresh one per response) that holds for
+// every partition that keeps its place; partitions dropped from the end take
+// their columns with them.
+//
+// Like MessageSet, compressed wrapper messages are not expanded: their value
+// column holds the compressed inner set.
+struct MessageColumns : public Marshallable
+{
+    int32_t size; // bytes of the set on the wire, filled in by the enclosing unit
+
+    const char* data; // the set in the buffer decoded from
+    std::vector<int64_t> offsets;
+    std::vector<int64_t> timestamps; // -1 for magic 0 messages
+    std::vector<int8_t> attrs;
+    std::vector<int8_t> magics;
+    std::vector<int32_t> keyOffs;
+    std::vector<int32_t> keyLens; // -1 for a null key
+    std::vector<int32_t> valueOffs;
+    std::vector<int32_t> valueLens; // -1 for a null value
+
+    MessageColumns() : size(0), data(NULL) {}
+
+    size_t count() const { return offsets.size(); }
+
+    const char* key(size_t i) const { return data + keyOffs[i]; }
+    const char* value(size_t i) const { return data + valueOffs[i]; }
+
+    void clear()
+    {
+        data = NULL;
+        offsets.clear();
+        timestamps.clear();
+        attrs.clear();
+        magics.clear();
+        keyOffs.clear();
+        keyLens.clear();
+        valueOffs.clear();
+        valueLens.clear();
+    }
+
+    virtual void unmarshal(const Unpack &up)
+    {
+        clear();
+        data = up.pop_fetch_ptr(size);
+
+        const char* p = data;
+        const char* end = data + size;
+        MessageView m;
+        while(m.decode(p, end)) {
+            offsets.push_back(m.offset);
+            timestamps.push_back(m.timestamp);
+            attrs.push_back(m.attr);
+            magics.push_back(m.magicByte);
+            keyOffs.push_back(m.key - data);
+            keyLens.push_back(m.keyLen);
+            valueOffs.push_back(m.value - data);
+            valueLens.push_back(m.valueLen);
+        }
+    }
+
+    // batch operations over the columns
+
+    int64_t maxTimestamp() const
+    {
+        int64_t m = -1;
+        const int64_t* ts = timestamps.data();
+        for(size_t i = 0, n = timestamps.size(); i < n; ++i)
+            m = ts[i] > m ? ts[i] : m;
+        return m;
+    }
+
+    int64_t valueBytes() const
+    {
+        int64_t total = 0;
+        const int32_t* len = valueLens.data();
+        for(size_t i = 0, n = valueLens.size(); i < n; ++i)
+            total += len[i] > 0 ? len[i] : 0;
+        return total;
+    }
+
+    // rows with from <= timestamp < to, written to sel; returns how many
+    size_t selectTimestamp(int64_t from, int64_t to, std::vector<uint32_t>& sel) const
+    {
+        size_t n = timestamps.size();
+        sel.resize(n);
+        const int64_t* ts = timestamps.data();
+        uint32_t* out = sel.data();
+        size_t k = 0;
+        for(size_t i = 0; i < n; ++i) {
+            out[k] = i;
+            k += (ts[i] >= from) & (ts[i] < to);
+        }
+        sel.resize(k);
+        return k;
+    }
+
+    // rows whose key equals key[0..len), written to sel; returns how many
+    size_t selectKey(const char* k, int32_t len, std::vector<uint32_t>& sel) const
+    {
+        size_t n = keyLens.size();
+        sel.resize(n);
+        const int32_t* lens = keyLens.data();
+        uint32_t* out = sel.data();
+        size_t m = 0;
+        // the length column rejects most rows before any byte is compared
+        for(size_t i = 0; i < n; ++i) {
+            out[m] = i;
+            m += lens[i] == len;
+        }
+        size_t hit = 0;
+        for(size_t j = 0; j < m; ++j) {
+            uint32_t i = out[j];
+            if(len <= 0 || ::memcmp(key(i), k, len) == 0)
+                out[hit++] = i;
+        }
+        sel.resize(hit);
+        return hit;
+    }
+};
+
+typedef FetchPartitionResponseUnitT<MessageColumns> FetchPartitionColumnsUnit;
+typedef FetchTopicResponseUnitT<MessageColumns> FetchTopicColumnsUnit;
+typedef FetchResponseV0T<MessageColumns> FetchColumnsResponseV0;
+typedef FetchResponseV1T<MessageColumns> FetchColumnsResponseV1;
+typedef FetchResponseV2T<MessageColumns> FetchColumnsResponseV2;
+
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include "KafkaMessage.h"
+
+namespace kafkaprotocpp {
+
+// A message decoded in place: key and value point into the buffer it was
+// decoded from, nothing is copied.
+struct MessageView
+{
+    int64_t offset;
+    int32_t size; // do NOT contain size of 'offset' and 'size' field
+    int32_t crc;
+    int8_t magicByte;
+    int8_t attr;
+    int64_t timestamp; // -1 for magic 0
+    const char* key;
+    int32_t keyLen; // -1 for a null key
+    const char* value;
+    int32_t valueLen; // -1 for a null value
+
+    int version() const { return magicByte; }
+    int comptype() const { return attr & 0x07; }
+
+    std::string keyString() const { return keyLen > 0 ? std::string(key, keyLen) : std::string(); }
+    std::string valueString() const { return valueLen > 0 ? std::string(value, valueLen) : std::string(); }
+
+    // Decode the message at p, without reading past end. On success p moves to
+    // the next message. Returns false, leaving p alone, if the message is
+    // truncated or malformed.
+    bool decode(const char*& p, const char* end)
+    {
+        return tryDecode(p, end) == DECODE_OK;
+    }
+
+    // Like decode(), telling why it failed: DECODE_TRUNCATED if the bytes end
+    // inside the message (a fetch response's partial tail), DECODE_MALFORMED
+    // if its size, magic or key/value lengths can't be right.
+    DecodeStatus tryDecode(const char*& p, const char* end)
+    {
+        if(end - p < 8 + 4)
+            return DECODE_TRUNCATED;
+        int64_t off = load_be64(p);
+        int32_t sz = load_be32(p + 8);
+        const char* q = p + 12;
+        if(sz < 4 + 1 + 1)
+            return DECODE_MALFORMED;
+        if(end - q < sz)
+            return DECODE_TRUNCATED;
+
+        // the message is all there from here, anything missing is corruption
+        const char* msgEnd = q + sz;
+        crc = load_be32(q);
+        magicByte = q[4];
+        attr = q[5];
+        q += 6;
+        if(magicByte != 0 && magicByte != 1)
+            return DECODE_MALFORMED;
+        timestamp = -1;
+        if(magicByte == 1) {
+            if(msgEnd - q < 8)
+                return DECODE_MALFORMED;
+            timestamp = load_be64(q);
+            q += 8;
+        }
+        if(!bytes(q, msgEnd, key, keyLen) || !bytes(q, msgEnd, value, valueLen))
+            return DECODE_MALFORMED;
+
+        offset = off;
+        size = sz;
+        p = msgEnd;
+        return DECODE_OK;
+    }
+
+private:
+    static bool bytes(const char*& p, const char* end, const char*& data, int32_t& len)
+    {
+        if(end - p < 4)
+            return false;
+        len = load_be32(p);
+        p += 4;
+        data = p;
+        if(len <= 0)
+            return true;
+        if(end - p < len)
+            return false;
+        p += len;
+        return true;
+    }
+};
+
+// Forward-only view over the raw bytes of a message set:
+//
+//     for(const MessageView& m : LazyMessageSet(buf, size)) ...
+//
+// Each message header is decoded when the iterator reaches it and iteration
+// stops cleanly at a truncated trailing message. A malformed message ends it
+// as well; iterator::status() tells the two apart once it is at the end:
+//
+//     LazyMessageSet::iterator it = set.begin();
+//     for(; it != set.end(); ++it) ...
+//     if(it.status() == DECODE_MALFORMED) ...
+//
+// The bytes must outlive the set and its iterators. As a fetch response
+// decode target it only records where the set lies in the response buffer,
+// see FetchLazyResponseV*.
+class LazyMessageSet : public Marshallable
+{
+public:
+    class iterator
+    {
+    public:
+        iterator() : m_pos(NULL), m_end(NULL), m_status(DECODE_OK) {}
+        iterator(const char* pos, const char* end) : m_pos(pos), m_end(end), m_status(DECODE_OK) { next(); }
+
+        // at the end: DECODE_OK if the set ended on a message boundary,
+        // DECODE_TRUNCATED if in a partial message, DECODE_MALFORMED if it
+        // stopped at a corrupt one
+        DecodeStatus status() const { return m_status; }
+
+        const MessageView& operator*() const { return m_view; }
+        const MessageView* operator->() const { return &m_view; }
+
+        iterator& operator++()
+        {
+            next();
+            return *this;
+        }
+
+        bool operator == (const iterator& o) const { return m_pos == o.m_pos; }
+        bool operator != (const iterator& o) const { return m_pos != o.m_pos; }
+
+    private:
+        void next()
+        {
+            if(m_pos == NULL)
+                return;
+            if(m_pos == m_end) {
+                m_pos = NULL;
+                return;
+            }
+            m_status = m_view.tryDecode(m_pos, m_end);
+            if(m_status != DECODE_OK)
+                m_pos = NULL; // a truncated tail or a corrupt message
+        }
+
+        const char* m_pos; // start of the message after m_view, NULL at end
+        const char* m_end;
+        DecodeStatus m_status;
+        MessageView m_view;
+    };
+
+    int32_t size; // filled in by the enclosing unit, like MessageSet::size
+
+    LazyMessageSet() : size(0), m_data(NULL) {}
+    LazyMessageSet(const char* data, size_t len) : size(len), m_data(data) {}
+
+    iterator begin() const { return iterator(m_data, m_data + size); }
+    iterator end() const { return iterator(); }
+
+    const char* data() const { return m_data; }
+
+    virtual void unmarshal(const Unpack &up)
+    {
+        m_data = up.pop_fetch_ptr(size);
+    }
+
+    // messages are only looked at while iterating, so never DECODE_TRUNCATED
+    DecodeStatus decode(const Unpack &up)
+    {
+        if(size < 0)
+            return DECODE_MALFORMED;
+        if(!up.has(size))
+            return DECODE_INCOMPLETE;
+        m_data = up.take_ptr(size);
+        return DECODE_OK;
+    }
+
+private:
+    const char* m_data;
+};
+
+typedef FetchPartitionResponseUnitT<LazyMessageSet> FetchPartitionLazyUnit;
+typedef FetchTopicResponseUnitT<LazyMessageSet> FetchTopicLazyUnit;
+typedef FetchResponseT<LazyMessageSet, 0> FetchLazyResponseV0;
+typedef FetchResponseT<LazyMessageSet, 1> FetchLazyResponseV1;
+typedef FetchResponseT<LazyMessageSet, 2> FetchLazyResponseV2;
+
+}
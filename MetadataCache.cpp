@@ -0,0 +1,213 @@
+#include "MetadataCache.h"
+
+#include <sched.h>
+#include <algorithm>
+#include <climits>
+
+using namespace kafkaprotocpp;
+
+static unsigned threadStripe(unsigned stripes)
+{
+    static std::atomic<unsigned> s_next(0);
+    thread_local unsigned t_stripe = s_next.fetch_add(1, std::memory_order_relaxed);
+    return t_stripe % stripes;
+}
+
+static void fillRoute(TopicRoute& route, const TopicMetadata& tmeta)
+{
+    route.topic = tmeta.strTopic;
+    route.errcode = tmeta.errcode;
+
+    // A topic's partitions are numbered from 0, so the ids in a sane
+    // response are below the number listed. A corrupt one gets no slot
+    // rather than the array sized by whatever id came off the wire.
+    int32_t count = (int32_t)std::min<size_t>(tmeta.vecParMeta.size(), INT32_MAX);
+    int32_t maxPar = -1;
+    for(auto& pmeta : tmeta.vecParMeta) {
+        if(pmeta.parid < count)
+            maxPar = std::max(maxPar, pmeta.parid);
+    }
+    route.partitions.resize(maxPar + 1);
+
+    for(auto& pmeta : tmeta.vecParMeta) {
+        if(pmeta.parid < 0 || pmeta.parid > maxPar)
+            continue;
+        PartitionRoute& par = route.partitions[pmeta.parid];
+        par.errcode = pmeta.errcode;
+        par.leader = pmeta.leader;
+        par.replicas = pmeta.replicas;
+        par.isr = pmeta.isr;
+    }
+}
+
+// partition slots the response didn't fill keep the default UNKNOWN_TOPIC_OR_PARTITION
+static bool exists(const TopicRoute* route, size_t parn)
+{
+    return route && parn < route->partitions.size()
+        && route->partitions[parn].errcode != ApiConstants::ERRORCODE_UNKNOWN_TOPIC_OR_PARTITION;
+}
+
+static bool sameIsr(std::vector<int32_t> a, std::vector<int32_t> b)
+{
+    if(a.size() != b.size())
+        return false;
+    // brokers don't keep the ISR in any particular order
+    std::sort(a.begin(), a.end());
+    std::sort(b.begin(), b.end());
+    return a == b;
+}
+
+static void diffRoutes(const TopicName& topic, const TopicRoute* before, const TopicRoute* after,
+        std::vector<PartitionChange>& changes)
+{
+    size_t n = std::max(before ? before->partitions.size() : 0, after ? after->partitions.size() : 0);
+    for(size_t parn = 0; parn < n; ++parn) {
+        bool was = exists(before, parn);
+        bool is = exists(after, parn);
+        if(!was && !is)
+            continue;
+
+        PartitionChange c;
+        c.topic = topic;
+        c.parn = parn;
+        c.what = 0;
+        c.oldLeader = was ? before->partitions[parn].leader : -1;
+        c.newLeader = is ? after->partitions[parn].leader : -1;
+        if(!was)
+            c.what = PartitionChange::ADDED;
+        else if(!is)
+            c.what = PartitionChange::REMOVED;
+        else {
+            if(c.oldLeader != c.newLeader)
+                c.what |= PartitionChange::LEADER;
+            if(!sameIsr(before->partitions[parn].isr, after->partitions[parn].isr))
+                c.what |= PartitionChange::ISR;
+        }
+        if(c.what)
+            changes.push_back(c);
+    }
+}
+
+MetadataSnapshot::MetadataSnapshot(const MetadataResponse& meta, uint64_t ver) : version(ver)
+{
+    brokers.reserve(meta.vecBroker.size());
+    for(auto& broker : meta.vecBroker)
+        brokers[broker.nodeid] = broker;
+
+    topics.reserve(meta.vecTopicMeta.size());
+    for(auto& tmeta : meta.vecTopicMeta)
+        fillRoute(topics[tmeta.strTopic], tmeta);
+}
+
+MetadataCache::Reader::Reader(const MetadataCache* cache) : m_cache(cache)
+{
+    m_stripe = threadStripe(READER_STRIPES);
+    for(;;) {
+        unsigned phase = cache->m_phase.load();
+        cache->m_stripes[m_stripe].count[phase & 1].fetch_add(1);
+        if(cache->m_phase.load() == phase) {
+            m_parity = phase & 1;
+            break;
+        }
+        // a refresh flipped the phase under us, pin the new one
+        cache->m_stripes[m_stripe].count[phase & 1].fetch_sub(1);
+    }
+    m_snap = cache->m_current.load();
+}
+
+MetadataCache::Reader::~Reader()
+{
+    if(m_cache)
+        m_cache->m_stripes[m_stripe].count[m_parity].fetch_sub(1, std::memory_order_release);
+}
+
+MetadataCache::MetadataCache() : m_phase(0), m_current(new MetadataSnapshot)
+{
+    for(int i = 0; i < READER_STRIPES; ++i) {
+        m_stripes[i].count[0].store(0, std::memory_order_relaxed);
+        m_stripes[i].count[1].store(0, std::memory_order_relaxed);
+    }
+}
+
+MetadataCache::~MetadataCache()
+{
+    delete m_current.load();
+}
+
+void MetadataCache::update(const MetadataResponse& meta)
+{
+    publish(new MetadataSnapshot(meta));
+}
+
+// Copies the current snapshot and replaces the topics of meta in the copy;
+// readers go on with the old one until the copy is swapped in.
+void MetadataCache::merge(const MetadataResponse& meta, std::vector<PartitionChange>* changes)
+{
+    std::lock_guard<std::mutex> guard(m_writeLock);
+
+    const MetadataSnapshot* cur = m_current.load();
+    MetadataSnapshot* snap = new MetadataSnapshot(*cur);
+    if(!meta.vecBroker.empty()) {
+        snap->brokers.clear();
+        for(auto& broker : meta.vecBroker)
+            snap->brokers[broker.nodeid] = broker;
+    }
+
+    for(auto& tmeta : meta.vecTopicMeta) {
+        auto it = snap->topics.find(tmeta.strTopic);
+        const TopicRoute* before = it == snap->topics.end() ? NULL : &it->second;
+
+        if(tmeta.errcode == ApiConstants::ERRORCODE_UNKNOWN_TOPIC_OR_PARTITION) {
+            if(before) {
+                if(changes)
+                    diffRoutes(tmeta.strTopic, before, NULL, *changes);
+                snap->topics.erase(it);
+            }
+            continue;
+        }
+        // e.g. LEADER_NOT_AVAILABLE while it is created, nothing to go by
+        if(tmeta.errcode != ApiConstants::ERRORCODE_NO_ERROR && before)
+            continue;
+
+        TopicRoute after;
+        fillRoute(after, tmeta);
+        if(changes)
+            diffRoutes(tmeta.strTopic, before, &after, *changes);
+        snap->topics[tmeta.strTopic] = std::move(after);
+    }
+    install(snap);
+}
+
+void MetadataCache::publish(MetadataSnapshot* snap)
+{
+    std::lock_guard<std::mutex> guard(m_writeLock);
+    install(snap);
+}
+
+// with m_writeLock held
+void MetadataCache::install(MetadataSnapshot* snap)
+{
+    snap->version = m_current.load()->version + 1;
+    const MetadataSnapshot* old = m_current.exchange(snap);
+    synchronize();
+    delete old;
+}
+
+uint64_t MetadataCache::version() const
+{
+    return read()->version;
+}
+
+// Wait until no reader can still hold a snapshot that was current before the
+// call. A reader may pin under the old phase yet load the new pointer, so one
+// flip is not enough: after the second flip both parities have drained once.
+void MetadataCache::synchronize()
+{
+    for(int flip = 0; flip < 2; ++flip) {
+        unsigned parity = m_phase.fetch_add(1) & 1;
+        for(int i = 0; i < READER_STRIPES; ++i) {
+            while(m_stripes[i].count[parity].load(std::memory_order_acquire) != 0)
+                sched_yield();
+        }
+    }
+}
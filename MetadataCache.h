@@ -0,0 +1,180 @@
+#pragma once
+
+#include "KafkaMessage.h"
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+namespace kafkaprotocpp {
+
+struct PartitionRoute
+{
+    int16_t errcode;
+    int32_t leader; // -1 if there is no leader
+    std::vector<int32_t> replicas;
+    std::vector<int32_t> isr;
+
+    PartitionRoute() : errcode(ApiConstants::ERRORCODE_UNKNOWN_TOPIC_OR_PARTITION), leader(-1) {}
+};
+
+struct TopicRoute
+{
+    TopicName topic;
+    int16_t errcode;
+    // indexed by partition id; ids not below the number of partitions listed
+    // are dropped as corrupt
+    std::vector<PartitionRoute> partitions;
+
+    const PartitionRoute* partition(int32_t parn) const
+    {
+        if(parn < 0 || (size_t)parn >= partitions.size())
+            return NULL;
+        return &partitions[parn];
+    }
+};
+
+// One partition that differs between two snapshots, see MetadataCache::merge().
+struct PartitionChange
+{
+    enum
+    {
+        ADDED = 0x01,   // new topic or partition
+        REMOVED = 0x02, // the topic is gone
+        LEADER = 0x04,
+        ISR = 0x08,
+    };
+
+    TopicName topic;
+    int32_t parn;
+    int what;          // ORed flags
+    int32_t oldLeader; // -1 if added
+    int32_t newLeader; // -1 if removed
+};
+
+// Immutable view of the cluster built from one MetadataResponse.
+struct MetadataSnapshot
+{
+    uint64_t version;
+    std::unordered_map<TopicName, TopicRoute> topics; // keyed by interned name
+    std::unordered_map<int32_t, Broker> brokers;
+
+    MetadataSnapshot() : version(0) {}
+    explicit MetadataSnapshot(const MetadataResponse& meta, uint64_t ver = 0);
+
+    const TopicRoute* topic(const TopicName& name) const
+    {
+        auto it = topics.find(name);
+        return it == topics.end() ? NULL : &it->second;
+    }
+    // plain names are looked up without interning unknown topics
+    const TopicRoute* topic(const char* data, size_t len) const
+    {
+        const InternedTopic* entry = TopicTable::global().find(data, len);
+        if(entry)
+            return topic(TopicName(entry));
+        // past the table's limit the snapshot may hold it uninterned
+        return TopicTable::global().full() ? topic(TopicName(data, len)) : NULL;
+    }
+    const TopicRoute* topic(const std::string& name) const
+    {
+        return topic(name.data(), name.size());
+    }
+    const TopicRoute* topic(const char* name) const
+    {
+        return topic(name, ::strlen(name));
+    }
+
+    const Broker* broker(int32_t nodeid) const
+    {
+        auto it = brokers.find(nodeid);
+        return it == brokers.end() ? NULL : &it->second;
+    }
+
+    // -1 if the topic/partition is unknown or has no leader
+    template <class Name>
+    int32_t leader(const Name& name, int32_t parn) const
+    {
+        const TopicRoute* t = topic(name);
+        const PartitionRoute* p = t ? t->partition(parn) : NULL;
+        return p ? p->leader : -1;
+    }
+};
+
+// Routing cache with lock-free readers.
+//
+// Readers pin the current snapshot through read(); pinning is two atomic
+// increments on a per-thread stripe, no lock and no shared cache line. A
+// refresh builds the new snapshot off to the side, swaps it in with one
+// atomic exchange and frees the old one after a grace period in which every
+// reader that could still see it has unpinned (two-phase RCU). Refreshes are
+// serialized among themselves and may block for the grace period, so run them
+// off the data path and keep Reader objects short-lived.
+class MetadataCache
+{
+public:
+    class Reader
+    {
+    public:
+        Reader(Reader&& o) : m_cache(o.m_cache), m_stripe(o.m_stripe), m_parity(o.m_parity), m_snap(o.m_snap)
+        {
+            o.m_cache = NULL;
+        }
+        ~Reader();
+
+        const MetadataSnapshot* get() const { return m_snap; }
+        const MetadataSnapshot* operator->() const { return m_snap; }
+        const MetadataSnapshot& operator*() const { return *m_snap; }
+
+    private:
+        friend class MetadataCache;
+        Reader(const MetadataCache* cache);
+        Reader(const Reader&);
+        Reader& operator = (const Reader&);
+
+        const MetadataCache* m_cache;
+        unsigned m_stripe;
+        unsigned m_parity;
+        const MetadataSnapshot* m_snap;
+    };
+
+    MetadataCache();
+    ~MetadataCache();
+
+    Reader read() const { return Reader(this); }
+
+    // replace the whole view with the content of meta
+    void update(const MetadataResponse& meta);
+    // Replace only the topics meta has (the answer to a MetadataRequest for
+    // some topics) and the broker list, other topics stay. A topic answered
+    // UNKNOWN_TOPIC_OR_PARTITION is dropped, one with another error keeps its
+    // routes. Partitions added, removed or with a new leader or ISR are
+    // appended to changes if given.
+    void merge(const MetadataResponse& meta, std::vector<PartitionChange>* changes = NULL);
+    // publish a snapshot built by the caller, the cache takes ownership
+    void publish(MetadataSnapshot* snap);
+
+    uint64_t version() const;
+
+private:
+    MetadataCache(const MetadataCache&);
+    MetadataCache& operator = (const MetadataCache&);
+
+    void install(MetadataSnapshot* snap);
+    void synchronize();
+
+    enum { READER_STRIPES = 64 };
+
+    struct ReaderStripe
+    {
+        std::atomic<long> count[2];
+        char pad[64 - 2 * sizeof(std::atomic<long>)];
+    };
+
+    mutable ReaderStripe m_stripes[READER_STRIPES];
+    std::atomic<unsigned> m_phase;
+    std::atomic<const MetadataSnapshot*> m_current;
+    std::mutex m_writeLock;
+};
+
+}
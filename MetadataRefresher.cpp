@@ -0,0 +1,119 @@
+#include "MetadataRefresher.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+using namespace kafkaprotocpp;
+
+static int64_t steadyMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+MetadataRefresher::MetadataRefresher(BrokerPool& pool, MetadataCache& meta, const Options& opts) :
+    m_pool(pool), m_meta(meta), m_opts(opts), m_nextAll(0), m_retryAt(0), m_now(0), m_inFlight(false),
+    m_requests(0), m_failures(0)
+{
+}
+
+void MetadataRefresher::use(const TopicName& topic)
+{
+    if(m_used.insert(topic).second)
+        m_due.insert(topic);
+}
+
+void MetadataRefresher::unuse(const TopicName& topic)
+{
+    m_used.erase(topic);
+    m_due.erase(topic);
+}
+
+void MetadataRefresher::refresh(const TopicName& topic)
+{
+    m_due.insert(topic);
+}
+
+void MetadataRefresher::refreshAll()
+{
+    m_due.insert(m_used.begin(), m_used.end());
+}
+
+void MetadataRefresher::poll(int64_t nowMs)
+{
+    m_now = nowMs;
+    if(nowMs >= m_nextAll) {
+        refreshAll();
+        m_nextAll = nowMs + m_opts.intervalMs;
+    }
+    if(m_inFlight || m_due.empty() || nowMs < m_retryAt)
+        return;
+
+    MetadataCache::Reader snap = m_meta.read();
+    m_pool.setBrokers(*snap);
+    AsyncConnection* conn = m_pool.any();
+    if(!conn) {
+        m_retryAt = nowMs + m_opts.retryBackoffMs;
+        return;
+    }
+
+    // never an empty list, that would be every topic
+    MetadataRequest req;
+    std::shared_ptr<std::vector<TopicName> > sent = std::make_shared<std::vector<TopicName> >(m_due.begin(), m_due.end());
+    req.vecTopic.reserve(sent->size());
+    for(auto& topic : *sent)
+        req.vecTopic.push_back(topic.str());
+    m_due.clear();
+
+    int16_t ver = conn->Versions().pick<MetadataRequest>();
+    if(ver < 0)
+        ver = MetadataRequest::apiver;
+    m_inFlight = true;
+    ++m_requests;
+    if(conn->Send(MetadataRequest::apikey, ver, req,
+                [this, sent, ver](int err, const Unpack& body) { onMetadata(*sent, ver, err, body); }) < 0)
+        onMetadata(*sent, ver, -1, Unpack(NULL, 0));
+}
+
+bool MetadataRefresher::run(int timeoutMs)
+{
+    int64_t start = steadyMs();
+    refreshAll();
+    for(;;) {
+        int64_t now = steadyMs();
+        poll(now);
+        if(!m_inFlight && m_due.empty())
+            return true;
+        int64_t left = start + timeoutMs - now;
+        if(left <= 0)
+            return false;
+        m_pool.poll(std::min<int64_t>(left, m_opts.retryBackoffMs));
+    }
+}
+
+void MetadataRefresher::onMetadata(const std::vector<TopicName>& sent, int ver, int err, const Unpack& body)
+{
+    m_inFlight = false;
+
+    MetadataResponse res;
+    if(err == 0) {
+        try {
+            res.unmarshal(body, ver);
+        } catch(const PacketError&) {
+            err = -1;
+        }
+    }
+    if(err < 0) {
+        // try again with whatever else became due meanwhile
+        ++m_failures;
+        m_due.insert(sent.begin(), sent.end());
+        m_retryAt = m_now + m_opts.retryBackoffMs;
+        return;
+    }
+
+    m_changes.clear();
+    m_meta.merge(res, &m_changes);
+    if(!m_changes.empty() && m_listener)
+        m_listener(m_changes);
+}
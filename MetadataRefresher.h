@@ -0,0 +1,96 @@
+#pragma once
+
+#include "BrokerPool.h"
+
+#include <set>
+
+namespace kafkaprotocpp {
+
+// Keeps the MetadataCache current for the topics in use only.
+//
+// Instead of fetching the whole cluster, each MetadataRequest lists just the
+// topics registered with use() (every Options::intervalMs) or asked for with
+// refresh(), e.g. after NOT_LEADER_FOR_PARTITION; the answer is merged into
+// the cache with MetadataCache::merge(), so other topics stay as they are.
+// The partitions whose leader or ISR changed, or that appeared or went away,
+// are handed to the listener, which is how a consumer or producer learns
+// where to move. Brokers come from the cache, so it must know at least one
+// (a first update() from a bootstrap MetadataRequest).
+//
+//     MetadataRefresher refresher(pool, cache);
+//     refresher.use("topic");
+//     refresher.setListener([](const std::vector<PartitionChange>& changes) { ... });
+//     refresher.poll(now);           // from the loop that polls the pool
+//     refresher.refresh(seeker.staleTopics());
+//
+// Metadata v0 and v1 create unknown topics on brokers with
+// auto.create.topics.enable.
+class MetadataRefresher
+{
+public:
+    struct Options
+    {
+        int64_t intervalMs;  // refresh every topic in use this often
+        int retryBackoffMs;
+
+        Options() : intervalMs(5 * 60 * 1000), retryBackoffMs(100) {}
+    };
+
+    typedef std::function<void(const std::vector<PartitionChange>& changes)> Listener;
+
+    MetadataRefresher(BrokerPool& pool, MetadataCache& meta, const Options& opts = Options());
+
+    // refreshed with the next poll and every intervalMs after
+    void use(const TopicName& topic);
+    // no longer refreshed, its routes stay in the cache
+    void unuse(const TopicName& topic);
+
+    // refresh these with the next poll, whether in use or not
+    void refresh(const TopicName& topic);
+    template <class Topics>
+    void refresh(const Topics& topics)
+    {
+        for(auto& topic : topics)
+            refresh(topic);
+    }
+    // every topic in use
+    void refreshAll();
+
+    void setListener(Listener listener) { m_listener = std::move(listener); }
+
+    // send a request for the topics due, one at a time
+    void poll(int64_t nowMs);
+    bool refreshing() const { return m_inFlight; }
+    // refresh every topic in use and wait for it (failed requests are
+    // retried), false on timeout
+    bool run(int timeoutMs);
+
+    // of the last refresh
+    const std::vector<PartitionChange>& lastChanges() const { return m_changes; }
+    size_t requests() const { return m_requests; }
+    size_t failures() const { return m_failures; }
+
+private:
+    MetadataRefresher(const MetadataRefresher&);
+    MetadataRefresher& operator = (const MetadataRefresher&);
+
+    void onMetadata(const std::vector<TopicName>& sent, int ver, int err, const Unpack& body);
+
+    BrokerPool& m_pool;
+    MetadataCache& m_meta;
+    Options m_opts;
+    Listener m_listener;
+
+    std::set<TopicName> m_used;
+    std::set<TopicName> m_due;    // for the next request
+    int64_t m_nextAll;            // when every topic in use is due again
+    int64_t m_retryAt;
+    int64_t m_now;
+    bool m_inFlight;
+
+    std::vector<PartitionChange> m_changes;
+    size_t m_requests;
+    size_t m_failures;
+};
+
+}
@@ -0,0 +1,194 @@
+#include "OffsetCommitter.h"
+
+#include <algorithm>
+
+using namespace kafkaprotocpp;
+
+void OffsetCommitter::setMember(const std::string& groupid, int32_t genid, const std::string& memberid)
+{
+    Group& g = m_groups[groupid];
+    g.genid = genid;
+    g.memberid = memberid;
+}
+
+void OffsetCommitter::track(const std::string& groupid, const std::string& topic, int32_t parn, int64_t offset,
+        const std::string& meta)
+{
+    Group& g = m_groups[groupid];
+    PartitionKey key(topic, parn);
+    PartitionState& st = g.partitions[key];
+    if(offset == st.offset)
+        return;
+    st.offset = offset;
+    st.meta = meta;
+    markDirty(g, key, st);
+}
+
+void OffsetCommitter::markDirty(Group& g, const PartitionKey& key, PartitionState& st)
+{
+    if(st.dirty)
+        return;
+    st.dirty = true;
+    g.dirty.push_back(key);
+}
+
+size_t OffsetCommitter::poll(int64_t nowMs, std::vector<Commit>& due, bool force)
+{
+    size_t n = 0;
+    for(auto& it : m_groups) {
+        Group& g = it.second;
+        if(g.inFlight || g.dirty.empty())
+            continue;
+        if(g.lastFlushMs < 0)
+            g.lastFlushMs = nowMs; // the interval starts with the first change
+        if(!force && g.dirty.size() < m_opts.threshold && nowMs - g.lastFlushMs < m_opts.intervalMs)
+            continue;
+
+        due.emplace_back();
+        build(it.first, g, nowMs, due.back());
+        ++n;
+    }
+    return n;
+}
+
+// everything dirty goes into one request, grouped by topic
+void OffsetCommitter::build(const std::string& groupid, Group& g, int64_t nowMs, Commit& c)
+{
+    c.groupid = groupid;
+    OffsetCommitRequest& req = c.req;
+    req.groupid = groupid;
+    req.generationId = g.genid;
+    req.consumerId = g.memberid;
+    req.retentionTime = m_opts.retentionTime;
+    req.offsets.clear();
+
+    std::sort(g.dirty.begin(), g.dirty.end());
+    for(auto& key : g.dirty) {
+        PartitionState& st = g.partitions[key];
+        st.dirty = false;
+        st.sent = st.offset;
+
+        if(req.offsets.empty() || req.offsets.back().topic != key.first) {
+            req.offsets.emplace_back();
+            req.offsets.back().topic = key.first;
+        }
+        req.offsets.back().parOffsetMetas.emplace_back();
+        PartitionOffsetMeta& pom = req.offsets.back().parOffsetMetas.back();
+        pom.parn = key.second;
+        pom.offset = st.offset;
+        pom.meta = st.meta;
+    }
+    g.dirty.clear();
+    g.inFlight = true;
+    g.lastFlushMs = nowMs;
+}
+
+bool OffsetCommitter::retriable(int16_t errcode)
+{
+    switch(errcode) {
+    case ApiConstants::ERRORCODE_REQUEST_TIMED_OUT:
+    case ApiConstants::ERRORCODE_GROUP_LOAD_IN_PROCESS:
+    case ApiConstants::ERRORCODE_GROUP_COORDINATOR_NOT_AVAIBLE:
+    case ApiConstants::ERRORCODE_GROUP_NOT_COORDINATOR:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void OffsetCommitter::complete(const std::string& groupid, const OffsetCommitResponse& res, std::vector<Error>* errors)
+{
+    auto git = m_groups.find(groupid);
+    if(git == m_groups.end() || !git->second.inFlight)
+        return;
+    Group& g = git->second;
+
+    for(auto& topic : res.result) {
+        for(auto& pe : topic.block) {
+            PartitionKey key(topic.topic, pe.parn);
+            auto it = g.partitions.find(key);
+            if(it == g.partitions.end() || it->second.sent < 0)
+                continue;
+            PartitionState& st = it->second;
+
+            if(pe.errcode == ApiConstants::ERRORCODE_NO_ERROR) {
+                st.committed = st.sent;
+            } else {
+                // resend unless a newer offset is already queued
+                bool retry = retriable(pe.errcode);
+                if(retry)
+                    markDirty(g, key, st);
+                if(errors) {
+                    Error e;
+                    e.groupid = groupid;
+                    e.topic = key.first;
+                    e.parn = key.second;
+                    e.offset = st.sent;
+                    e.errcode = pe.errcode;
+                    e.retried = retry;
+                    errors->push_back(e);
+                }
+            }
+            st.sent = -1;
+        }
+    }
+
+    // partitions the response left out are sent again
+    for(auto& it : g.partitions) {
+        if(it.second.sent >= 0) {
+            it.second.sent = -1;
+            markDirty(g, it.first, it.second);
+        }
+    }
+    g.inFlight = false;
+}
+
+void OffsetCommitter::failed(const std::string& groupid)
+{
+    auto git = m_groups.find(groupid);
+    if(git == m_groups.end() || !git->second.inFlight)
+        return;
+    Group& g = git->second;
+
+    for(auto& it : g.partitions) {
+        if(it.second.sent >= 0) {
+            it.second.sent = -1;
+            markDirty(g, it.first, it.second);
+        }
+    }
+    g.inFlight = false;
+}
+
+void OffsetCommitter::drop(const std::string& groupid)
+{
+    auto git = m_groups.find(groupid);
+    if(git == m_groups.end())
+        return;
+    Group& g = git->second;
+
+    for(auto& key : g.dirty)
+        g.partitions[key].dirty = false;
+    g.dirty.clear();
+    g.lastFlushMs = -1;
+}
+
+int64_t OffsetCommitter::committed(const std::string& groupid, const std::string& topic, int32_t parn) const
+{
+    auto git = m_groups.find(groupid);
+    if(git == m_groups.end())
+        return -1;
+    auto it = git->second.partitions.find(PartitionKey(topic, parn));
+    return it == git->second.partitions.end() ? -1 : it->second.committed;
+}
+
+bool OffsetCommitter::inFlight(const std::string& groupid) const
+{
+    auto git = m_groups.find(groupid);
+    return git != m_groups.end() && git->second.inFlight;
+}
+
+size_t OffsetCommitter::pending(const std::string& groupid) const
+{
+    auto git = m_groups.find(groupid);
+    return git == m_groups.end() ? 0 : git->second.dirty.size();
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "KafkaConsumerMessage.h"
+
+#include <map>
+
+namespace kafkaprotocpp {
+
+// Coalesces offset commits.
+//
+// The consumer calls track() after every batch, which only records the latest
+// offset of the partition. poll() turns what changed since the last commit
+// into at most one OffsetCommitRequest per group, when the group's interval
+// has passed or enough partitions changed, and never while the group still
+// has a commit in flight. Commit traffic is then bounded by groups and time,
+// not by how much is consumed. Sending is left to the caller:
+//
+//     std::vector<OffsetCommitter::Commit> due;
+//     committer.poll(nowMs, due);
+//     for(auto& c : due)
+//         ... send c.req to the coordinator of c.groupid, then
+//         committer.complete(c.groupid, res, &errors);  // or failed(c.groupid)
+class OffsetCommitter
+{
+public:
+    struct Options
+    {
+        int64_t intervalMs;    // commit changed offsets at least this often
+        size_t threshold;      // or as soon as this many partitions changed
+        int64_t retentionTime; // OffsetCommitRequest::retentionTime, -1 for the broker default
+
+        Options() : intervalMs(5000), threshold(1000), retentionTime(-1) {}
+    };
+
+    struct Commit
+    {
+        std::string groupid;
+        OffsetCommitRequest req;
+    };
+
+    // a partition the coordinator did not commit
+    struct Error
+    {
+        std::string groupid;
+        std::string topic;
+        int32_t parn;
+        int64_t offset;
+        int16_t errcode;
+        bool retried; // will be sent again by a later poll()
+    };
+
+    explicit OffsetCommitter(const Options& opts = Options()) : m_opts(opts) {}
+
+    // generation and member id put in this group's requests
+    void setMember(const std::string& groupid, int32_t genid, const std::string& memberid);
+
+    // offset is the next offset to consume, as Kafka expects
+    void track(const std::string& groupid, const std::string& topic, int32_t parn, int64_t offset,
+            const std::string& meta = std::string());
+
+    // appends the commits due at nowMs, all groups with changes if force
+    size_t poll(int64_t nowMs, std::vector<Commit>& due, bool force = false);
+
+    // the response to this group's commit in flight; errors, if given,
+    // receives the partitions that failed
+    void complete(const std::string& groupid, const OffsetCommitResponse& res, std::vector<Error>* errors = NULL);
+    // the commit in flight got no response; its offsets go out again
+    void failed(const std::string& groupid);
+
+    // forget a group's uncommitted offsets, e.g. after losing its partitions
+    void drop(const std::string& groupid);
+
+    // last committed offset, -1 if none
+    int64_t committed(const std::string& groupid, const std::string& topic, int32_t parn) const;
+    bool inFlight(const std::string& groupid) const;
+    size_t pending(const std::string& groupid) const;
+
+private:
+    typedef std::pair<std::string, int32_t> PartitionKey;
+
+    struct PartitionState
+    {
+        int64_t offset;    // latest tracked
+        std::string meta;
+        int64_t sent;      // offset in the commit in flight, -1 if none
+        int64_t committed;
+        bool dirty;        // offset not committed nor in flight
+
+        PartitionState() : offset(-1), sent(-1), committed(-1), dirty(false) {}
+    };
+
+    struct Group
+    {
+        int32_t genid;
+        std::string memberid;
+        std::map<PartitionKey, PartitionState> partitions;
+        std::vector<PartitionKey> dirty;
+        bool inFlight;
+        int64_t lastFlushMs;
+
+        Group() : genid(-1), inFlight(false), lastFlushMs(-1) {}
+    };
+
+    void markDirty(Group& g, const PartitionKey& key, PartitionState& st);
+    void build(const std::string& groupid, Group& g, int64_t nowMs, Commit& c);
+
+    static bool retriable(int16_t errcode);
+
+    Options m_opts;
+    std::map<std::string, Group> m_groups;
+};
+
+}
@@ -0,0 +1,242 @@
+#include "OffsetSeeker.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+using namespace kafkaprotocpp;
+
+static int64_t steadyMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+OffsetSeeker::OffsetSeeker(BrokerPool& pool, const MetadataCache& meta, const Options& opts) :
+    m_pool(pool), m_meta(meta), m_opts(opts), m_now(0), m_requests(0), m_retries(0)
+{
+}
+
+void OffsetSeeker::add(const TopicName& topic, int32_t parn, int64_t timestamp)
+{
+    Key key(topic, parn);
+    m_results.erase(key);
+    auto it = m_pending.find(key);
+    if(it != m_pending.end()) {
+        Pending& p = it->second;
+        p.timestamp = timestamp;
+        p.tries = 0;
+        p.again = p.sent;
+        p.dropped = false;
+        return;
+    }
+    Pending& p = m_pending[key];
+    p.timestamp = timestamp;
+    p.tries = 0;
+    p.retryAt = 0;
+    p.sent = false;
+    p.again = false;
+    p.dropped = false;
+}
+
+void OffsetSeeker::add(const std::vector<Target>& targets)
+{
+    for(auto& t : targets)
+        add(t.topic, t.parn, t.timestamp);
+}
+
+void OffsetSeeker::clear()
+{
+    m_results.clear();
+    // the ones in flight are erased when they come back
+    for(auto it = m_pending.begin(); it != m_pending.end(); ) {
+        if(it->second.sent) {
+            it->second.dropped = true;
+            it->second.again = false;
+            ++it;
+        } else {
+            it = m_pending.erase(it);
+        }
+    }
+    m_requests = 0;
+    m_retries = 0;
+}
+
+// one request per leader with every partition due that it leads
+void OffsetSeeker::poll(int64_t nowMs)
+{
+    m_now = nowMs;
+    MetadataCache::Reader snap = m_meta.read();
+    m_pool.setBrokers(*snap);
+
+    std::map<int32_t, std::pair<ListOffsetRequest, std::shared_ptr<KeyList> > > byLeader;
+    std::vector<Key> noLeader;
+
+    for(auto& it : m_pending) {
+        Pending& p = it.second;
+        if(p.sent || p.dropped || p.retryAt > nowMs)
+            continue;
+        const Key& key = it.first;
+        int32_t leader = snap->leader(key.first, key.second);
+        if(leader < 0) {
+            noLeader.push_back(key);
+            continue;
+        }
+
+        auto& entry = byLeader[leader];
+        ListOffsetRequest& req = entry.first;
+        if(!entry.second) {
+            req.replicaId = -1;
+            entry.second = std::make_shared<KeyList>();
+        }
+        if(req.topicReqVec.empty() || req.topicReqVec.back().topic != key.first) {
+            req.topicReqVec.emplace_back();
+            req.topicReqVec.back().topic = key.first;
+        }
+        ListOffsetReqPartitionUnit pu;
+        pu.parn = key.second;
+        pu.time_before = p.timestamp;
+        req.topicReqVec.back().parReqVec.push_back(pu);
+        entry.second->push_back(key);
+        if(p.tries > 0)
+            ++m_retries;
+        ++p.tries;
+        p.sent = true;
+    }
+
+    for(auto& key : noLeader) {
+        ++m_pending[key].tries;
+        retry(key, ApiConstants::ERRORCODE_LEADER_NOT_AVAILABLE);
+    }
+
+    for(auto& it : byLeader) {
+        std::shared_ptr<KeyList> sentList = it.second.second;
+        AsyncConnection* conn = m_pool.get(it.first);
+        // timestamps need v1, v0 answers "offsets before" instead
+        int16_t ver = conn ? conn->Versions().pick<ListOffsetRequest>() : -1;
+        if(conn && ver < ApiConstants::API_VERSION1) {
+            for(auto& key : *sentList)
+                finish(key, -1, -1, ApiConstants::ERRORCODE_UNSUPPORTED_VERSION);
+            continue;
+        }
+        if(!conn || conn->Send(ListOffsetRequest::apikey, ver, it.second.first,
+                    [this, sentList, ver](int err, const Unpack& body) { onListOffsets(*sentList, ver, err, body); }) < 0) {
+            onListOffsets(*sentList, ver, -1, Unpack(NULL, 0));
+            continue;
+        }
+        ++m_requests;
+    }
+}
+
+bool OffsetSeeker::run(int timeoutMs)
+{
+    int64_t start = steadyMs();
+    for(;;) {
+        int64_t now = steadyMs();
+        poll(now);
+        if(done())
+            return true;
+        int64_t left = start + timeoutMs - now;
+        if(left <= 0)
+            return false;
+        m_pool.poll(std::min<int64_t>(left, m_opts.retryBackoffMs));
+    }
+}
+
+void OffsetSeeker::onListOffsets(const KeyList& sent, int ver, int err, const Unpack& body)
+{
+    ListOffsetResponse res;
+    if(err == 0) {
+        try {
+            res.unmarshal(body, ver);
+        } catch(const PacketError&) {
+            err = -1;
+        }
+    }
+
+    if(err == 0) {
+        for(auto& topic : res.offsets) {
+            for(auto& po : topic.parOffsets) {
+                Key key(topic.topic, po.parn);
+                if(!answered(key))
+                    continue;
+                if(leadershipError(po.errcode))
+                    retry(key, po.errcode);
+                else if(po.errcode != ApiConstants::ERRORCODE_NO_ERROR)
+                    finish(key, -1, -1, po.errcode);
+                else
+                    finish(key, po.offset, po.timestamp, po.errcode);
+            }
+        }
+    }
+
+    // no answer for these: the connection failed or the broker left them out
+    for(auto& key : sent) {
+        if(answered(key))
+            retry(key, ApiConstants::ERRORCODE_BROKER_NOT_AVAILABLE);
+    }
+}
+
+// An answer for key came back, true if it is to be used. A partition
+// cleared meanwhile is erased, one added again goes out at the next poll.
+bool OffsetSeeker::answered(const Key& key)
+{
+    auto it = m_pending.find(key);
+    if(it == m_pending.end() || !it->second.sent)
+        return false;
+    Pending& p = it->second;
+    p.sent = false;
+    if(p.dropped) {
+        m_pending.erase(it);
+        return false;
+    }
+    if(p.again) {
+        p.again = false;
+        p.retryAt = 0;
+        return false;
+    }
+    return true;
+}
+
+void OffsetSeeker::finish(const Key& key, int64_t offset, int64_t timestamp, int16_t errcode)
+{
+    m_pending.erase(key);
+    Result& r = m_results[key];
+    r.offset = offset;
+    r.timestamp = timestamp;
+    r.errcode = errcode;
+}
+
+void OffsetSeeker::retry(const Key& key, int16_t errcode)
+{
+    Pending& p = m_pending[key];
+    p.sent = false;
+    if(p.tries > m_opts.maxRetries) {
+        finish(key, -1, -1, errcode);
+        return;
+    }
+    p.retryAt = m_now + m_opts.retryBackoffMs;
+}
+
+std::set<TopicName> OffsetSeeker::staleTopics() const
+{
+    std::set<TopicName> topics;
+    for(auto& it : m_pending) {
+        if(!it.second.sent && it.second.tries > 0)
+            topics.insert(it.first.first);
+    }
+    return topics;
+}
+
+bool OffsetSeeker::leadershipError(int16_t errcode)
+{
+    switch(errcode) {
+    case ApiConstants::ERRORCODE_UNKNOWN_TOPIC_OR_PARTITION:
+    case ApiConstants::ERRORCODE_LEADER_NOT_AVAILABLE:
+    case ApiConstants::ERRORCODE_NOT_LEADER_FOR_PARTITION:
+    case ApiConstants::ERRORCODE_REPLICA_NOT_AVAILABLE:
+        return true;
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "BrokerPool.h"
+
+#include <map>
+#include <set>
+
+namespace kafkaprotocpp {
+
+// Offsets by timestamp for many partitions at once, e.g. to reset a consumer
+// group to a point in time.
+//
+// Partitions are grouped by leader from the MetadataCache and each leader gets
+// one ListOffsetRequest (v1) for all of its partitions; the requests go out
+// together over the BrokerPool and complete concurrently. A partition that
+// comes back with a leadership error (or whose broker could not be reached) is
+// retried on its own after Options::retryBackoffMs with the leader the
+// metadata has by then; staleTopics() tells which topics to refresh.
+// Everything else is final.
+//
+//     OffsetSeeker seeker(pool, cache);
+//     for(...)
+//         seeker.add(topic, parn, timestampMs);
+//     seeker.run(5000);              // or poll(now) + pool.poll() in your loop
+//     for(auto& it : seeker.results()) ...
+class OffsetSeeker
+{
+public:
+    struct Options
+    {
+        int maxRetries;     // per partition, for leadership errors
+        int retryBackoffMs;
+
+        Options() : maxRetries(5), retryBackoffMs(100) {}
+    };
+
+    struct Target
+    {
+        TopicName topic;
+        int32_t parn;
+        int64_t timestamp; // ms, or -1 for the log end, -2 for the log start
+    };
+
+    struct Result
+    {
+        // first offset whose timestamp is at least the one asked for, -1 if
+        // there is none (seek to the log end then) or errcode is set
+        int64_t offset;
+        int64_t timestamp; // of that record, -1 for the special timestamps
+        int16_t errcode;
+    };
+
+    typedef std::pair<TopicName, int32_t> Key;
+    typedef std::map<Key, Result> ResultMap;
+
+    OffsetSeeker(BrokerPool& pool, const MetadataCache& meta, const Options& opts = Options());
+
+    // look it up with the next poll(); a partition in flight is sent again
+    // with the new timestamp once its answer is back
+    void add(const TopicName& topic, int32_t parn, int64_t timestamp);
+    void add(const std::vector<Target>& targets);
+
+    // send every partition that is due
+    void poll(int64_t nowMs);
+    bool done() const { return m_pending.empty(); }
+    // poll and poll the pool until done, false on timeout
+    bool run(int timeoutMs);
+
+    // partitions answered so far
+    const ResultMap& results() const { return m_results; }
+    // forget results and pending partitions, answers in flight are ignored
+    void clear();
+
+    // topics of partitions waiting to be retried after a leadership error
+    std::set<TopicName> staleTopics() const;
+
+    size_t requests() const { return m_requests; } // ListOffsetRequests sent
+    size_t retries() const { return m_retries; }   // partitions sent again
+
+private:
+    OffsetSeeker(const OffsetSeeker&);
+    OffsetSeeker& operator = (const OffsetSeeker&);
+
+    struct Pending
+    {
+        int64_t timestamp;
+        int tries;
+        int64_t retryAt;
+        bool sent;
+        bool again;   // add()ed again while in flight, send once it is back
+        bool dropped; // clear()ed while in flight
+    };
+
+    typedef std::vector<Key> KeyList;
+
+    void onListOffsets(const KeyList& sent, int ver, int err, const Unpack& body);
+    bool answered(const Key& key);
+    void finish(const Key& key, int64_t offset, int64_t timestamp, int16_t errcode);
+    void retry(const Key& key, int16_t errcode);
+
+    static bool leadershipError(int16_t errcode);
+
+    BrokerPool& m_pool;
+    const MetadataCache& m_meta;
+    Options m_opts;
+
+    std::map<Key, Pending> m_pending; // by topic, so a request lists each topic once
+    ResultMap m_results;
+
+    int64_t m_now;
+    size_t m_requests;
+    size_t m_retries;
+};
+
+}
@@ -5,13 +5,17 @@
 #include <vector>
 #include <arpa/inet.h>
 #include <stdexcept>
+#include <iterator>
 
 #include "zlib.h"
 #include "BlockBuffer.h"
+#include "TopicTable.h"
+#include "ByteSwap.h"
+#include "Varint.h"
 
 #ifndef ntohll
-#define ntohll(x) ( ( (uint64_t)(ntohl( (uint32_t)((x << 32) >> 32) )) << 32) | ntohl( ((uint32_t)(x >> 32)) ) )                                        
-#define htonll(x) ntohll(x)
+#define ntohll(x) kafkaprotocpp::be64(x)
+#define htonll(x) kafkaprotocpp::be64(x)
 #endif
 
 namespace kafkaprotocpp {
@@ -45,6 +49,15 @@ struct IncompletePacket : public PacketError
     IncompletePacket(const std::string& w) : PacketError(w) {}
 };
 
+// result of the non-throwing decode() functions
+enum DecodeStatus
+{
+    DECODE_OK = 0,
+    DECODE_TRUNCATED = 1,  // decoded, but a message set ended in a partial message (normal for fetch)
+    DECODE_INCOMPLETE = 2, // ran out of bytes
+    DECODE_MALFORMED = 3,  // a length or count that can't be right
+};
+
 class PackBuffer
 {
 private:
@@ -73,6 +86,13 @@ public:
 			return;
 		throw PackError("append buffer overflow");
 	}
+	// grow by n bytes for the caller to fill, returns where they start
+	char * extend(size_t n)
+	{
+		if(char * p = bb.extend(n))
+			return p;
+		throw PackError("extend buffer overflow");
+	}
 	void append(const char * data)
 	{
 		append(data,:: strlen(data));
@@ -137,22 +157,44 @@ public:
 
 	Pack & push_int16(int16_t num)
 	{
-		num = htons(num); 
-        return push(&num, 2);
+		char buf[2];
+		store_be16(buf, num);
+        return push(buf, 2);
 	}
 
 	Pack & push_int32(int32_t num)
 	{
-		num = htonl(num); 
-        return push(&num, 4);
+		char buf[4];
+		store_be32(buf, num);
+        return push(buf, 4);
 	}	
 
 	Pack & push_int64(int64_t num)
 	{
-		num = htonll(num); 
-        return push(&num, 8);
+		char buf[8];
+		store_be64(buf, num);
+        return push(buf, 8);
 	}
 
+    // bulk encode: grow once, byte-swap the whole array into place
+    Pack & push_int16_array(const int16_t* arr, size_t n)
+    {
+        store_be16_array(m_buffer.extend(n * 2), arr, n);
+        return *this;
+    }
+
+    Pack & push_int32_array(const int32_t* arr, size_t n)
+    {
+        store_be32_array(m_buffer.extend(n * 4), arr, n);
+        return *this;
+    }
+
+    Pack & push_int64_array(const int64_t* arr, size_t n)
+    {
+        store_be64_array(m_buffer.extend(n * 8), arr, n);
+        return *this;
+    }
+
     Pack & push_string(const std::string& str)
     {
         if(str.size() > 0xFFFF) throw PackError("push_string: string too long");
@@ -171,6 +213,54 @@ public:
         return push_int32(size).push(data, size);
 	}
 
+    // Flexible versions (KIP-482): lengths and counts are unsigned varints
+    // stored plus one, so 0 is null, and structs end with tagged fields.
+    Pack & push_uvarint(uint64_t v)
+    {
+        char buf[10];
+        return push(buf, write_uvarint(buf, v));
+    }
+
+    Pack & push_varint(int64_t v)
+    {
+        char buf[10];
+        return push(buf, write_varint(buf, v));
+    }
+
+    Pack & push_compact_string(const char* data, size_t len)
+    {
+        if(len > 0x7FFF) throw PackError("push_compact_string: string too long");
+        return push_uvarint(len + 1).push(data, len);
+    }
+
+    Pack & push_compact_string(const std::string& str)
+    {
+        return push_compact_string(str.data(), str.size());
+    }
+
+    Pack & push_compact_bytes(const char* data, size_t size)
+    {
+        if(size > 0x7FFFFFFF) throw PackError("push_compact_bytes: bytes too long");
+        return push_uvarint(size + 1).push(data, size);
+    }
+
+    // null compact string, bytes or array
+    Pack & push_compact_null()
+    {
+        return push_int8(0);
+    }
+
+    Pack & push_compact_array_len(size_t n)
+    {
+        return push_uvarint(n + 1);
+    }
+
+    // an empty tagged field section
+    Pack & push_tagged_fields()
+    {
+        return push_int8(0);
+    }
+
     // replace apis
 	size_t replace(size_t pos, const void* data, size_t rplen)
 	{
@@ -183,13 +273,15 @@ public:
 	}
 	size_t replace_int16(size_t pos, int16_t u16)
 	{
-		u16 = htons(u16);
-		return replace(pos, &u16, 2);
+		char buf[2];
+		store_be16(buf, u16);
+		return replace(pos, buf, 2);
 	}
 	size_t replace_int32(size_t pos, int32_t u32)
 	{
-		u32 = htonl(u32);
-		return replace(pos, &u32, 4);
+		char buf[4];
+		store_be32(buf, u32);
+		return replace(pos, buf, 4);
 	}
 
     // The CRC32 functions make the following assumptions:
@@ -260,7 +352,7 @@ public:
 		if(m_size < 1u)
 			throw UnpackError("pop_int8: not enough data");
 
-		int8_t i8 = *((int8_t*)m_data);
+		int8_t i8 = (int8_t)m_data[0];
 		m_data += 1u; m_size -= 1u;
 		return i8;
 	}
@@ -270,8 +362,7 @@ public:
 		if(m_size < 2u)
 			throw UnpackError("pop_int16: not enough data");
 
-		int16_t i16 = *((int16_t*)m_data);
-		i16 = ntohs(i16);
+		int16_t i16 = load_be16(m_data);
 
 		m_data += 2u; m_size -= 2u;
 		return i16;
@@ -281,8 +372,7 @@ public:
 	{
 		if(m_size < 4u)
 			throw UnpackError("pop_int32: not enough data");
-		int32_t i32 = *((int32_t*)m_data);
-		i32 = ntohl(i32);
+		int32_t i32 = load_be32(m_data);
 		m_data += 4u; m_size -= 4u;
 		return i32;
 	}
@@ -290,20 +380,39 @@ public:
 	int32_t peek_int32() const {
 		if (m_size < 4u)
 			throw UnpackError("peek_int32: not enough data");
-		int32_t i32 = *((int32_t*)m_data);
-		i32 = ntohl(i32);
-		return i32;
+		return load_be32(m_data);
 	}
 	int64_t pop_int64() const
 	{
 		if(m_size < 8u)
 			throw UnpackError("pop_int64: not enough data");
-		int64_t i64 = *((int64_t*)m_data);
-		i64 = ntohll(i64);
+		int64_t i64 = load_be64(m_data);
 		m_data += 8u; m_size -= 8u;
 		return i64;
 	}
 
+    // bulk decode of n big-endian elements, one bounds check for all of them
+    void pop_int16_array(int16_t* arr, size_t n) const
+    {
+        if(m_size / 2u < n)
+            throw UnpackError("pop_int16_array: not enough data");
+        load_be16_array(arr, pop_fetch_ptr(n * 2), n);
+    }
+
+    void pop_int32_array(int32_t* arr, size_t n) const
+    {
+        if(m_size / 4u < n)
+            throw UnpackError("pop_int32_array: not enough data");
+        load_be32_array(arr, pop_fetch_ptr(n * 4), n);
+    }
+
+    void pop_int64_array(int64_t* arr, size_t n) const
+    {
+        if(m_size / 8u < n)
+            throw UnpackError("pop_int64_array: not enough data");
+        load_be64_array(arr, pop_fetch_ptr(n * 8), n);
+    }
+
     std::string pop_bytes() const
 	{
 		int size = pop_int32();
@@ -323,6 +432,162 @@ public:
         return std::string(data, len);
     }
 
+    // into an existing string, reusing its capacity
+    void pop_bytes(std::string& s) const
+    {
+        int size = pop_int32();
+        if(size <= 0)
+            s.clear();
+        else
+            s.assign(pop_fetch_ptr(size), size);
+    }
+
+    void pop_string(std::string& s) const
+    {
+        int16_t len = pop_int16();
+        if(len <= 0)
+            s.clear();
+        else
+            s.assign(pop_fetch_ptr(len), len);
+    }
+
+    // interns straight from the wire bytes, no allocation for a known topic
+    TopicName pop_topic() const
+    {
+        int16_t len = pop_int16();
+        if(len <= 0)
+            return TopicName();
+
+        const char* data = pop_fetch_ptr(len);
+        return TopicName(data, len);
+    }
+
+    uint64_t pop_uvarint() const
+    {
+        const char* p = m_data;
+        uint64_t v;
+        if(!read_uvarint(p, m_data + m_size, v))
+            throw UnpackError("pop_uvarint: bad varint");
+        m_size -= p - m_data;
+        m_data = p;
+        return v;
+    }
+
+    int64_t pop_varint() const
+    {
+        return zigzag_decode(pop_uvarint());
+    }
+
+    // length of a compact string or bytes, element count of a compact array;
+    // -1 for null
+    int32_t pop_compact_len() const
+    {
+        uint64_t v = pop_uvarint();
+        if(v > 0x80000000u)
+            throw UnpackError("pop_compact_len: length too big");
+        return (int32_t)(v - 1);
+    }
+
+    std::string pop_compact_string() const
+    {
+        int32_t len = pop_compact_len();
+        if(len <= 0)
+            return "";
+        return std::string(pop_fetch_ptr(len), len);
+    }
+
+    void pop_compact_string(std::string& s) const
+    {
+        int32_t len = pop_compact_len();
+        if(len <= 0)
+            s.clear();
+        else
+            s.assign(pop_fetch_ptr(len), len);
+    }
+
+    std::string pop_compact_bytes() const
+    {
+        return pop_compact_string();
+    }
+
+    void pop_compact_bytes(std::string& s) const
+    {
+        pop_compact_string(s);
+    }
+
+    TopicName pop_compact_topic() const
+    {
+        int32_t len = pop_compact_len();
+        if(len <= 0)
+            return TopicName();
+        const char* data = pop_fetch_ptr(len);
+        return TopicName(data, len);
+    }
+
+    // Tagged fields: a count, then tag, size and data for each. f(tag, data)
+    // is called for every field, data covering just its bytes; whatever f
+    // leaves unread is skipped.
+    template <class F>
+    void pop_tagged_fields(F f) const
+    {
+        for(uint64_t n = pop_uvarint(); n > 0; --n) {
+            uint64_t tag = pop_uvarint();
+            uint64_t size = pop_uvarint();
+            if(size > m_size)
+                throw UnpackError("pop_tagged_fields: not enough data");
+            Unpack field(pop_fetch_ptr(size), size);
+            f((uint32_t)tag, field);
+        }
+    }
+
+    // the tagged fields of a struct this code knows none of
+    void skip_tagged_fields() const
+    {
+        pop_tagged_fields([](uint32_t, const Unpack&) {});
+    }
+
+    // Unchecked reads for the non-throwing decoders: a group of fixed-size
+    // fields is checked once with has(), then read with take_*.
+    bool has(size_t n) const
+    {
+        return m_size >= n;
+    }
+
+    int8_t take_int8() const
+    {
+        int8_t i8 = (int8_t)m_data[0];
+        m_data += 1u; m_size -= 1u;
+        return i8;
+    }
+
+    int16_t take_int16() const
+    {
+        int16_t i16 = load_be16(m_data);
+        m_data += 2u; m_size -= 2u;
+        return i16;
+    }
+
+    int32_t take_int32() const
+    {
+        int32_t i32 = load_be32(m_data);
+        m_data += 4u; m_size -= 4u;
+        return i32;
+    }
+
+    int64_t take_int64() const
+    {
+        int64_t i64 = load_be64(m_data);
+        m_data += 8u; m_size -= 8u;
+        return i64;
+    }
+
+    const char * take_ptr(size_t k) const
+    {
+        const char * p = m_data;
+        m_data += k; m_size -= k;
+        return p;
+    }
+
 	const char * pop_fetch_ptr(size_t k) const
 	{
 		if(m_size < k)
@@ -357,6 +622,10 @@ private:
 struct Marshallable {
     virtual void marshal(Pack &) const {}
     virtual void unmarshal(const Unpack &) {}
+    // at a given API version; Request and the connections go through these,
+    // structs that cover several versions override them
+    virtual void marshal(Pack &pk, int) const { marshal(pk); }
+    virtual void unmarshal(const Unpack &up, int) { unmarshal(up); }
     virtual ~Marshallable()
     {
     }
@@ -406,6 +675,12 @@ inline Pack & operator << (Pack & p, const std::string & str)
 	return p;
 }
 
+inline Pack & operator << (Pack & p, const TopicName & topic)
+{
+	p.push_string(topic.data(), topic.size());
+	return p;
+}
+
 inline const Unpack& operator>>(const Unpack& p, int &i32)
 {
     i32 = p.pop_int32();
@@ -420,7 +695,13 @@ inline const Unpack & operator >> (const Unpack & p, int64_t & i64)
 
 inline const Unpack & operator >> (const Unpack & p, std::string & str)
 {
-	str = p.pop_string();
+	p.pop_string(str);
+	return p;
+}
+
+inline const Unpack & operator >> (const Unpack & p, TopicName & topic)
+{
+	topic = p.pop_topic();
 	return p;
 }
 
@@ -446,6 +727,34 @@ inline void marshal_container(Pack & p, const ContainerClass & c)
 		p << *i;
 }
 
+// integral arrays are encoded in bulk
+inline void marshal_container(Pack & p, const std::vector<int16_t> & c)
+{
+	p.push_int32(c.size());
+	p.push_int16_array(c.data(), c.size());
+}
+
+inline void marshal_container(Pack & p, const std::vector<int32_t> & c)
+{
+	p.push_int32(c.size());
+	p.push_int32_array(c.data(), c.size());
+}
+
+inline void marshal_container(Pack & p, const std::vector<int64_t> & c)
+{
+	p.push_int32(c.size());
+	p.push_int64_array(c.data(), c.size());
+}
+
+// compact array (flexible versions)
+template < typename ContainerClass >
+inline void marshal_compact_container(Pack & p, const ContainerClass & c)
+{
+	p.push_compact_array_len(c.size());
+	for(typename ContainerClass::const_iterator i = c.begin(); i != c.end(); ++i)
+		p << *i;
+}
+
 template <class T>
 inline Pack & operator << (Pack& p, const std::vector<T>& vec)
 {
@@ -461,16 +770,135 @@ inline void unmarshal_container(const Unpack & p, OutputIterator i)
 	{
 		typename OutputIterator::container_type::value_type tmp;
 		p >> tmp;
-		*i = tmp;
+		*i = std::move(tmp);
 		++i;
 	}
 }
 
+// integral arrays are appended in bulk: one resize, one vectorized byte swap
+template <class T>
+inline void unmarshal_int_array(const Unpack & p, std::vector<T> & vec, void (Unpack::*pop)(T*, size_t) const)
+{
+	int32_t count = p.pop_int32();
+	if(count <= 0)
+		return;
+	if(p.size() / sizeof(T) < (size_t)count)
+		throw UnpackError("unmarshal_container: not enough data");
+	size_t old = vec.size();
+	vec.resize(old + count);
+	(p.*pop)(vec.data() + old, count);
+}
+
+// reaches the container behind a back_insert_iterator (a protected member)
+template <class C>
+struct back_insert_access : public std::back_insert_iterator<C>
+{
+	static C & get(const std::back_insert_iterator<C> & i)
+	{
+		return *(i.*(&back_insert_access::container));
+	}
+};
+
+inline void unmarshal_container(const Unpack & p, std::back_insert_iterator<std::vector<int16_t> > i)
+{
+	unmarshal_int_array(p, back_insert_access<std::vector<int16_t> >::get(i), &Unpack::pop_int16_array);
+}
+
+inline void unmarshal_container(const Unpack & p, std::back_insert_iterator<std::vector<int32_t> > i)
+{
+	unmarshal_int_array(p, back_insert_access<std::vector<int32_t> >::get(i), &Unpack::pop_int32_array);
+}
+
+inline void unmarshal_container(const Unpack & p, std::back_insert_iterator<std::vector<int64_t> > i)
+{
+	unmarshal_int_array(p, back_insert_access<std::vector<int64_t> >::get(i), &Unpack::pop_int64_array);
+}
+
+// Decodes over the vector's current contents: it is resized to the wire
+// count and existing elements are overwritten in place, so an object decoded
+// again and again keeps its capacity (and that of its elements).
+template <class T>
+inline void unmarshal_vector(const Unpack & p, std::vector<T> & vec)
+{
+	int32_t count = p.pop_int32();
+	if(count <= 0) {
+		vec.clear();
+		return;
+	}
+	// every element takes at least one byte, so a bogus count can't resize much
+	if(p.size() < (size_t)count)
+		throw UnpackError("unmarshal_vector: not enough data");
+	vec.resize(count);
+	for(auto& e : vec)
+		p >> e;
+}
+
+inline void unmarshal_vector(const Unpack & p, std::vector<int16_t> & vec)
+{
+	vec.clear();
+	unmarshal_int_array(p, vec, &Unpack::pop_int16_array);
+}
+
+inline void unmarshal_vector(const Unpack & p, std::vector<int32_t> & vec)
+{
+	vec.clear();
+	unmarshal_int_array(p, vec, &Unpack::pop_int32_array);
+}
+
+inline void unmarshal_vector(const Unpack & p, std::vector<int64_t> & vec)
+{
+	vec.clear();
+	unmarshal_int_array(p, vec, &Unpack::pop_int64_array);
+}
+
+// compact array (flexible versions), decoded over the vector like unmarshal_vector
+template <class T>
+inline void unmarshal_compact_vector(const Unpack & p, std::vector<T> & vec)
+{
+	int32_t count = p.pop_compact_len();
+	if(count <= 0) {
+		vec.clear();
+		return;
+	}
+	if(p.size() < (size_t)count)
+		throw UnpackError("unmarshal_compact_vector: not enough data");
+	vec.resize(count);
+	for(auto& e : vec)
+		p >> e;
+}
+
 template <class T>
 inline const Unpack & operator >> (const Unpack & p, std::vector<T>& vec)
 {
-    unmarshal_container(p, back_inserter(vec));
+    unmarshal_vector(p, vec);
     return p;
 }
 
+// Non-throwing counterpart of unmarshal_vector, for element types that have a
+// DecodeStatus decode(const Unpack&). A truncated element is not an error.
+template <class T, class A>
+inline DecodeStatus decode_vector(const Unpack & p, std::vector<T, A> & vec)
+{
+	if(!p.has(4))
+		return DECODE_INCOMPLETE;
+	int32_t count = p.take_int32();
+	if(count <= 0) {
+		vec.clear();
+		return DECODE_OK;
+	}
+	if(p.size() < (size_t)count)
+		return DECODE_INCOMPLETE;
+	vec.resize(count);
+
+	DecodeStatus result = DECODE_OK;
+	for(auto& e : vec) {
+		DecodeStatus st = e.decode(p);
+		if(st == DECODE_TRUNCATED)
+			result = st;
+		else if(st != DECODE_OK)
+			return st;
+	}
+	return result;
+}
+
 }
@@ -0,0 +1,300 @@
+#include "PartitionSet.h"
+
+#include <algorithm>
+#include <iterator>
+
+using namespace kafkaprotocpp;
+
+static bool topicLess(const TopicPartitionsBlock& block, const std::string& topic)
+{
+    return block.topic < topic;
+}
+
+static bool sortedUnique(const std::vector<int32_t>& v)
+{
+    for(size_t i = 1; i < v.size(); ++i) {
+        if(v[i - 1] >= v[i])
+            return false;
+    }
+    return true;
+}
+
+size_t PartitionSet::size() const
+{
+    size_t n = 0;
+    for(auto& block : m_blocks)
+        n += block.partitions.size();
+    return n;
+}
+
+void PartitionSet::assign(const std::vector<TopicPartitionsBlock>& blocks)
+{
+    m_blocks = blocks;
+    normalize();
+}
+
+void PartitionSet::assign(std::vector<TopicPartitionsBlock>&& blocks)
+{
+    m_blocks = std::move(blocks);
+    normalize();
+}
+
+std::vector<TopicPartitionsBlock>::iterator PartitionSet::lower(const std::string& topic)
+{
+    return std::lower_bound(m_blocks.begin(), m_blocks.end(), topic, topicLess);
+}
+
+std::vector<TopicPartitionsBlock>::const_iterator PartitionSet::lower(const std::string& topic) const
+{
+    return std::lower_bound(m_blocks.begin(), m_blocks.end(), topic, topicLess);
+}
+
+const TopicPartitionsBlock* PartitionSet::find(const std::string& topic) const
+{
+    auto it = lower(topic);
+    return it != m_blocks.end() && it->topic == topic ? &*it : NULL;
+}
+
+bool PartitionSet::contains(const std::string& topic, int32_t parn) const
+{
+    const TopicPartitionsBlock* block = find(topic);
+    return block && std::binary_search(block->partitions.begin(), block->partitions.end(), parn);
+}
+
+bool PartitionSet::insert(const std::string& topic, int32_t parn)
+{
+    auto it = lower(topic);
+    if(it == m_blocks.end() || it->topic != topic) {
+        it = m_blocks.insert(it, TopicPartitionsBlock());
+        it->topic = topic;
+    }
+    std::vector<int32_t>& parts = it->partitions;
+    auto pit = std::lower_bound(parts.begin(), parts.end(), parn);
+    if(pit != parts.end() && *pit == parn)
+        return false;
+    parts.insert(pit, parn);
+    return true;
+}
+
+bool PartitionSet::erase(const std::string& topic, int32_t parn)
+{
+    auto it = lower(topic);
+    if(it == m_blocks.end() || it->topic != topic)
+        return false;
+    std::vector<int32_t>& parts = it->partitions;
+    auto pit = std::lower_bound(parts.begin(), parts.end(), parn);
+    if(pit == parts.end() || *pit != parn)
+        return false;
+    parts.erase(pit);
+    if(parts.empty())
+        m_blocks.erase(it);
+    return true;
+}
+
+TopicPartitionsBlock& PartitionSet::append(const std::string& topic)
+{
+    if(m_blocks.empty() || m_blocks.back().topic < topic) {
+        m_blocks.emplace_back();
+        m_blocks.back().topic = topic;
+        return m_blocks.back();
+    }
+    // out of order, still kept sorted but no longer O(1)
+    auto it = lower(topic);
+    if(it == m_blocks.end() || it->topic != topic) {
+        it = m_blocks.insert(it, TopicPartitionsBlock());
+        it->topic = topic;
+    }
+    return *it;
+}
+
+void PartitionSet::unite(const PartitionSet& o)
+{
+    PartitionSet out;
+    setUnion(*this, o, out);
+    swap(out);
+}
+
+void PartitionSet::subtract(const PartitionSet& o)
+{
+    PartitionSet out;
+    setDifference(*this, o, out);
+    swap(out);
+}
+
+// Set operations write into out's existing blocks, so a result reused across
+// calls keeps its capacity and steady state diffing doesn't allocate.
+static TopicPartitionsBlock& nextBlock(std::vector<TopicPartitionsBlock>& v, size_t& n, const std::string& topic)
+{
+    if(n == v.size())
+        v.emplace_back();
+    TopicPartitionsBlock& block = v[n++];
+    block.topic = topic;
+    block.partitions.clear();
+    return block;
+}
+
+static void copyBlock(std::vector<TopicPartitionsBlock>& v, size_t& n, const TopicPartitionsBlock& from)
+{
+    TopicPartitionsBlock& block = nextBlock(v, n, from.topic);
+    block.partitions.assign(from.partitions.begin(), from.partitions.end());
+}
+
+// merge over topics, then over the partitions of topics in both
+void PartitionSet::setUnion(const PartitionSet& a, const PartitionSet& b, PartitionSet& out)
+{
+    std::vector<TopicPartitionsBlock>& v = out.m_blocks;
+    size_t n = 0;
+    auto ia = a.m_blocks.begin(), ib = b.m_blocks.begin();
+    while(ia != a.m_blocks.end() || ib != b.m_blocks.end()) {
+        if(ib == b.m_blocks.end() || (ia != a.m_blocks.end() && ia->topic < ib->topic)) {
+            copyBlock(v, n, *ia++);
+        } else if(ia == a.m_blocks.end() || ib->topic < ia->topic) {
+            copyBlock(v, n, *ib++);
+        } else {
+            TopicPartitionsBlock& block = nextBlock(v, n, ia->topic);
+            std::set_union(ia->partitions.begin(), ia->partitions.end(), ib->partitions.begin(), ib->partitions.end(),
+                    std::back_inserter(block.partitions));
+            ++ia;
+            ++ib;
+        }
+    }
+    v.resize(n);
+}
+
+void PartitionSet::setDifference(const PartitionSet& a, const PartitionSet& b, PartitionSet& out)
+{
+    std::vector<TopicPartitionsBlock>& v = out.m_blocks;
+    size_t n = 0;
+    auto ib = b.m_blocks.begin();
+    for(auto& block : a.m_blocks) {
+        while(ib != b.m_blocks.end() && ib->topic < block.topic)
+            ++ib;
+        if(ib == b.m_blocks.end() || ib->topic != block.topic) {
+            copyBlock(v, n, block);
+            continue;
+        }
+        TopicPartitionsBlock& diff = nextBlock(v, n, block.topic);
+        std::set_difference(block.partitions.begin(), block.partitions.end(), ib->partitions.begin(),
+                ib->partitions.end(), std::back_inserter(diff.partitions));
+        if(diff.partitions.empty())
+            --n;
+    }
+    v.resize(n);
+}
+
+void PartitionSet::setIntersection(const PartitionSet& a, const PartitionSet& b, PartitionSet& out)
+{
+    std::vector<TopicPartitionsBlock>& v = out.m_blocks;
+    size_t n = 0;
+    auto ib = b.m_blocks.begin();
+    for(auto& block : a.m_blocks) {
+        while(ib != b.m_blocks.end() && ib->topic < block.topic)
+            ++ib;
+        if(ib == b.m_blocks.end())
+            break;
+        if(ib->topic != block.topic)
+            continue;
+        TopicPartitionsBlock& both = nextBlock(v, n, block.topic);
+        std::set_intersection(block.partitions.begin(), block.partitions.end(), ib->partitions.begin(),
+                ib->partitions.end(), std::back_inserter(both.partitions));
+        if(both.partitions.empty())
+            --n;
+    }
+    v.resize(n);
+}
+
+bool PartitionSet::operator == (const PartitionSet& o) const
+{
+    if(m_blocks.size() != o.m_blocks.size())
+        return false;
+    for(size_t i = 0; i < m_blocks.size(); ++i) {
+        if(m_blocks[i].topic != o.m_blocks[i].topic || m_blocks[i].partitions != o.m_blocks[i].partitions)
+            return false;
+    }
+    return true;
+}
+
+bool PartitionSet::normalized() const
+{
+    for(size_t i = 0; i < m_blocks.size(); ++i) {
+        if(i > 0 && !(m_blocks[i - 1].topic < m_blocks[i].topic))
+            return false;
+        if(m_blocks[i].partitions.empty() || !sortedUnique(m_blocks[i].partitions))
+            return false;
+    }
+    return true;
+}
+
+void PartitionSet::normalize()
+{
+    if(normalized())
+        return;
+
+    std::stable_sort(m_blocks.begin(), m_blocks.end(), [](const TopicPartitionsBlock& a, const TopicPartitionsBlock& b) {
+        return a.topic < b.topic;
+    });
+    // fold blocks of the same topic into the first one
+    size_t out = 0;
+    for(size_t i = 0; i < m_blocks.size(); ++i) {
+        if(out > 0 && m_blocks[out - 1].topic == m_blocks[i].topic) {
+            std::vector<int32_t>& dst = m_blocks[out - 1].partitions;
+            dst.insert(dst.end(), m_blocks[i].partitions.begin(), m_blocks[i].partitions.end());
+        } else {
+            if(out != i)
+                m_blocks[out] = std::move(m_blocks[i]);
+            ++out;
+        }
+    }
+    m_blocks.resize(out);
+
+    out = 0;
+    for(size_t i = 0; i < m_blocks.size(); ++i) {
+        std::vector<int32_t>& parts = m_blocks[i].partitions;
+        if(!sortedUnique(parts)) {
+            std::sort(parts.begin(), parts.end());
+            parts.erase(std::unique(parts.begin(), parts.end()), parts.end());
+        }
+        if(parts.empty())
+            continue;
+        if(out != i)
+            m_blocks[out] = std::move(m_blocks[i]);
+        ++out;
+    }
+    m_blocks.resize(out);
+}
+
+void PartitionSet::marshal(Pack &pk) const
+{
+    FieldCodec<std::vector<TopicPartitionsBlock> >::encode(pk, m_blocks, 0);
+}
+
+void PartitionSet::unmarshal(const Unpack &up)
+{
+    FieldCodec<std::vector<TopicPartitionsBlock> >::decode(up, m_blocks, 0);
+    normalize();
+}
+
+void PartitionSet::marshal16(Pack &pk) const
+{
+    pk.push_int16(m_blocks.size());
+    for(auto& block : m_blocks) {
+        pk << block.topic;
+        pk.push_int16(block.partitions.size());
+        pk.push_int32_array(block.partitions.data(), block.partitions.size());
+    }
+}
+
+void PartitionSet::unmarshal16(const Unpack &up)
+{
+    int16_t cnt = up.pop_int16();
+    if(cnt < 0)
+        cnt = 0;
+    m_blocks.resize(cnt);
+    for(auto& block : m_blocks) {
+        up.pop_string(block.topic);
+        int16_t parn = up.pop_int16();
+        block.partitions.resize(parn > 0 ? parn : 0);
+        up.pop_int32_array(block.partitions.data(), block.partitions.size());
+    }
+    normalize();
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "Packet.h"
+#include "Schema.h"
+
+namespace kafkaprotocpp {
+
+struct TopicPartitionsBlock : public Marshallable
+{
+    std::string topic;
+    std::vector<int32_t> partitions;
+
+    typedef Schema<
+        KAFKA_FIELD(TopicPartitionsBlock, topic),
+        KAFKA_FIELD(TopicPartitionsBlock, partitions)> schema;
+
+    void marshal(Pack &pk) const {
+        schema::encode(pk, *this);
+    }
+
+    void unmarshal(const Unpack &up) {
+        schema::decode(up, *this);
+    }
+};
+
+// Set of topic partitions stored flat: blocks sorted by topic name, each with
+// a sorted array of partition ids and no duplicates. Lookups are binary
+// searches, and union/difference/intersection are linear merges over
+// contiguous arrays, with no node allocation or pointer chasing.
+//
+// marshal/unmarshal use the wire format of MemberAssignment (int32 counts),
+// marshal16/unmarshal16 that of MemberSubToppars (int16 counts). Decoding
+// reuses the existing blocks and only sorts when the input wasn't sorted.
+class PartitionSet : public Marshallable
+{
+public:
+    typedef std::vector<TopicPartitionsBlock>::const_iterator const_iterator;
+
+    PartitionSet() {}
+    // blocks in any order, duplicates allowed
+    explicit PartitionSet(const std::vector<TopicPartitionsBlock>& blocks) { assign(blocks); }
+
+    const_iterator begin() const { return m_blocks.begin(); }
+    const_iterator end() const { return m_blocks.end(); }
+    const TopicPartitionsBlock& operator[](size_t i) const { return m_blocks[i]; }
+    const std::vector<TopicPartitionsBlock>& blocks() const { return m_blocks; }
+
+    bool empty() const { return m_blocks.empty(); }
+    size_t topics() const { return m_blocks.size(); }
+    size_t size() const; // partitions in all topics
+
+    void clear() { m_blocks.clear(); }
+    void swap(PartitionSet& o) { m_blocks.swap(o.m_blocks); }
+
+    void assign(const std::vector<TopicPartitionsBlock>& blocks);
+    void assign(std::vector<TopicPartitionsBlock>&& blocks);
+
+    const TopicPartitionsBlock* find(const std::string& topic) const;
+    bool contains(const std::string& topic, int32_t parn) const;
+
+    // false if already present
+    bool insert(const std::string& topic, int32_t parn);
+    bool erase(const std::string& topic, int32_t parn);
+
+    // Block of topic for builders, O(1) when topics come in name order.
+    // Partitions pushed to it must be increasing; the block is only valid
+    // until the next change of the set.
+    TopicPartitionsBlock& append(const std::string& topic);
+
+    void unite(const PartitionSet& o);     // this |= o
+    void subtract(const PartitionSet& o);  // this -= o
+
+    // out must not be a or b; its blocks are reused
+    static void setUnion(const PartitionSet& a, const PartitionSet& b, PartitionSet& out);
+    static void setDifference(const PartitionSet& a, const PartitionSet& b, PartitionSet& out);
+    static void setIntersection(const PartitionSet& a, const PartitionSet& b, PartitionSet& out);
+
+    bool operator == (const PartitionSet& o) const;
+    bool operator != (const PartitionSet& o) const { return !(*this == o); }
+
+    void marshal(Pack &pk) const;
+    void unmarshal(const Unpack &up);
+    void marshal16(Pack &pk) const;
+    void unmarshal16(const Unpack &up);
+
+private:
+    std::vector<TopicPartitionsBlock>::iterator lower(const std::string& topic);
+    std::vector<TopicPartitionsBlock>::const_iterator lower(const std::string& topic) const;
+
+    // restore the invariants after decoding or assign()
+    void normalize();
+    bool normalized() const;
+
+    std::vector<TopicPartitionsBlock> m_blocks;
+};
+
+}
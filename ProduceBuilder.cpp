@@ -0,0 +1,164 @@
+#include "ProduceBuilder.h"
+#include "Trace.h"
+
+using namespace kafkaprotocpp;
+
+ProduceBuilder::ProduceBuilder(int32_t ctxid, const std::string& clientid, int16_t ack, int32_t timeout,
+        int16_t apiver) :
+    m_ctxid(ctxid), m_clientid(clientid), m_ack(ack), m_timeout(timeout),
+    m_apiver(apiver), m_magic(apiver >= ApiConstants::API_VERSION3 ? 2 : apiver >= ApiConstants::API_VERSION2 ? 1 : 0),
+    m_pb(), m_pk(m_pb), m_batch(m_pk), m_producerId(-1), m_producerEpoch(-1)
+{
+    reset();
+}
+
+void ProduceBuilder::reset()
+{
+    m_pb.resize(0);
+    m_batch.discard();
+
+    KAFKA_TRACE(m_ctxid, ProduceRequest::apikey, TRACE_MARSHAL_BEGIN);
+
+    m_pk.push_int32(0); // reserved length field
+    m_pk.push_int16(ProduceRequest::apikey);
+    m_pk.push_int16(m_apiver);
+    m_pk.push_int32(m_ctxid);
+    m_pk.push_string(m_clientid);
+
+    if(m_apiver >= ApiConstants::API_VERSION3)
+        m_pk.push_int16(-1); // no transactionalId
+    m_pk.push_int16(m_ack);
+    m_pk.push_int32(m_timeout);
+    m_topicCountPos = m_pk.size();
+    m_pk.push_int32(0);
+
+    m_topicCount = 0;
+    m_parCountPos = 0;
+    m_parCount = 0;
+    m_setSizePos = 0;
+    m_messages = 0;
+    m_finished = false;
+}
+
+void ProduceBuilder::beginTopic(const TopicName& topic)
+{
+    if(m_finished)
+        throw PackError("ProduceBuilder: request already finished");
+    endTopic();
+
+    m_pk.push_string(topic.data(), topic.size());
+    m_parCountPos = m_pk.size();
+    m_pk.push_int32(0);
+    m_parCount = 0;
+    ++m_topicCount;
+}
+
+void ProduceBuilder::setProducer(int64_t producerId, int16_t producerEpoch)
+{
+    m_producerId = producerId;
+    m_producerEpoch = producerEpoch;
+}
+
+void ProduceBuilder::beginPartition(int32_t parn, int32_t baseSequence)
+{
+    if(m_parCountPos == 0)
+        throw PackError("ProduceBuilder: beginPartition without a topic");
+    endPartition();
+
+    m_pk.push_int32(parn);
+    m_setSizePos = m_pk.size();
+    m_pk.push_int32(0);
+    ++m_parCount;
+    if(m_magic == 2)
+        m_batch.begin(m_producerId, m_producerEpoch, baseSequence);
+}
+
+void ProduceBuilder::append(int64_t timestamp, const char* key, int32_t keyLen, const char* value, int32_t valueLen,
+        int8_t attr)
+{
+    if(m_setSizePos == 0)
+        throw PackError("ProduceBuilder: append without a partition");
+    if(m_magic == 2) {
+        m_batch.append(timestamp, key, keyLen, value, valueLen);
+        ++m_messages;
+        return;
+    }
+
+    // offset, size, crc, magic, attr, [timestamp], key length
+    size_t headLen = 8 + 4 + 4 + 1 + 1 + (m_magic == 1 ? 8 : 0) + 4;
+    // a length of -1 encodes a null key/value
+    size_t msgLen = headLen + (keyLen > 0 ? keyLen : 0) + 4 + (valueLen > 0 ? valueLen : 0);
+
+    size_t start = m_pk.size();
+    char* p = m_pb.extend(headLen);
+    store_be64(p, 0);
+    store_be32(p + 8, msgLen - 12);
+    p[16] = m_magic;
+    p[17] = attr;
+    p += 18;
+    if(m_magic == 1) {
+        store_be64(p, timestamp);
+        p += 8;
+    }
+    store_be32(p, keyLen);
+    if(keyLen > 0)
+        m_pk.push(key, keyLen);
+    m_pk.push_int32(valueLen);
+    if(valueLen > 0)
+        m_pk.push(value, valueLen);
+
+    // the buffer may have moved while growing
+    char* msg = m_pb.data() + start;
+    uint32_t crc = crc32(crc32(0L, Z_NULL, 0), (unsigned char*)msg + 16, msgLen - 16);
+    store_be32(msg + 12, crc);
+    ++m_messages;
+}
+
+void ProduceBuilder::endPartition()
+{
+    if(m_setSizePos == 0)
+        return;
+    if(m_batch.open())
+        m_batch.end();
+    m_pk.replace_int32(m_setSizePos, m_pk.size() - m_setSizePos - 4);
+    m_setSizePos = 0;
+}
+
+void ProduceBuilder::endTopic()
+{
+    if(m_parCountPos == 0)
+        return;
+    endPartition();
+    m_pk.replace_int32(m_parCountPos, m_parCount);
+    m_parCountPos = 0;
+}
+
+void ProduceBuilder::finish()
+{
+    if(m_finished)
+        return;
+    endTopic();
+    m_pk.replace_int32(m_topicCountPos, m_topicCount);
+    m_pk.replace_int32(0, m_pk.size() - 4);
+    m_finished = true;
+
+    KAFKA_TRACE(m_ctxid, ProduceRequest::apikey, TRACE_MARSHAL_END);
+}
+
+void ProduceBuilder::setCtxid(int32_t ctxid)
+{
+    m_ctxid = ctxid;
+    m_pk.replace_int32(8, m_ctxid);
+}
+
+const char* ProduceBuilder::data()
+{
+    finish();
+    return m_pk.data();
+}
+
+size_t ProduceBuilder::size()
+{
+    finish();
+    return m_pk.size();
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "RecordBatch.h"
+
+namespace kafkaprotocpp {
+
+// Builds a complete ProduceRequest frame (length, header and body) by
+// appending messages straight into the wire buffer:
+//
+//     ProduceBuilder b(1, "producer", 1, 1000);
+//     b.beginTopic("t");
+//     b.beginPartition(0);
+//     b.append(ts, key, keyLen, value, valueLen);
+//     ...
+//     conn.SendFrame(ProduceRequest::apikey, b.data(), b.size(), res);
+//
+// Key and value are copied once, into the frame. Message sizes and CRCs are
+// filled in as each message is appended; set sizes and topic/partition counts
+// are patched when the enclosing partition/topic/request is closed. Starting
+// a new partition or topic closes the previous one, data() closes everything.
+// The output is byte-for-byte what Request(ProduceRequest) produces.
+//
+// With apiver 3 each partition gets one RecordBatch (magic 2) instead of a
+// message set; setProducer() and the baseSequence of beginPartition() make
+// the batches idempotent.
+class ProduceBuilder
+{
+public:
+    ProduceBuilder(int32_t ctxid, const std::string& clientid, int16_t ack, int32_t timeout,
+            int16_t apiver = ProduceRequest::apiver);
+
+    // start over with the same header, keeping the buffer's capacity
+    void reset();
+
+    void beginTopic(const TopicName& topic);
+    // baseSequence only for apiver 3 with a producer id
+    void beginPartition(int32_t parn, int32_t baseSequence = -1);
+
+    // producer id and epoch of the following batches (apiver 3), -1 for none
+    void setProducer(int64_t producerId, int16_t producerEpoch);
+
+    // magic 2 for produce v3 (attr unused, batches aren't compressed),
+    // magic 1 (with timestamp) for produce v2, magic 0 before
+    void append(int64_t timestamp, const char* key, int32_t keyLen, const char* value, int32_t valueLen,
+            int8_t attr = 0);
+    void append(int64_t timestamp, const std::string& key, const std::string& value, int8_t attr = 0)
+    {
+        append(timestamp, key.data(), key.size(), value.data(), value.size(), attr);
+    }
+
+    void setCtxid(int32_t ctxid);
+
+    size_t messages() const { return m_messages; }
+
+    // the finished frame
+    const char* data();
+    size_t size();
+
+private:
+    ProduceBuilder(const ProduceBuilder&);
+    ProduceBuilder& operator = (const ProduceBuilder&);
+
+    void endPartition();
+    void endTopic();
+    void finish();
+
+    int32_t m_ctxid;
+    std::string m_clientid;
+    int16_t m_ack;
+    int32_t m_timeout;
+    int16_t m_apiver;
+    int8_t m_magic;
+
+    PackBuffer m_pb;
+    Pack m_pk;
+    RecordBatchWriter m_batch; // apiver 3
+    int64_t m_producerId;
+    int16_t m_producerEpoch;
+
+    size_t m_topicCountPos;  // of the request's topic array count
+    int32_t m_topicCount;
+    size_t m_parCountPos;    // of the current topic's partition count, 0 if no topic is open
+    int32_t m_parCount;
+    size_t m_setSizePos;     // of the current message set size, 0 if no partition is open
+    size_t m_messages;
+    bool m_finished;
+};
+
+}
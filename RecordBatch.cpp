@@ -0,0 +1,176 @@
+#include "RecordBatch.h"
+#include "Compression.h"
+
+#include <stdlib.h>
+
+using namespace kafkaprotocpp;
+
+enum { COMPRESSION_GZIP = 1 };
+
+LazyRecordSet::iterator::iterator(const char* pos, const char* end) :
+    m_pos(pos), m_end(end), m_rec(NULL), m_recEnd(NULL), m_left(0), m_skipped(0)
+{
+    next();
+}
+
+void LazyRecordSet::iterator::next()
+{
+    for(;;) {
+        if(m_left > 0) {
+            --m_left;
+            if(m_view.decode(m_rec, m_recEnd, m_batch))
+                return;
+            m_left = 0; // a bad record ends its batch
+        }
+        m_rec = m_recEnd = NULL;
+        if(m_pos == NULL || !nextBatch()) {
+            m_pos = NULL;
+            m_rec = NULL;
+            return;
+        }
+        if(m_rec == NULL) // a magic 0/1 message, already in m_view
+            return;
+    }
+}
+
+// Move to the next entry at m_pos: a batch with records to read from m_rec, or
+// a legacy message into m_view (m_rec stays NULL). False at the end.
+bool LazyRecordSet::iterator::nextBatch()
+{
+    for(;;) {
+        int magic = RecordBatchView::magicAt(m_pos, m_end);
+        if(magic < 0)
+            return false;
+
+        if(magic < 2) {
+            MessageView m;
+            if(!m.decode(m_pos, m_end))
+                return false;
+            m_batch.baseOffset = m.offset;
+            m_batch.magic = m.magicByte;
+            m_view.assign(m);
+            return true;
+        }
+
+        if(!m_batch.decode(m_pos, m_end))
+            return false;
+        if(m_batch.control() || m_batch.recordCount <= 0)
+            continue;
+
+        if(m_batch.comptype() == 0) {
+            m_rec = m_batch.records;
+            m_recEnd = m_batch.records + m_batch.recordsLen;
+        } else if(m_batch.comptype() == COMPRESSION_GZIP) {
+            uint64_t len = 0;
+            char* out = (char*)gz_decompress(m_batch.records, m_batch.recordsLen, &len);
+            if(out == NULL) {
+                ++m_skipped;
+                continue;
+            }
+            if(len == 0) {
+                free(out);
+                continue;
+            }
+            if(!m_inflated || m_inflated.use_count() > 1)
+                m_inflated = std::make_shared<std::vector<char> >();
+            m_inflated->assign(out, out + len);
+            free(out);
+            m_rec = m_inflated->data();
+            m_recEnd = m_rec + m_inflated->size();
+        } else {
+            ++m_skipped;
+            continue;
+        }
+        m_left = m_batch.recordCount;
+        return true;
+    }
+}
+
+void RecordBatchWriter::begin(int64_t producerId, int16_t producerEpoch, int32_t baseSequence, int16_t attributes)
+{
+    if(m_open)
+        throw PackError("RecordBatchWriter: batch already open");
+    m_start = m_pk.size();
+    char h[RecordBatchView::HEADER_SIZE];
+    store_be64(h, 0);          // baseOffset
+    store_be32(h + 8, 0);      // batchLength, at end()
+    store_be32(h + 12, -1);    // partitionLeaderEpoch
+    h[16] = 2;                 // magic
+    store_be32(h + 17, 0);     // crc, at end()
+    store_be16(h + 21, attributes & ~RecordBatchView::ATTR_COMPRESSION);
+    store_be32(h + 23, 0);     // lastOffsetDelta, at end()
+    store_be64(h + 27, 0);     // firstTimestamp, at end()
+    store_be64(h + 35, 0);     // maxTimestamp, at end()
+    store_be64(h + 43, producerId);
+    store_be16(h + 51, producerEpoch);
+    store_be32(h + 53, baseSequence);
+    store_be32(h + 57, 0);     // recordCount, at end()
+    m_pk.push(h, sizeof(h));
+    m_count = 0;
+    m_open = true;
+}
+
+void RecordBatchWriter::append(int64_t timestamp, const char* key, int32_t keyLen, const char* value, int32_t valueLen)
+{
+    if(!m_open)
+        throw PackError("RecordBatchWriter: append without begin");
+    if(m_count == 0)
+        m_firstTs = m_maxTs = timestamp;
+    else if(timestamp > m_maxTs)
+        m_maxTs = timestamp;
+
+    int64_t tsDelta = timestamp - m_firstTs;
+    if(keyLen < 0)
+        keyLen = -1;
+    if(valueLen < 0)
+        valueLen = -1;
+
+    // attributes, deltas, key, value, no headers
+    char head[1 + 10 + 5 + 5];
+    size_t n = 0;
+    head[n++] = 0;
+    n += write_varint(head + n, tsDelta);
+    n += write_varint(head + n, m_count);
+    n += write_varint(head + n, keyLen);
+    char vhead[5];
+    size_t vn = write_varint(vhead, valueLen);
+    size_t len = n + (keyLen > 0 ? keyLen : 0) + vn + (valueLen > 0 ? valueLen : 0) + 1;
+
+    char lenBuf[5];
+    m_pk.push(lenBuf, write_varint(lenBuf, len));
+    m_pk.push(head, n);
+    if(keyLen > 0)
+        m_pk.push(key, keyLen);
+    m_pk.push(vhead, vn);
+    if(valueLen > 0)
+        m_pk.push(value, valueLen);
+    m_pk.push_int8(0); // header count
+    ++m_count;
+}
+
+size_t RecordBatchWriter::end()
+{
+    if(!m_open)
+        throw PackError("RecordBatchWriter: end without begin");
+    char* h = m_pk.data() + m_start;
+    size_t size = m_pk.size() - m_start;
+    store_be32(h + 8, size - 12);
+    store_be32(h + 23, m_count > 0 ? m_count - 1 : 0);
+    store_be64(h + 27, m_firstTs);
+    store_be64(h + 35, m_maxTs);
+    store_be32(h + 57, m_count);
+    store_be32(h + 17, crc32c(0, h + 21, size - 21));
+    m_open = false;
+    return size;
+}
+
+void RecordBatchWriter::setProducer(char* batch, size_t size, int64_t producerId, int16_t producerEpoch,
+        int32_t baseSequence)
+{
+    if(size < RecordBatchView::HEADER_SIZE)
+        throw PackError("RecordBatchWriter: not a record batch");
+    store_be64(batch + 43, producerId);
+    store_be16(batch + 51, producerEpoch);
+    store_be32(batch + 53, baseSequence);
+    store_be32(batch + 17, crc32c(0, batch + 21, size - 21));
+}
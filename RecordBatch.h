@@ -0,0 +1,356 @@
+#pragma once
+
+#include "MessageView.h"
+#include "Varint.h"
+#include "Crc32c.h"
+
+#include <memory>
+
+namespace kafkaprotocpp {
+
+// Header of a RecordBatch (magic 2, Kafka 0.11+), decoded in place. Fetch v4
+// and later return the log as stored, so a record set may hold these batches
+// as well as magic 0/1 message sets.
+struct RecordBatchView
+{
+    enum { HEADER_SIZE = 61 }; // baseOffset through recordCount
+
+    enum
+    {
+        ATTR_COMPRESSION = 0x07,
+        ATTR_LOG_APPEND_TIME = 0x08,
+        ATTR_TRANSACTIONAL = 0x10,
+        ATTR_CONTROL = 0x20,
+    };
+
+    int64_t baseOffset;
+    int32_t batchLength; // from partitionLeaderEpoch to the end
+    int32_t partitionLeaderEpoch;
+    int8_t magic;
+    uint32_t crc;        // crc32c from attributes to the end
+    int16_t attributes;
+    int32_t lastOffsetDelta;
+    int64_t firstTimestamp;
+    int64_t maxTimestamp;
+    int64_t producerId;
+    int16_t producerEpoch;
+    int32_t baseSequence;
+    int32_t recordCount;
+    const char* records; // possibly compressed
+    size_t recordsLen;
+
+    int comptype() const { return attributes & ATTR_COMPRESSION; }
+    bool transactional() const { return attributes & ATTR_TRANSACTIONAL; }
+    bool control() const { return attributes & ATTR_CONTROL; }
+    int64_t lastOffset() const { return baseOffset + lastOffsetDelta; }
+
+    // checks crc against the bytes, only valid on the original buffer
+    bool crcValid() const
+    {
+        const char* from = records - (HEADER_SIZE - 21);
+        return crc32c(0, from, recordsLen + HEADER_SIZE - 21) == crc;
+    }
+
+    // magic byte of the entry at p, the same position for batches and
+    // messages; -1 if there aren't enough bytes
+    static int magicAt(const char* p, const char* end)
+    {
+        return end - p < 17 ? -1 : p[16];
+    }
+
+    // Decode the batch at p. On success p moves past it. Returns false,
+    // leaving p alone, if it is truncated or not a magic 2 batch.
+    bool decode(const char*& p, const char* end)
+    {
+        if(end - p < HEADER_SIZE)
+            return false;
+        int32_t len = load_be32(p + 8);
+        if(len < HEADER_SIZE - 12 || end - p - 12 < len || p[16] != 2)
+            return false;
+
+        baseOffset = load_be64(p);
+        batchLength = len;
+        partitionLeaderEpoch = load_be32(p + 12);
+        magic = p[16];
+        crc = (uint32_t)load_be32(p + 17);
+        attributes = load_be16(p + 21);
+        lastOffsetDelta = load_be32(p + 23);
+        firstTimestamp = load_be64(p + 27);
+        maxTimestamp = load_be64(p + 35);
+        producerId = load_be64(p + 43);
+        producerEpoch = load_be16(p + 51);
+        baseSequence = load_be32(p + 53);
+        recordCount = load_be32(p + 57);
+        records = p + HEADER_SIZE;
+        recordsLen = len + 12 - HEADER_SIZE;
+        p += 12 + len;
+        return true;
+    }
+};
+
+// One record of a batch (or a magic 0/1 message), key, value and headers
+// pointing into the buffer it was decoded from.
+struct RecordView
+{
+    int64_t offset;
+    int64_t timestamp;
+    const char* key;
+    int32_t keyLen;   // -1 for a null key
+    const char* value;
+    int32_t valueLen; // -1 for a null value
+    int32_t headerCount;
+    const char* headers; // headerCount headers, read them with nextHeader()
+    const char* headersEnd;
+
+    std::string keyString() const { return keyLen > 0 ? std::string(key, keyLen) : std::string(); }
+    std::string valueString() const { return valueLen > 0 ? std::string(value, valueLen) : std::string(); }
+
+    // Decode the record at p of batch. On success p moves to the next record.
+    bool decode(const char*& p, const char* end, const RecordBatchView& batch)
+    {
+        const char* q = p;
+        int32_t len;
+        if(!read_varint(q, end, len) || len < 0 || end - q < len)
+            return false;
+        const char* recEnd = q + len;
+        if(recEnd - q < 1)
+            return false;
+        ++q; // attributes, unused
+        int64_t tsDelta;
+        int32_t offDelta;
+        if(!read_varint(q, recEnd, tsDelta) || !read_varint(q, recEnd, offDelta))
+            return false;
+        if(!bytes(q, recEnd, key, keyLen) || !bytes(q, recEnd, value, valueLen))
+            return false;
+        if(!read_varint(q, recEnd, headerCount) || headerCount < 0)
+            return false;
+
+        offset = batch.baseOffset + offDelta;
+        timestamp = (batch.attributes & RecordBatchView::ATTR_LOG_APPEND_TIME) ? batch.maxTimestamp
+            : batch.firstTimestamp + tsDelta;
+        headers = q;
+        headersEnd = recEnd;
+        p = recEnd;
+        return true;
+    }
+
+    // a magic 0/1 message as a record
+    void assign(const MessageView& m)
+    {
+        offset = m.offset;
+        timestamp = m.timestamp;
+        key = m.key;
+        keyLen = m.keyLen;
+        value = m.value;
+        valueLen = m.valueLen;
+        headerCount = 0;
+        headers = headersEnd = NULL;
+    }
+
+    // header at p (starting at headers), false past the last one
+    static bool nextHeader(const char*& p, const char* end, const char*& hkey, int32_t& hkeyLen,
+            const char*& hvalue, int32_t& hvalueLen)
+    {
+        const char* q = p;
+        if(!bytes(q, end, hkey, hkeyLen) || hkeyLen < 0 || !bytes(q, end, hvalue, hvalueLen))
+            return false;
+        p = q;
+        return true;
+    }
+
+private:
+    static bool bytes(const char*& p, const char* end, const char*& data, int32_t& len)
+    {
+        if(!read_varint(p, end, len))
+            return false;
+        data = p;
+        if(len <= 0)
+            return true;
+        if(end - p < len)
+            return false;
+        p += len;
+        return true;
+    }
+};
+
+// Forward-only view over the raw bytes of a fetched record set, magic 2
+// batches and magic 0/1 messages alike:
+//
+//     for(const RecordView& r : LazyRecordSet(buf, size)) ...
+//
+// Like LazyMessageSet nothing is decoded before the iterator reaches it, and
+// a truncated trailing batch ends the iteration. Control batches (transaction
+// markers) are skipped. Gzip batches are inflated into a buffer shared by the
+// iterator's copies; batches with other codecs are skipped, check
+// iterator::skipped() to tell. The bytes must outlive the set and iterators.
+class LazyRecordSet : public Marshallable
+{
+public:
+    class iterator
+    {
+    public:
+        iterator() : m_pos(NULL), m_end(NULL), m_rec(NULL), m_recEnd(NULL), m_left(0), m_skipped(0) {}
+        iterator(const char* pos, const char* end);
+
+        const RecordView& operator*() const { return m_view; }
+        const RecordView* operator->() const { return &m_view; }
+        // the batch of the current record, magic 0/1 messages only fill in
+        // baseOffset and magic
+        const RecordBatchView& batch() const { return m_batch; }
+        // batches passed over for an unsupported codec so far
+        size_t skipped() const { return m_skipped; }
+
+        iterator& operator++()
+        {
+            next();
+            return *this;
+        }
+
+        bool operator == (const iterator& o) const { return m_pos == o.m_pos && m_rec == o.m_rec; }
+        bool operator != (const iterator& o) const { return !(*this == o); }
+
+    private:
+        void next();
+        bool nextBatch();
+
+        const char* m_pos; // next batch or message, NULL at end
+        const char* m_end;
+        const char* m_rec; // next record of the current batch
+        const char* m_recEnd;
+        int32_t m_left;    // records left in the current batch
+        size_t m_skipped;
+        RecordBatchView m_batch;
+        RecordView m_view;
+        std::shared_ptr<std::vector<char> > m_inflated;
+    };
+
+    int32_t size; // filled in by the enclosing unit, like MessageSet::size
+
+    LazyRecordSet() : size(0), m_data(NULL) {}
+    LazyRecordSet(const char* data, size_t len) : size(len), m_data(data) {}
+
+    iterator begin() const { return iterator(m_data, m_data + size); }
+    iterator end() const { return iterator(); }
+
+    const char* data() const { return m_data; }
+
+    virtual void unmarshal(const Unpack &up)
+    {
+        m_data = up.pop_fetch_ptr(size);
+    }
+
+    DecodeStatus decode(const Unpack &up)
+    {
+        if(size < 0)
+            return DECODE_MALFORMED;
+        if(!up.has(size))
+            return DECODE_INCOMPLETE;
+        m_data = up.take_ptr(size);
+        return DECODE_OK;
+    }
+
+private:
+    const char* m_data;
+};
+
+// Encodes one uncompressed RecordBatch (magic 2) at the end of pk:
+//
+//     RecordBatchWriter w(pk);
+//     w.begin(producerId, producerEpoch, baseSequence);
+//     w.append(ts, key, keyLen, value, valueLen);
+//     ...
+//     w.end();
+//
+// Records go straight into the buffer; end() patches the header fields that
+// depend on them and the CRC. Offsets are relative, the broker assigns the
+// base offset.
+class RecordBatchWriter
+{
+public:
+    explicit RecordBatchWriter(Pack& pk) : m_pk(pk), m_start(0), m_count(0), m_firstTs(0), m_maxTs(0), m_open(false) {}
+
+    // producerId -1 for a non-idempotent batch
+    void begin(int64_t producerId = -1, int16_t producerEpoch = -1, int32_t baseSequence = -1,
+            int16_t attributes = 0);
+    void append(int64_t timestamp, const char* key, int32_t keyLen, const char* value, int32_t valueLen);
+    // size of the finished batch
+    size_t end();
+    // forget an open batch, e.g. after the buffer was reset
+    void discard() { m_open = false; }
+
+    bool open() const { return m_open; }
+    int32_t records() const { return m_count; }
+    // of the batch so far
+    size_t size() const { return m_open ? m_pk.size() - m_start : 0; }
+
+    // Set the producer fields of an encoded batch and redo its CRC, for
+    // batches resent with a new producer id or sequence.
+    static void setProducer(char* batch, size_t size, int64_t producerId, int16_t producerEpoch, int32_t baseSequence);
+
+private:
+    RecordBatchWriter(const RecordBatchWriter&);
+    RecordBatchWriter& operator = (const RecordBatchWriter&);
+
+    Pack& m_pk;
+    size_t m_start; // of the batch in m_pk
+    int32_t m_count;
+    int64_t m_firstTs;
+    int64_t m_maxTs;
+    bool m_open;
+};
+
+// Produce v3 (Kafka 0.11+), record sets must be RecordBatch v2. The response
+// has the v2 layout, see ProduceResponseV3.
+struct ProducePartitionRecordsUnit : public Marshallable
+{
+    int32_t parn;
+    LazyRecordSet records; // a view, the bytes must live until encoded
+
+    void marshal(Pack &pk) const
+    {
+        pk.push_int32(parn);
+        pk.push_bytes(records.data(), records.size);
+    }
+};
+
+struct ProduceTopicRecordsUnit : public Marshallable
+{
+    TopicName topic;
+    std::vector<ProducePartitionRecordsUnit> parRecords;
+
+    typedef Schema<
+        KAFKA_FIELD(ProduceTopicRecordsUnit, topic),
+        KAFKA_FIELD(ProduceTopicRecordsUnit, parRecords)> schema;
+
+    void marshal(Pack &pk) const
+    {
+        schema::encode(pk, *this);
+    }
+};
+
+struct ProduceRequestV3 : public Marshallable
+{
+    enum { apikey = ApiConstants::PRODUCE_REQUEST_KEY, apiver = ApiConstants::API_VERSION3};
+
+    std::string transactionalId; // empty for none (null on the wire)
+    int16_t ack;
+    int32_t timeout;
+    std::vector<ProduceTopicRecordsUnit> topicRecords;
+
+    void marshal(Pack &pk) const
+    {
+        if(transactionalId.empty())
+            pk.push_int16(-1);
+        else
+            pk.push_string(transactionalId);
+        pk.push_int16(ack);
+        pk.push_int32(timeout);
+        FieldCodec<std::vector<ProduceTopicRecordsUnit> >::encode(pk, topicRecords, apiver);
+    }
+};
+
+typedef FetchPartitionResponseUnitV7T<LazyRecordSet> FetchPartitionRecordsUnit;
+typedef FetchTopicResponseUnitV7T<LazyRecordSet> FetchTopicRecordsUnit;
+typedef FetchResponseV7T<LazyRecordSet> FetchResponseV7;
+
+}
@@ -1,4 +1,6 @@
 #include "Request.h"
+#include "Trace.h"
+#include "ApiConstants.h"
 
 using namespace std;
 using namespace kafkaprotocpp;
@@ -8,16 +10,22 @@ Request::Request(int32_t ctxid, const std::string& clientid, int16_t apikey, int
     pb(),
     pk(pb)
 {
+    KAFKA_TRACE(ctxid, apikey, TRACE_MARSHAL_BEGIN);
+
     pk.push_int32(0); // reserved length field
     pk.push_int16(apikey);
     pk.push_int16(apiver);
     pk.push_int32(ctxid);
-    pk.push_string(clientid);
+    pk.push_string(clientid); // not compact, even in header v2
+    if(ApiConstants::requestHeaderVersion(apikey, apiver) >= 2)
+        pk.push_tagged_fields();
 
-    m.marshal(pk);
+    m.marshal(pk, apiver);
 
     // update length
     pk.replace_int32(0, pk.size()-4);
+
+    KAFKA_TRACE(ctxid, apikey, TRACE_MARSHAL_END);
 }
 
 void Request::setCtxid(int32_t ctxid)
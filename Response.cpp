@@ -1,4 +1,5 @@
 #include "Response.h"
+#include "ApiConstants.h"
 
 using namespace kafkaprotocpp;
 
@@ -13,8 +14,14 @@ void Response::head()
     m_ctxid = up.pop_int32();
 }
 
+void Response::head(int apikey, int apiver)
+{
+    head();
+    if(ApiConstants::responseHeaderVersion(apikey, apiver) >= 1)
+        up.skip_tagged_fields();
+}
+
 int32_t Response::peeklen(const char* data)
 {
-    int32_t i = *((int32_t*)data);
-    return htonl(i) + 4;
+    return load_be32(data) + 4;
 }
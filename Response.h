@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Packet.h"
+#include <stdlib.h>
 
 namespace kafkaprotocpp {
 
@@ -21,8 +22,36 @@ public:
 public:
     Response(const char* buffer, size_t size);
     void head();
+    // also skips the tagged fields of a response header v1
+    void head(int apikey, int apiver);
 
     static int32_t peeklen(const char* data);
 };
 
+// Owns one response frame (malloc'ed) so that zero-copy decode targets such
+// as LazyMessageSet can keep pointing into it after the call returns.
+class ResponseBuffer
+{
+public:
+    ResponseBuffer() : m_data(NULL), m_size(0) {}
+    ~ResponseBuffer() { free(m_data); }
+
+    void reset(char* data = NULL, size_t size = 0)
+    {
+        free(m_data);
+        m_data = data;
+        m_size = size;
+    }
+
+    const char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    ResponseBuffer(const ResponseBuffer&);
+    ResponseBuffer& operator = (const ResponseBuffer&);
+
+    char* m_data;
+    size_t m_size;
+};
+
 }
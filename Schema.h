@@ -0,0 +1,306 @@
+#pragma once
+
+#include "Packet.h"
+#include "ApiConstants.h"
+
+#include <type_traits>
+
+namespace kafkaprotocpp {
+
+// Declarative wire layout for protocol structs.
+//
+// A struct lists its fields in wire order, each with the API versions it is
+// present in:
+//
+//     struct PartitionOffsets : public Marshallable {
+//         int32_t parn;
+//         int64_t offset;
+//         typedef Schema<
+//             KAFKA_FIELD(PartitionOffsets, parn),
+//             KAFKA_FIELD_V(PartitionOffsets, offset, 1, KAFKA_MAX_VER)> schema;
+//     };
+//
+// and schema::encode/decode/size generate the code. Members are reached
+// through member pointers known at compile time and nested structs through
+// their own schema (or a qualified, non-virtual call to a hand-written
+// marshal/unmarshal), so everything inlines and nothing goes through the
+// Marshallable vtable. With a constant version the presence checks fold away,
+// which lets one struct cover several versions.
+
+enum { KAFKA_MAX_VER = 0x7fff };
+
+// A flexible version (see ApiConstants::firstFlexibleVersion) is passed down
+// with KAFKA_FLEXIBLE set: strings, bytes and arrays go compact and every
+// schema struct ends with tagged fields. A struct's marshal/unmarshal sets it
+// with flexible_ver(), nested structs see it through ver.
+enum { KAFKA_FLEXIBLE = 0x10000 };
+
+inline int flexible_ver(int apikey, int ver)
+{
+    return ApiConstants::isFlexible(apikey, ver) ? ver | KAFKA_FLEXIBLE : ver;
+}
+
+inline bool is_flexible(int ver) { return (ver & KAFKA_FLEXIBLE) != 0; }
+
+template <class T>
+struct has_schema
+{
+    template <class U> static char test(typename U::schema*);
+    template <class U> static long test(...);
+    enum { value = sizeof(test<T>(0)) == 1 };
+};
+
+// how one member type goes on the wire. The primary template covers structs
+// that still hand-write marshal()/unmarshal().
+template <class M, class Enable = void>
+struct FieldCodec
+{
+    static void encode(Pack &pk, const M &m, int) { m.M::marshal(pk); }
+    static void decode(const Unpack &up, M &m, int) { m.M::unmarshal(up); }
+    static size_t size(const M &m, int)
+    {
+        PackBuffer pb;
+        Pack pk(pb);
+        m.M::marshal(pk);
+        return pk.size();
+    }
+};
+
+template <class M>
+struct FieldCodec<M, typename std::enable_if<has_schema<M>::value>::type>
+{
+    static void encode(Pack &pk, const M &m, int ver) { M::schema::encode(pk, m, ver); }
+    static void decode(const Unpack &up, M &m, int ver) { M::schema::decode(up, m, ver); }
+    static size_t size(const M &m, int ver) { return M::schema::size(m, ver); }
+};
+
+template <>
+struct FieldCodec<int8_t>
+{
+    static void encode(Pack &pk, int8_t v, int) { pk.push_int8(v); }
+    static void decode(const Unpack &up, int8_t &v, int) { v = up.pop_int8(); }
+    static size_t size(int8_t, int) { return 1; }
+};
+
+template <>
+struct FieldCodec<int16_t>
+{
+    static void encode(Pack &pk, int16_t v, int) { pk.push_int16(v); }
+    static void decode(const Unpack &up, int16_t &v, int) { v = up.pop_int16(); }
+    static size_t size(int16_t, int) { return 2; }
+};
+
+template <>
+struct FieldCodec<int32_t>
+{
+    static void encode(Pack &pk, int32_t v, int) { pk.push_int32(v); }
+    static void decode(const Unpack &up, int32_t &v, int) { v = up.pop_int32(); }
+    static size_t size(int32_t, int) { return 4; }
+};
+
+template <>
+struct FieldCodec<int64_t>
+{
+    static void encode(Pack &pk, int64_t v, int) { pk.push_int64(v); }
+    static void decode(const Unpack &up, int64_t &v, int) { v = up.pop_int64(); }
+    static size_t size(int64_t, int) { return 8; }
+};
+
+// any allocator, so arena strings decode the same way
+template <class A>
+struct FieldCodec<std::basic_string<char, std::char_traits<char>, A> >
+{
+    typedef std::basic_string<char, std::char_traits<char>, A> String;
+
+    static void encode(Pack &pk, const String &s, int ver)
+    {
+        if(is_flexible(ver))
+            pk.push_compact_string(s.data(), s.size());
+        else
+            pk.push_string(s.data(), s.size());
+    }
+    static void decode(const Unpack &up, String &s, int ver)
+    {
+        // assign keeps the string's capacity when decoding into it again
+        int32_t len = is_flexible(ver) ? up.pop_compact_len() : up.pop_int16();
+        if(len <= 0)
+            s.clear();
+        else
+            s.assign(up.pop_fetch_ptr(len), len);
+    }
+    static size_t size(const String &s, int ver)
+    {
+        return (is_flexible(ver) ? uvarint_size(s.size() + 1) : 2) + s.size();
+    }
+};
+
+template <>
+struct FieldCodec<TopicName>
+{
+    static void encode(Pack &pk, const TopicName &t, int ver)
+    {
+        if(is_flexible(ver))
+            pk.push_compact_string(t.data(), t.size());
+        else
+            pk.push_string(t.data(), t.size());
+    }
+    static void decode(const Unpack &up, TopicName &t, int ver)
+    {
+        t = is_flexible(ver) ? up.pop_compact_topic() : up.pop_topic();
+    }
+    static size_t size(const TopicName &t, int ver)
+    {
+        return (is_flexible(ver) ? uvarint_size(t.size() + 1) : 2) + t.size();
+    }
+};
+
+// element count of an array, compact in flexible versions
+inline void push_array_len(Pack &pk, size_t n, int ver)
+{
+    if(is_flexible(ver))
+        pk.push_compact_array_len(n);
+    else
+        pk.push_int32(n);
+}
+
+inline int32_t pop_array_len(const Unpack &up, int ver)
+{
+    return is_flexible(ver) ? up.pop_compact_len() : up.pop_int32();
+}
+
+inline size_t array_len_size(size_t n, int ver)
+{
+    return is_flexible(ver) ? uvarint_size(n + 1) : 4;
+}
+
+template <class T, class A>
+struct FieldCodec<std::vector<T, A> >
+{
+    static void encode(Pack &pk, const std::vector<T, A> &v, int ver)
+    {
+        push_array_len(pk, v.size(), ver);
+        for(auto& e : v)
+            FieldCodec<T>::encode(pk, e, ver);
+    }
+    // overwrites in place like unmarshal_vector, so reused objects keep capacity
+    static void decode(const Unpack &up, std::vector<T, A> &v, int ver)
+    {
+        int32_t count = pop_array_len(up, ver);
+        if(count <= 0) {
+            v.clear();
+            return;
+        }
+        // every element takes at least one byte, so a bogus count can't resize much
+        if(up.size() < (size_t)count)
+            throw UnpackError("FieldCodec: not enough data");
+        v.resize(count);
+        for(auto& e : v)
+            FieldCodec<T>::decode(up, e, ver);
+    }
+    static size_t size(const std::vector<T, A> &v, int ver)
+    {
+        size_t n = array_len_size(v.size(), ver);
+        for(auto& e : v)
+            n += FieldCodec<T>::size(e, ver);
+        return n;
+    }
+};
+
+// integral arrays are byte-swapped in bulk, whatever the allocator
+template <class T, class A>
+struct IntVectorCodec
+{
+    static void encode(Pack &pk, const std::vector<T, A> &v, int ver)
+    {
+        push_array_len(pk, v.size(), ver);
+        push(pk, v.data(), v.size());
+    }
+    static void decode(const Unpack &up, std::vector<T, A> &v, int ver)
+    {
+        int32_t count = pop_array_len(up, ver);
+        if(count <= 0) {
+            v.clear();
+            return;
+        }
+        if(up.size() / sizeof(T) < (size_t)count)
+            throw UnpackError("IntVectorCodec: not enough data");
+        v.resize(count);
+        pop(up, v.data(), count);
+    }
+    static size_t size(const std::vector<T, A> &v, int ver) { return array_len_size(v.size(), ver) + v.size() * sizeof(T); }
+
+private:
+    static void push(Pack &pk, const int16_t *a, size_t n) { pk.push_int16_array(a, n); }
+    static void push(Pack &pk, const int32_t *a, size_t n) { pk.push_int32_array(a, n); }
+    static void push(Pack &pk, const int64_t *a, size_t n) { pk.push_int64_array(a, n); }
+    static void pop(const Unpack &up, int16_t *a, size_t n) { up.pop_int16_array(a, n); }
+    static void pop(const Unpack &up, int32_t *a, size_t n) { up.pop_int32_array(a, n); }
+    static void pop(const Unpack &up, int64_t *a, size_t n) { up.pop_int64_array(a, n); }
+};
+
+template <class A> struct FieldCodec<std::vector<int16_t, A> > : public IntVectorCodec<int16_t, A> {};
+template <class A> struct FieldCodec<std::vector<int32_t, A> > : public IntVectorCodec<int32_t, A> {};
+template <class A> struct FieldCodec<std::vector<int64_t, A> > : public IntVectorCodec<int64_t, A> {};
+
+// member Ptr of T, present in API versions [MinVer, MaxVer]
+template <class T, class M, M T::*Ptr, int MinVer = 0, int MaxVer = KAFKA_MAX_VER>
+struct Field
+{
+    static bool present(int ver)
+    {
+        ver &= KAFKA_MAX_VER;
+        return ver >= MinVer && ver <= MaxVer;
+    }
+
+    static void encode(Pack &pk, const T &obj, int ver)
+    {
+        if(present(ver))
+            FieldCodec<M>::encode(pk, obj.*Ptr, ver);
+    }
+    static void decode(const Unpack &up, T &obj, int ver)
+    {
+        if(present(ver))
+            FieldCodec<M>::decode(up, obj.*Ptr, ver);
+    }
+    static size_t size(const T &obj, int ver)
+    {
+        return present(ver) ? FieldCodec<M>::size(obj.*Ptr, ver) : 0;
+    }
+};
+
+#define KAFKA_FIELD(T, m) ::kafkaprotocpp::Field<T, decltype(T::m), &T::m>
+#define KAFKA_FIELD_V(T, m, minver, maxver) ::kafkaprotocpp::Field<T, decltype(T::m), &T::m, minver, maxver>
+
+template <class... Fields>
+struct Schema
+{
+    template <class T>
+    static void encode(Pack &pk, const T &obj, int ver = 0)
+    {
+        int expand[] = { 0, (Fields::encode(pk, obj, ver), 0)... };
+        (void)expand;
+        if(is_flexible(ver))
+            pk.push_tagged_fields();
+    }
+
+    template <class T>
+    static void decode(const Unpack &up, T &obj, int ver = 0)
+    {
+        int expand[] = { 0, (Fields::decode(up, obj, ver), 0)... };
+        (void)expand;
+        if(is_flexible(ver))
+            up.skip_tagged_fields();
+    }
+
+    // encoded size in bytes, without encoding
+    template <class T>
+    static size_t size(const T &obj, int ver = 0)
+    {
+        size_t n = 0;
+        int expand[] = { 0, (n += Fields::size(obj, ver), 0)... };
+        (void)expand;
+        return is_flexible(ver) ? n + 1 : n;
+    }
+};
+
+}
@@ -0,0 +1,223 @@
+#include "SegmentReader.h"
+
+#include <algorithm>
+#include <climits>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace kafkaprotocpp;
+
+enum
+{
+    INDEX_ENTRY = 8,      // int32 relative offset, int32 position
+    TIME_INDEX_ENTRY = 12, // int64 timestamp, int32 relative offset
+};
+
+int MappedFile::open(const std::string& path)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+        return -1;
+    struct stat st;
+    if(fstat(fd, &st) < 0) {
+        int err = errno;
+        ::close(fd);
+        errno = err;
+        return -1;
+    }
+
+    if(st.st_size > 0) {
+        void* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if(p == MAP_FAILED) {
+            int err = errno;
+            ::close(fd);
+            errno = err;
+            return -1;
+        }
+        m_data = static_cast<const char*>(p);
+        m_size = st.st_size;
+    }
+    ::close(fd); // the mapping keeps the file
+    m_open = true;
+    return 0;
+}
+
+void MappedFile::close()
+{
+    if(m_data)
+        munmap(const_cast<char*>(m_data), m_size);
+    m_data = NULL;
+    m_size = 0;
+    m_open = false;
+}
+
+static std::string stem(const std::string& logPath)
+{
+    const std::string ext(".log");
+    if(logPath.size() >= ext.size() && logPath.compare(logPath.size() - ext.size(), ext.size(), ext) == 0)
+        return logPath.substr(0, logPath.size() - ext.size());
+    return logPath;
+}
+
+// the file name without directory and extension, -1 if it isn't all digits
+static int64_t parseBaseOffset(const std::string& stem)
+{
+    size_t slash = stem.rfind('/');
+    std::string name = slash == std::string::npos ? stem : stem.substr(slash + 1);
+    // 20 digits, zero padded
+    if(name.empty() || name.size() > 20 || name.find_first_not_of("0123456789") != std::string::npos)
+        return -1;
+    errno = 0;
+    int64_t base = strtoll(name.c_str(), NULL, 10);
+    return errno ? -1 : base;
+}
+
+int SegmentReader::open(const std::string& logPath)
+{
+    close();
+    if(m_log.open(logPath) < 0)
+        return -1;
+    if(m_log.size())
+        madvise(const_cast<char*>(m_log.data()), m_log.size(), MADV_SEQUENTIAL);
+
+    // relative offsets in the indexes are useless without the base
+    std::string base = stem(logPath);
+    m_baseOffset = parseBaseOffset(base);
+    if(m_baseOffset < 0)
+        return 0;
+    if(m_index.open(base + ".index") == 0)
+        m_indexEntries = usedEntries(m_index, INDEX_ENTRY);
+    if(m_timeIndex.open(base + ".timeindex") == 0)
+        m_timeIndexEntries = usedEntries(m_timeIndex, TIME_INDEX_ENTRY);
+    return 0;
+}
+
+void SegmentReader::close()
+{
+    m_log.close();
+    m_index.close();
+    m_timeIndex.close();
+    m_baseOffset = -1;
+    m_indexEntries = 0;
+    m_timeIndexEntries = 0;
+}
+
+// The broker preallocates index files and trims them when the segment is
+// rolled, so the active one ends in zeroed entries. Entries only grow, so the
+// first all-zero one after the start is found by bisection.
+size_t SegmentReader::usedEntries(const MappedFile& index, size_t entrySize)
+{
+    size_t n = index.size() / entrySize;
+    const char* p = index.data();
+    auto zero = [&](size_t i) {
+        for(size_t k = 0; k < entrySize; ++k)
+            if(p[i * entrySize + k])
+                return false;
+        return true;
+    };
+    if(n == 0 || zero(0))
+        return 0;
+    size_t lo = 1, hi = n; // entries before lo are used, from hi on zero
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if(zero(mid))
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
+}
+
+// position of the last indexed batch at or before offset, 0 if none
+size_t SegmentReader::indexLookup(int64_t offset) const
+{
+    if(m_indexEntries == 0 || offset <= m_baseOffset)
+        return 0;
+    int64_t rel = offset - m_baseOffset;
+    const char* p = m_index.data();
+    size_t lo = 0, hi = m_indexEntries; // first entry above rel
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if(load_be32(p + mid * INDEX_ENTRY) <= rel)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    // the log may have been copied while the index was ahead of it
+    while(lo > 0) {
+        size_t pos = (uint32_t)load_be32(p + (lo - 1) * INDEX_ENTRY + 4);
+        if(pos < m_log.size())
+            return pos;
+        --lo;
+    }
+    return 0;
+}
+
+// From the batch at pos, the first one whose last offset is at least offset
+// and whose max timestamp is at least ts. Only headers are read.
+size_t SegmentReader::scan(size_t pos, int64_t offset, int64_t ts) const
+{
+    const char* data = m_log.data();
+    const char* end = data + m_log.size();
+    const char* p = data + pos;
+    LogEntryHeader e;
+    // stops at a truncated or garbled entry
+    while(e.decode(p, end)) {
+        if(e.lastOffset >= offset && e.maxTimestamp >= ts)
+            return p - data;
+        p += e.size;
+    }
+    return m_log.size();
+}
+
+size_t SegmentReader::position(int64_t offset) const
+{
+    if(!m_log.size())
+        return 0;
+    return scan(indexLookup(offset), offset, INT64_MIN);
+}
+
+size_t SegmentReader::positionForTime(int64_t ts) const
+{
+    if(!m_log.size())
+        return 0;
+    size_t start = 0;
+    if(m_timeIndexEntries > 0) {
+        // last entry below ts: its offset's batch is before the one wanted
+        const char* p = m_timeIndex.data();
+        size_t lo = 0, hi = m_timeIndexEntries;
+        while(lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if(load_be64(p + mid * TIME_INDEX_ENTRY) < ts)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if(lo > 0)
+            start = indexLookup(m_baseOffset + load_be32(p + (lo - 1) * TIME_INDEX_ENTRY + 8));
+    }
+    return scan(start, INT64_MIN, ts);
+}
+
+LazyRecordSet SegmentReader::records(size_t pos) const
+{
+    if(pos >= m_log.size())
+        return LazyRecordSet(m_log.data() + m_log.size(), 0);
+    // segments are capped at 2GB by the broker
+    size_t len = std::min<size_t>(m_log.size() - pos, INT32_MAX);
+    return LazyRecordSet(m_log.data() + pos, len);
+}
+
+LazyMessageSet SegmentReader::messages(size_t pos) const
+{
+    if(pos >= m_log.size())
+        return LazyMessageSet(m_log.data() + m_log.size(), 0);
+    size_t len = std::min<size_t>(m_log.size() - pos, INT32_MAX);
+    return LazyMessageSet(m_log.data() + pos, len);
+}
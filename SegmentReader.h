@@ -0,0 +1,142 @@
+#pragma once
+
+#include "RecordBatch.h"
+
+#include <string>
+
+namespace kafkaprotocpp {
+
+// Header fields of the entry (magic 2 batch or magic 0/1 message) at the
+// start of a log, enough to index it without reading its records.
+struct LogEntryHeader
+{
+    size_t size;          // of the whole entry
+    int magic;
+    bool compressed;
+    int64_t firstOffset;  // a compressed magic 0/1 wrapper only knows its last
+    int64_t lastOffset;
+    int64_t maxTimestamp; // -1 for magic 0
+
+    // false if the entry at p is truncated or malformed
+    bool decode(const char* p, const char* end)
+    {
+        magic = RecordBatchView::magicAt(p, end);
+        if(magic < 0)
+            return false;
+        int32_t len = load_be32(p + 8);
+        if(len <= 0 || end - p - 12 < len)
+            return false;
+        size = 12 + len;
+        if(magic >= 2) {
+            if(size < RecordBatchView::HEADER_SIZE)
+                return false;
+            compressed = (load_be16(p + 21) & RecordBatchView::ATTR_COMPRESSION) != 0;
+            firstOffset = load_be64(p);
+            lastOffset = firstOffset + load_be32(p + 23);
+            maxTimestamp = load_be64(p + 35);
+        } else {
+            if(size < 12 + 6)
+                return false;
+            compressed = (p[17] & 0x07) != 0;
+            firstOffset = lastOffset = load_be64(p);
+            maxTimestamp = magic == 1 && size >= 26 ? load_be64(p + 18) : -1;
+        }
+        return true;
+    }
+};
+
+// A file mapped read-only. An empty file opens fine and maps nothing.
+class MappedFile
+{
+public:
+    MappedFile() : m_data(NULL), m_size(0), m_open(false) {}
+    ~MappedFile() { close(); }
+
+    // 0 on success, -1 with errno set
+    int open(const std::string& path);
+    void close();
+
+    bool isOpen() const { return m_open; }
+    const char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator = (const MappedFile&);
+
+    const char* m_data;
+    size_t m_size;
+    bool m_open;
+};
+
+// One segment of a partition's log as the broker stores it on disk:
+//
+//   - 00000000000000012345.log, the batches and messages, in the same layout
+//     as a fetched record set; the name is the segment's base offset;
+//   - .index, (offset - base, byte position) every few KB of the log;
+//   - .timeindex, (max timestamp so far, offset - base) likewise.
+//
+// The log is mmapped and iterated in place with LazyRecordSet (magic 2
+// batches and older messages) or LazyMessageSet (magic 0/1 only), the views
+// used for fetch responses, so nothing is copied and no broker is involved.
+// The indexes are optional: without them a seek scans the batch headers from
+// the start of the segment.
+//
+//     SegmentReader seg;
+//     if(seg.open("/data/topic-0/00000000000000012345.log") < 0) ...
+//     for(const RecordView& r : seg.recordsFrom(12400))
+//         if(r.offset >= 12400) ...
+//
+// Seeks land on the batch holding the offset (or timestamp), which may start
+// with earlier records; skip them by offset. A segment still being written
+// ends at its last complete batch, and indexes the broker preallocated are
+// read up to their last entry. Views stay valid until close().
+class SegmentReader
+{
+public:
+    SegmentReader() : m_baseOffset(-1), m_indexEntries(0), m_timeIndexEntries(0) {}
+
+    // The .index and .timeindex next to logPath are used if they can be
+    // opened and the name is a base offset. 0 on success, -1 with errno set
+    // if the log can't be mapped.
+    int open(const std::string& logPath);
+    void close();
+
+    bool isOpen() const { return m_log.isOpen(); }
+    int64_t baseOffset() const { return m_baseOffset; } // -1 if the name isn't one
+    const char* data() const { return m_log.data(); }
+    size_t size() const { return m_log.size(); }
+    bool hasIndex() const { return m_indexEntries > 0; }
+    bool hasTimeIndex() const { return m_timeIndexEntries > 0; }
+
+    // byte position of the first batch holding offset or a later one, size()
+    // if there is none
+    size_t position(int64_t offset) const;
+    // byte position of the first batch with a timestamp at or after ts (ms),
+    // size() if there is none; magic 0 messages have no timestamp
+    size_t positionForTime(int64_t ts) const;
+
+    // from a byte position to the end of the segment
+    LazyRecordSet records(size_t pos = 0) const;
+    LazyMessageSet messages(size_t pos = 0) const;
+
+    LazyRecordSet recordsFrom(int64_t offset) const { return records(position(offset)); }
+    LazyRecordSet recordsFromTime(int64_t ts) const { return records(positionForTime(ts)); }
+
+private:
+    SegmentReader(const SegmentReader&);
+    SegmentReader& operator = (const SegmentReader&);
+
+    static size_t usedEntries(const MappedFile& index, size_t entrySize);
+    size_t indexLookup(int64_t offset) const;
+    size_t scan(size_t pos, int64_t offset, int64_t ts) const;
+
+    MappedFile m_log;
+    MappedFile m_index;
+    MappedFile m_timeIndex;
+    int64_t m_baseOffset;
+    size_t m_indexEntries;     // in use, the rest of the file is preallocated
+    size_t m_timeIndexEntries;
+};
+
+}
@@ -0,0 +1,282 @@
+#include "SegmentWriter.h"
+
+#include <climits>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using namespace kafkaprotocpp;
+
+SegmentWriter::SegmentWriter(const Options& opts) :
+    m_opts(opts), m_log(-1), m_index(-1), m_timeIndex(-1), m_baseOffset(-1), m_nextOffset(0), m_size(0),
+    m_sinceIndex(0), m_maxTimestamp(-1), m_maxTimestampOffset(-1), m_lastIndexedTimestamp(-1), m_segments(0)
+{
+    if(m_opts.segmentBytes > INT32_MAX)
+        m_opts.segmentBytes = INT32_MAX;
+}
+
+static int writeAll(int fd, struct iovec* iov, int n)
+{
+    while(n > 0) {
+        ssize_t w = writev(fd, iov, n);
+        if(w < 0) {
+            if(errno == EINTR)
+                continue;
+            return -1;
+        }
+        while(n > 0 && (size_t)w >= iov->iov_len) {
+            w -= iov->iov_len;
+            ++iov;
+            --n;
+        }
+        if(n > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + w;
+            iov->iov_len -= w;
+        }
+    }
+    return 0;
+}
+
+static int writeAll(int fd, const std::string& buf)
+{
+    struct iovec iov = { const_cast<char*>(buf.data()), buf.size() };
+    return writeAll(fd, &iov, 1);
+}
+
+static void closeFd(int& fd)
+{
+    if(fd >= 0)
+        ::close(fd);
+    fd = -1;
+}
+
+int SegmentWriter::open(const std::string& dir, int64_t offset)
+{
+    if(close() < 0)
+        return -1;
+    m_dir = dir;
+    m_nextOffset = offset;
+    m_segments = 0;
+    return openSegment(offset);
+}
+
+int SegmentWriter::close()
+{
+    int ret = closeSegment();
+    m_buf.clear();
+    m_indexBuf.clear();
+    m_timeIndexBuf.clear();
+    return ret;
+}
+
+int SegmentWriter::openSegment(int64_t base)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/%020lld", (long long)base);
+    std::string path = m_dir + name;
+    const char* exts[] = { ".log", ".index", ".timeindex" };
+    int* fds[] = { &m_log, &m_index, &m_timeIndex };
+    for(int i = 0; i < 3; ++i) {
+        *fds[i] = ::open((path + exts[i]).c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if(*fds[i] < 0) {
+            // don't leave half a segment behind
+            int err = errno;
+            for(int k = 0; k < i; ++k) {
+                closeFd(*fds[k]);
+                unlink((path + exts[k]).c_str());
+            }
+            errno = err;
+            return -1;
+        }
+    }
+    // so the new files survive a crash along with their data
+    if(m_opts.sync != SYNC_NEVER) {
+        int fd = ::open(m_dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if(fd >= 0) {
+            fsync(fd);
+            ::close(fd);
+        }
+    }
+
+    m_baseOffset = base;
+    m_size = 0;
+    m_sinceIndex = 0;
+    m_maxTimestamp = -1;
+    m_maxTimestampOffset = base;
+    m_lastIndexedTimestamp = -1;
+    ++m_segments;
+    return 0;
+}
+
+int SegmentWriter::closeSegment()
+{
+    if(m_log < 0)
+        return 0;
+    int ret = writeOut(NULL, 0);
+    if(ret == 0 && m_opts.sync == SYNC_ROLL)
+        ret = syncFiles();
+    int err = errno;
+    closeFd(m_log);
+    closeFd(m_index);
+    closeFd(m_timeIndex);
+    errno = err;
+    return ret;
+}
+
+int SegmentWriter::roll()
+{
+    if(m_log < 0) {
+        errno = EBADF;
+        return -1;
+    }
+    if(m_size == 0)
+        return 0;
+    if(closeSegment() < 0)
+        return -1;
+    return openSegment(m_nextOffset);
+}
+
+int SegmentWriter::flush()
+{
+    if(m_log < 0) {
+        errno = EBADF;
+        return -1;
+    }
+    return writeOut(NULL, 0);
+}
+
+int64_t SegmentWriter::append(const MessageSet& set, bool assignOffsets)
+{
+    m_scratch.resize(0);
+    Pack pk(m_scratch);
+    set.marshal(pk);
+    return append(pk.data(), pk.size(), assignOffsets);
+}
+
+int64_t SegmentWriter::append(const char* data, size_t size, bool assignOffsets)
+{
+    if(m_log < 0) {
+        errno = EBADF;
+        return -1;
+    }
+
+    const char* p = data;
+    const char* end = data + size;
+    const char* run = p; // entries taken as they are, not staged yet
+    LogEntryHeader e;
+    while(e.decode(p, end)) {
+        if(assignOffsets) {
+            // the offset field isn't covered by the crc, but the offsets
+            // inside a compressed wrapper would have to be rewritten too
+            if(e.magic < 2 && e.compressed) {
+                errno = EINVAL;
+                return -1;
+            }
+            e.lastOffset = m_nextOffset + (e.lastOffset - e.firstOffset);
+            e.firstOffset = m_nextOffset;
+        } else if(e.lastOffset < m_nextOffset) {
+            // written already
+            if(stage(run, p - run) < 0)
+                return -1;
+            p += e.size;
+            run = p;
+            continue;
+        }
+
+        if(m_size > 0 && (m_size + e.size > m_opts.segmentBytes || e.lastOffset - m_baseOffset > INT32_MAX)) {
+            if(stage(run, p - run) < 0)
+                return -1;
+            run = p;
+            if(closeSegment() < 0 || openSegment(e.firstOffset) < 0)
+                return -1;
+        }
+
+        if(assignOffsets) {
+            char head[8];
+            store_be64(head, e.firstOffset);
+            if(stage(head, sizeof(head)) < 0 || stage(p + 8, e.size - 8) < 0)
+                return -1;
+            run = p + e.size;
+        }
+        // once the batch is staged (or in run, staged before any write), so an
+        // index entry never reaches the file ahead of it
+        index(e);
+        m_size += e.size;
+        m_nextOffset = e.lastOffset + 1;
+        p += e.size;
+    }
+    if(stage(run, p - run) < 0)
+        return -1;
+    return p - data;
+}
+
+// As the broker does: an index entry for the batch that follows
+// indexIntervalBytes of log, pointing at its start with its last offset.
+void SegmentWriter::index(const LogEntryHeader& e)
+{
+    if(e.maxTimestamp > m_maxTimestamp) {
+        m_maxTimestamp = e.maxTimestamp;
+        m_maxTimestampOffset = e.lastOffset;
+    }
+    if(m_sinceIndex > m_opts.indexIntervalBytes) {
+        char entry[12];
+        store_be32(entry, e.lastOffset - m_baseOffset);
+        store_be32(entry + 4, m_size);
+        m_indexBuf.append(entry, 8);
+        if(m_maxTimestamp > m_lastIndexedTimestamp) {
+            store_be64(entry, m_maxTimestamp);
+            store_be32(entry + 8, m_maxTimestampOffset - m_baseOffset);
+            m_timeIndexBuf.append(entry, 12);
+            m_lastIndexedTimestamp = m_maxTimestamp;
+        }
+        m_sinceIndex = 0;
+    }
+    m_sinceIndex += e.size;
+}
+
+// buffer data, or write it along with the buffer if that would overflow it
+int SegmentWriter::stage(const char* data, size_t size)
+{
+    if(size == 0)
+        return 0;
+    if(m_buf.size() + size > m_opts.bufferBytes)
+        return writeOut(data, size);
+    if(m_buf.capacity() < m_opts.bufferBytes)
+        m_buf.reserve(m_opts.bufferBytes);
+    m_buf.append(data, size);
+    return 0;
+}
+
+// The buffer and extra to the log in one writev, then the index entries,
+// which may only point at data already in the log.
+int SegmentWriter::writeOut(const char* extra, size_t size)
+{
+    if(m_buf.empty() && size == 0 && m_indexBuf.empty() && m_timeIndexBuf.empty())
+        return 0;
+    struct iovec iov[2] = {
+        { const_cast<char*>(m_buf.data()), m_buf.size() },
+        { const_cast<char*>(extra), size },
+    };
+    if(writeAll(m_log, iov, 2) < 0)
+        return -1;
+    m_buf.clear();
+    if(!m_indexBuf.empty() && writeAll(m_index, m_indexBuf) < 0)
+        return -1;
+    m_indexBuf.clear();
+    if(!m_timeIndexBuf.empty() && writeAll(m_timeIndex, m_timeIndexBuf) < 0)
+        return -1;
+    m_timeIndexBuf.clear();
+    if(m_opts.sync == SYNC_FLUSH)
+        return syncFiles();
+    return 0;
+}
+
+int SegmentWriter::syncFiles()
+{
+    if(fdatasync(m_log) < 0 || fdatasync(m_index) < 0 || fdatasync(m_timeIndex) < 0)
+        return -1;
+    return 0;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "SegmentReader.h"
+
+#include <string>
+
+namespace kafkaprotocpp {
+
+// Appends to a partition's log in the broker's on-disk format, the files
+// SegmentReader (or a broker) reads back:
+//
+//     SegmentWriter writer;
+//     writer.open("/spool/topic-0", nextOffset);
+//     writer.append(records.data(), records.size);  // a fetched record set
+//     ...
+//     writer.close();
+//
+// Appends are gathered in a buffer of Options::bufferBytes and written with
+// one writev() when it fills, together with the set that didn't fit, which
+// isn't copied; the files grow in large sequential writes. Like the broker, an .index and
+// a .timeindex entry is added every Options::indexIntervalBytes of log, and a
+// new segment, named after its first offset, is started when the current one
+// would grow past Options::segmentBytes. Options::sync picks when data is
+// fdatasync()ed; otherwise durability is left to the page cache.
+//
+// Entries keep their offsets, and ones already written are skipped, so
+// overlapping fetches can be spooled as they come. For a broker stand-in,
+// append(..., true) assigns offsets from nextOffset() instead.
+class SegmentWriter
+{
+public:
+    enum SyncPolicy
+    {
+        SYNC_NEVER, // the OS writes back when it likes
+        SYNC_ROLL,  // a segment and its indexes when it is rolled or closed
+        SYNC_FLUSH, // every time buffered data is written
+    };
+
+    struct Options
+    {
+        size_t segmentBytes;       // at most 2GB, positions are 32 bit
+        size_t indexIntervalBytes;
+        size_t bufferBytes;
+        int sync;                  // SyncPolicy
+
+        Options() : segmentBytes(1 << 30), indexIntervalBytes(4096), bufferBytes(1 << 20), sync(SYNC_ROLL) {}
+    };
+
+    SegmentWriter(const Options& opts = Options());
+    ~SegmentWriter() { close(); }
+
+    // Start a new segment at offset in dir, which must exist. 0 on success,
+    // -1 with errno set, EEXIST if that segment is already there.
+    int open(const std::string& dir, int64_t offset);
+    // write what is buffered, sync per policy and close the files
+    int close();
+
+    // Append the complete entries (magic 2 batches or magic 0/1 messages) of
+    // an encoded set; a truncated tail, as fetch responses have, is left out.
+    // Returns the bytes of data taken, or -1 with errno set: EINVAL for a
+    // compressed magic 0/1 wrapper when assigning offsets, otherwise a write
+    // error after which the segment is in an unknown state.
+    int64_t append(const char* data, size_t size, bool assignOffsets = false);
+    int64_t append(const MessageSet& set, bool assignOffsets = false);
+
+    // write buffered data to the files, syncing with SYNC_FLUSH
+    int flush();
+    // close the current segment and start the next one at nextOffset()
+    int roll();
+
+    bool isOpen() const { return m_log >= 0; }
+    int64_t nextOffset() const { return m_nextOffset; }
+    int64_t baseOffset() const { return m_baseOffset; }  // of the current segment
+    size_t segmentSize() const { return m_size; }        // buffered bytes included
+    size_t buffered() const { return m_buf.size(); }
+    size_t segments() const { return m_segments; }       // opened so far
+
+private:
+    SegmentWriter(const SegmentWriter&);
+    SegmentWriter& operator = (const SegmentWriter&);
+
+    int openSegment(int64_t base);
+    int closeSegment();
+    int stage(const char* data, size_t size);
+    int writeOut(const char* extra, size_t size);
+    int syncFiles();
+    void index(const LogEntryHeader& e);
+
+    Options m_opts;
+    std::string m_dir;
+
+    int m_log;
+    int m_index;
+    int m_timeIndex;
+    int64_t m_baseOffset;
+    int64_t m_nextOffset;
+    size_t m_size;
+
+    size_t m_sinceIndex;       // log bytes since the last index entry
+    int64_t m_maxTimestamp;    // in the segment so far, and its offset
+    int64_t m_maxTimestampOffset;
+    int64_t m_lastIndexedTimestamp;
+
+    std::string m_buf;         // log bytes not written yet
+    std::string m_indexBuf;
+    std::string m_timeIndexBuf;
+    PackBuffer m_scratch;      // for append(MessageSet)
+    size_t m_segments;
+};
+
+}
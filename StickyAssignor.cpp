@@ -0,0 +1,328 @@
+#include "StickyAssignor.h"
+
+#include <algorithm>
+#include <set>
+
+using namespace kafkaprotocpp;
+
+bool StickyAssignor::Member::subscribes(int32_t t) const
+{
+    return std::binary_search(topics.begin(), topics.end(), t);
+}
+
+void StickyAssignor::assign(const std::vector<GroupMemberMeta>& members, const MetadataSnapshot& snap, Assignments& out)
+{
+    PartitionCounts counts;
+    for(auto& member : members) {
+        for(auto& name : member.meta.topics) {
+            const TopicRoute* route = snap.topic(name);
+            if(route && route->errcode == ApiConstants::ERRORCODE_NO_ERROR)
+                counts[name] = route->partitions.size();
+        }
+    }
+    assign(members, counts, out);
+}
+
+void StickyAssignor::assign(const std::vector<GroupMemberMeta>& members, const PartitionCounts& counts, Assignments& out)
+{
+    index(members, counts);
+    claimPrevious();
+
+    bool homogeneous = !m_members.empty();
+    for(auto& m : m_members) {
+        if(m.topics != m_members[0].topics) {
+            homogeneous = false;
+            break;
+        }
+    }
+    if(homogeneous)
+        assignHomogeneous();
+    else
+        assignGeneral();
+
+    output(out);
+}
+
+void StickyAssignor::index(const std::vector<GroupMemberMeta>& members, const PartitionCounts& counts)
+{
+    m_members.clear();
+    m_topics.clear();
+    m_groups.clear();
+    m_topicIndex.clear();
+
+    std::set<std::string> ids;
+    for(auto& meta : members) {
+        if(!ids.insert(meta.memberid).second)
+            continue; // a member listed twice is assigned once
+        Member m;
+        m.meta = &meta;
+        m_members.push_back(std::move(m));
+    }
+    std::sort(m_members.begin(), m_members.end(), [](const Member& a, const Member& b) {
+        return a.meta->memberid < b.meta->memberid;
+    });
+
+    // topics numbered in name order, partition ids numbered topic by topic
+    // consecutive members usually subscribe to the same list, which is
+    // compared instead of being looked up again
+    std::vector<const std::string*> names;
+    const std::vector<std::string>* last = NULL;
+    for(auto& m : m_members) {
+        if(last && *last == m.meta->meta.topics)
+            continue;
+        last = &m.meta->meta.topics;
+        for(auto& name : m.meta->meta.topics) {
+            auto ins = m_topicIndex.insert(std::make_pair(name, -1));
+            if(!ins.second)
+                continue;
+            auto it = counts.find(name);
+            if(it != counts.end() && it->second > 0)
+                names.push_back(&ins.first->first);
+        }
+    }
+    std::sort(names.begin(), names.end(), [](const std::string* a, const std::string* b) {
+        return *a < *b;
+    });
+    uint32_t total = 0;
+    for(auto name : names) {
+        m_topicIndex[*name] = m_topics.size();
+        Topic t;
+        t.name = name;
+        t.count = counts.find(*name)->second;
+        t.base = total;
+        total += t.count;
+        m_topics.push_back(std::move(t));
+    }
+
+    last = NULL;
+    for(size_t i = 0; i < m_members.size(); ++i) {
+        Member& m = m_members[i];
+        if(last && *last == m.meta->meta.topics) {
+            m.topics = m_members[i - 1].topics;
+        } else {
+            last = &m.meta->meta.topics;
+            for(auto& name : m.meta->meta.topics) {
+                int32_t t = m_topicIndex.find(name)->second;
+                if(t >= 0)
+                    m.topics.push_back(t);
+            }
+            std::sort(m.topics.begin(), m.topics.end());
+            m.topics.erase(std::unique(m.topics.begin(), m.topics.end()), m.topics.end());
+        }
+        for(auto t : m.topics)
+            m_topics[t].members.push_back(i);
+    }
+
+    m_owner.assign(total, -1);
+    m_prevOwner.assign(total, -1);
+    m_topicOf.resize(total);
+    for(size_t t = 0; t < m_topics.size(); ++t)
+        std::fill(m_topicOf.begin() + m_topics[t].base, m_topicOf.begin() + m_topics[t].base + m_topics[t].count, t);
+}
+
+// keep what members own and still subscribe to; a partition claimed by two
+// members stays with the first
+void StickyAssignor::claimPrevious()
+{
+    for(size_t i = 0; i < m_members.size(); ++i) {
+        Member& m = m_members[i];
+        for(auto& owned : m.meta->meta.oldSubs.toppars) {
+            auto it = m_topicIndex.find(owned.topic);
+            if(it == m_topicIndex.end() || it->second < 0)
+                continue;
+            const Topic& t = m_topics[it->second];
+            bool subscribed = m.subscribes(it->second);
+            for(auto parn : owned.partitions) {
+                if(parn < 0 || parn >= t.count)
+                    continue;
+                uint32_t pid = t.base + parn;
+                if(m_prevOwner[pid] == -1)
+                    m_prevOwner[pid] = i;
+                if(subscribed && m_owner[pid] == -1)
+                    give(pid, i);
+            }
+        }
+    }
+}
+
+void StickyAssignor::give(uint32_t pid, int32_t m)
+{
+    Member& member = m_members[m];
+    if(!m_groups.empty()) {
+        auto& byLoad = m_groups[member.group].byLoad;
+        byLoad.erase(std::make_pair(member.owned.size(), m));
+        byLoad.insert(std::make_pair(member.owned.size() + 1, m));
+    }
+    m_owner[pid] = m;
+    member.owned.push_back(pid);
+}
+
+// drop owned[j] of member m, the caller gives it to someone else
+void StickyAssignor::take(size_t j, int32_t m)
+{
+    Member& member = m_members[m];
+    if(!m_groups.empty()) {
+        auto& byLoad = m_groups[member.group].byLoad;
+        byLoad.erase(std::make_pair(member.owned.size(), m));
+        byLoad.insert(std::make_pair(member.owned.size() - 1, m));
+    }
+    m_owner[member.owned[j]] = -1;
+    member.owned[j] = member.owned.back();
+    member.owned.pop_back();
+}
+
+void StickyAssignor::group()
+{
+    std::map<std::vector<int32_t>, int32_t> groups;
+    for(size_t i = 0; i < m_members.size(); ++i) {
+        Member& m = m_members[i];
+        auto ins = groups.insert(std::make_pair(m.topics, (int32_t)m_groups.size()));
+        if(ins.second) {
+            m_groups.emplace_back();
+            for(auto t : m.topics)
+                m_topics[t].groups.push_back(ins.first->second);
+        }
+        m.group = ins.first->second;
+        m_groups[m.group].byLoad.insert(std::make_pair(m.owned.size(), (int32_t)i));
+    }
+}
+
+// Every member can take every partition, so each member's quota is known:
+// total / members, plus one for the first total % members members. Those
+// extra slots go to the members that already own the most.
+void StickyAssignor::assignHomogeneous()
+{
+    size_t total = m_owner.size();
+    size_t n = m_members.size();
+    size_t quota = total / n;
+    size_t extra = total % n;
+
+    std::vector<int32_t> order(n);
+    for(size_t i = 0; i < n; ++i)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [this](int32_t a, int32_t b) {
+        return m_members[a].owned.size() > m_members[b].owned.size();
+    });
+
+    std::vector<size_t> target(n);
+    for(size_t k = 0; k < n; ++k) {
+        Member& m = m_members[order[k]];
+        target[order[k]] = quota + (k < extra ? 1 : 0);
+        if(m.owned.size() > target[order[k]]) {
+            for(size_t j = target[order[k]]; j < m.owned.size(); ++j)
+                m_owner[m.owned[j]] = -1;
+            m.owned.resize(target[order[k]]);
+        }
+    }
+
+    size_t k = 0;
+    for(uint32_t pid = 0; pid < total; ++pid) {
+        if(m_owner[pid] != -1)
+            continue;
+        while(m_members[order[k]].owned.size() >= target[order[k]])
+            ++k;
+        give(pid, order[k]);
+    }
+}
+
+// ties go to the lowest member index
+int32_t StickyAssignor::leastLoaded(const Topic& t) const
+{
+    const std::pair<size_t, int32_t>* best = NULL;
+    for(auto g : t.groups) {
+        const auto& least = *m_groups[g].byLoad.begin();
+        if(best == NULL || least < *best)
+            best = &least;
+    }
+    return best ? best->second : -1;
+}
+
+void StickyAssignor::assignGeneral()
+{
+    group();
+
+    // the most constrained topics first, so they still find room
+    std::vector<int32_t> order(m_topics.size());
+    for(size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [this](int32_t a, int32_t b) {
+        return m_topics[a].members.size() < m_topics[b].members.size();
+    });
+
+    for(auto ti : order) {
+        const Topic& t = m_topics[ti];
+        if(t.members.empty())
+            continue;
+        for(int32_t parn = 0; parn < t.count; ++parn) {
+            uint32_t pid = t.base + parn;
+            if(m_owner[pid] == -1)
+                give(pid, leastLoaded(t));
+        }
+    }
+
+    rebalance();
+}
+
+// Move partitions from a member to the least loaded subscriber of their topic
+// while that one has at least two fewer. Each move lowers the sum of squared
+// loads, so this ends. Partitions given out this round are tried first,
+// being at the back of 'owned', so previous owners keep theirs if possible.
+void StickyAssignor::rebalance()
+{
+    std::vector<int32_t> order(m_members.size());
+    bool changed = true;
+    while(changed) {
+        changed = false;
+        for(size_t i = 0; i < order.size(); ++i)
+            order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [this](int32_t a, int32_t b) {
+            return m_members[a].owned.size() > m_members[b].owned.size();
+        });
+
+        for(auto mi : order) {
+            Member& m = m_members[mi];
+            for(size_t j = m.owned.size(); j-- > 0; ) {
+                uint32_t pid = m.owned[j];
+                int32_t to = leastLoaded(m_topics[m_topicOf[pid]]);
+                if(to == mi || m_members[to].owned.size() + 1 >= m.owned.size())
+                    continue;
+                take(j, mi);
+                give(pid, to);
+                changed = true;
+            }
+        }
+    }
+}
+
+void StickyAssignor::output(Assignments& out)
+{
+    m_kept = m_moved = 0;
+    for(size_t pid = 0; pid < m_owner.size(); ++pid) {
+        if(m_prevOwner[pid] == -1)
+            continue;
+        if(m_prevOwner[pid] == m_owner[pid])
+            ++m_kept;
+        else
+            ++m_moved;
+    }
+
+    out.clear();
+    for(auto& m : m_members) {
+        MemberAssignment& ma = out[m.meta->memberid];
+        ma.size = 0;
+        ma.version = 0;
+
+        // topics are numbered in name order, so ascending ids give sorted blocks
+        std::sort(m.owned.begin(), m.owned.end());
+        TopicPartitionsBlock* block = NULL;
+        int32_t current = -1;
+        for(auto pid : m.owned) {
+            int32_t t = m_topicOf[pid];
+            if(t != current) {
+                block = &ma.topicAssign.append(*m_topics[t].name);
+                current = t;
+            }
+            block->partitions.push_back(pid - m_topics[t].base);
+        }
+    }
+}
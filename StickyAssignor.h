@@ -0,0 +1,98 @@
+#pragma once
+
+#include "KafkaConsumerMessage.h"
+#include "MetadataCache.h"
+
+#include <map>
+#include <set>
+#include <unordered_map>
+
+namespace kafkaprotocpp {
+
+// Partition assignor for the group leader.
+//
+// Takes the members of a JoinGroupResponse (subscribed topics plus what each
+// member currently owns, ProtocolMetadata::oldSubs) and produces
+// SyncGroupRequest::assignments that are
+//   - balanced: with identical subscriptions partition counts differ by at
+//     most one, otherwise no partition could move to a member with two or
+//     more fewer partitions that also subscribes to its topic;
+//   - sticky: a partition stays with its current owner unless balance or a
+//     changed subscription requires moving it.
+//
+// When every member subscribes to the same topics (the usual case) quotas are
+// known up front and the assignment is one linear pass. Otherwise unowned
+// partitions go greedily to the least loaded eligible member, topics with the
+// fewest subscribers first, and a rebalance pass moves partitions from over-
+// to under-loaded members while that narrows the spread. Members with the same
+// subscriptions share one load-ordered set, so finding the least loaded
+// eligible member costs one lookup per distinct subscription, not per member.
+class StickyAssignor
+{
+public:
+    typedef std::map<std::string, int32_t> PartitionCounts; // topic -> number of partitions
+    typedef std::map<std::string, MemberAssignment> Assignments; // memberid -> assignment
+
+    StickyAssignor() : m_kept(0), m_moved(0) {}
+
+    // topics missing from counts are not assigned
+    void assign(const std::vector<GroupMemberMeta>& members, const PartitionCounts& counts, Assignments& out);
+    void assign(const std::vector<GroupMemberMeta>& members, const MetadataSnapshot& snap, Assignments& out);
+
+    // of the last assign(): partitions left with their previous owner, and
+    // previously owned partitions that changed owner
+    size_t kept() const { return m_kept; }
+    size_t moved() const { return m_moved; }
+
+private:
+    struct Member
+    {
+        const GroupMemberMeta* meta;
+        std::vector<int32_t> topics;   // indexes into m_topics, sorted
+        std::vector<uint32_t> owned;   // partition ids, see Topic::base
+        int32_t group;                 // index into m_groups, general case only
+
+        Member() : meta(NULL), group(-1) {}
+
+        bool subscribes(int32_t t) const;
+    };
+
+    // members with identical subscriptions
+    struct Group
+    {
+        std::set<std::pair<size_t, int32_t> > byLoad; // (partitions owned, member)
+    };
+
+    struct Topic
+    {
+        const std::string* name;
+        int32_t count;
+        uint32_t base;                 // id of partition 0
+        std::vector<int32_t> members;  // subscribers, indexes into m_members
+        std::vector<int32_t> groups;   // subscriber groups, general case only
+    };
+
+    void index(const std::vector<GroupMemberMeta>& members, const PartitionCounts& counts);
+    void claimPrevious();
+    void assignHomogeneous();
+    void assignGeneral();
+    void rebalance();
+    void output(Assignments& out);
+
+    void group();
+    void give(uint32_t pid, int32_t m);
+    void take(size_t j, int32_t m);
+    int32_t leastLoaded(const Topic& t) const;
+
+    std::vector<Member> m_members;          // sorted by member id
+    std::vector<Topic> m_topics;
+    std::vector<Group> m_groups;            // empty unless grouped
+    std::unordered_map<std::string, int32_t> m_topicIndex; // -1 for topics without partitions
+    std::vector<int32_t> m_owner;           // partition id -> member, -1 if unassigned
+    std::vector<int32_t> m_prevOwner;
+    std::vector<int32_t> m_topicOf;         // partition id -> topic
+    size_t m_kept;
+    size_t m_moved;
+};
+
+}
@@ -0,0 +1,107 @@
+#include "TopicTable.h"
+
+using namespace kafkaprotocpp;
+
+TopicTable& TopicTable::global()
+{
+    static TopicTable s_table;
+    return s_table;
+}
+
+TopicTable::Slots* TopicTable::newSlots(size_t cap, Slots* prev)
+{
+    Slots* s = new Slots;
+    s->mask = cap - 1;
+    s->slot = new std::atomic<const InternedTopic*>[cap];
+    for(size_t i = 0; i < cap; ++i)
+        s->slot[i].store(NULL, std::memory_order_relaxed);
+    s->prev = prev;
+    return s;
+}
+
+TopicTable::TopicTable() : m_slots(newSlots(1024, NULL)), m_size(0), m_limit(65536), m_empty(NULL)
+{
+    m_empty = intern("", 0);
+}
+
+TopicTable::~TopicTable()
+{
+    Slots* s = m_slots.load();
+    while(s) {
+        Slots* prev = s->prev;
+        delete [] s->slot;
+        delete s;
+        s = prev;
+    }
+    for(auto entry : m_entries)
+        delete entry;
+}
+
+const InternedTopic* TopicTable::probe(const Slots* s, uint32_t h, const char* data, size_t len)
+{
+    for(size_t i = h & s->mask; ; i = (i + 1) & s->mask) {
+        const InternedTopic* e = s->slot[i].load(std::memory_order_acquire);
+        if(e == NULL)
+            return NULL;
+        if(e->hash == h && e->name.size() == len && ::memcmp(e->name.data(), data, len) == 0)
+            return e;
+    }
+}
+
+const InternedTopic* TopicTable::uninterned(const char* data, size_t len)
+{
+    InternedTopic* entry = new InternedTopic;
+    entry->id = InternedTopic::NOT_INTERNED;
+    entry->hash = hash(data, len);
+    entry->name.assign(data, len);
+    entry->refs.store(1, std::memory_order_relaxed);
+    return entry;
+}
+
+const InternedTopic* TopicTable::find(const char* data, size_t len) const
+{
+    return probe(m_slots.load(std::memory_order_acquire), hash(data, len), data, len);
+}
+
+const InternedTopic* TopicTable::intern(const char* data, size_t len)
+{
+    uint32_t h = hash(data, len);
+    const InternedTopic* e = probe(m_slots.load(std::memory_order_acquire), h, data, len);
+    if(e)
+        return e;
+
+    std::lock_guard<std::mutex> guard(m_lock);
+    Slots* s = m_slots.load(std::memory_order_relaxed);
+    if((e = probe(s, h, data, len)) != NULL)
+        return e; // raced with another inserter
+    // the empty name always gets in
+    if(m_entries.size() >= m_limit.load(std::memory_order_relaxed) && len > 0)
+        return NULL;
+
+    // keep the load factor under 1/2 so probes stay short
+    if((m_entries.size() + 1) * 2 > s->mask + 1) {
+        Slots* grown = newSlots((s->mask + 1) * 2, s);
+        for(auto old : m_entries) {
+            size_t i = old->hash & grown->mask;
+            while(grown->slot[i].load(std::memory_order_relaxed) != NULL)
+                i = (i + 1) & grown->mask;
+            grown->slot[i].store(old, std::memory_order_relaxed);
+        }
+        m_slots.store(grown, std::memory_order_release);
+        s = grown;
+    }
+
+    InternedTopic* entry = new InternedTopic;
+    entry->id = m_entries.size();
+    entry->hash = h;
+    entry->name.assign(data, len);
+    entry->refs.store(0, std::memory_order_relaxed);
+    m_entries.push_back(entry);
+
+    size_t i = h & s->mask;
+    while(s->slot[i].load(std::memory_order_relaxed) != NULL)
+        i = (i + 1) & s->mask;
+    s->slot[i].store(entry, std::memory_order_release);
+    m_size.store(m_entries.size(), std::memory_order_release);
+    return entry;
+}
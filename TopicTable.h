@@ -0,0 +1,184 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <functional>
+
+namespace kafkaprotocpp {
+
+// One topic name. Interned entries are never freed or moved, so pointers and
+// ids stay valid for the life of the table. Names that didn't fit in the table
+// get an entry of their own with id NOT_INTERNED, freed with the last
+// TopicName holding it.
+struct InternedTopic
+{
+    enum { NOT_INTERNED = 0xFFFFFFFF };
+
+    uint32_t id;
+    uint32_t hash;
+    std::string name;
+    mutable std::atomic<uint32_t> refs; // NOT_INTERNED entries only
+};
+
+// Process-wide topic interning table.
+//
+// Lookups hash the caller's bytes (typically straight from the wire) and
+// probe an open-addressing array without locking or allocating. Only the
+// first sighting of a name takes the lock to insert it. A grown slot array
+// replaces the old one, which is kept until the table dies because readers
+// may still be probing it.
+//
+// Interned names live as long as the table, which for global() is the
+// process, so a client fed arbitrary names off the wire would grow it without
+// end. The table therefore holds at most limit() names (65536 unless
+// setLimit() says otherwise); past that, TopicName keeps its own reference
+// counted copy, which works the same but compares by string.
+class TopicTable
+{
+public:
+    static TopicTable& global();
+
+    TopicTable();
+    ~TopicTable();
+
+    // NULL if the name isn't interned yet and the table is full
+    const InternedTopic* intern(const char* data, size_t len);
+    const InternedTopic* intern(const std::string& name)
+    {
+        return intern(name.data(), name.size());
+    }
+    // NULL if the name was never interned, never inserts
+    const InternedTopic* find(const char* data, size_t len) const;
+
+    const InternedTopic* empty() const { return m_empty; }
+    size_t size() const { return m_size.load(std::memory_order_acquire); }
+
+    // names interned from now on; those in already stay
+    void setLimit(size_t maxNames) { m_limit.store(maxNames, std::memory_order_relaxed); }
+    size_t limit() const { return m_limit.load(std::memory_order_relaxed); }
+    bool full() const { return size() >= limit(); }
+
+    // an entry outside any table with one reference, for TopicName
+    static const InternedTopic* uninterned(const char* data, size_t len);
+
+    static uint32_t hash(const char* data, size_t len)
+    {
+        uint32_t h = 2166136261u; // FNV-1a
+        for(size_t i = 0; i < len; ++i) {
+            h ^= (uint8_t)data[i];
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+private:
+    TopicTable(const TopicTable&);
+    TopicTable& operator = (const TopicTable&);
+
+    struct Slots
+    {
+        size_t mask;
+        std::atomic<const InternedTopic*>* slot;
+        Slots* prev;
+    };
+
+    static const InternedTopic* probe(const Slots* s, uint32_t h, const char* data, size_t len);
+    static Slots* newSlots(size_t cap, Slots* prev);
+
+    std::atomic<Slots*> m_slots;
+    std::atomic<size_t> m_size;
+    std::atomic<size_t> m_limit;
+    std::mutex m_lock;
+    std::vector<InternedTopic*> m_entries; // id-indexed, guarded by m_lock
+    const InternedTopic* m_empty;
+};
+
+// Handle to an interned topic name: one pointer, cheap to copy, compare and
+// hash. Converts to const std::string& where the name itself is needed. Once
+// the global table is full, new names are held as reference counted copies
+// (see TopicTable); those compare by string.
+class TopicName
+{
+public:
+    TopicName() : m_entry(TopicTable::global().empty()) {}
+    TopicName(const std::string& name) : m_entry(make(name.data(), name.size())) {}
+    TopicName(const char* name) : m_entry(make(name, ::strlen(name))) {}
+    TopicName(const char* data, size_t len) : m_entry(make(data, len)) {}
+    explicit TopicName(const InternedTopic* entry) : m_entry(entry) { retain(); }
+
+    TopicName(const TopicName& o) : m_entry(o.m_entry) { retain(); }
+    TopicName& operator = (const TopicName& o)
+    {
+        if(m_entry != o.m_entry) {
+            o.retain();
+            release();
+            m_entry = o.m_entry;
+        }
+        return *this;
+    }
+    ~TopicName() { release(); }
+
+    const std::string& str() const { return m_entry->name; }
+    operator const std::string& () const { return m_entry->name; }
+    const char* c_str() const { return m_entry->name.c_str(); }
+    const char* data() const { return m_entry->name.data(); }
+    size_t size() const { return m_entry->name.size(); }
+    bool empty() const { return m_entry->name.empty(); }
+
+    // InternedTopic::NOT_INTERNED for a name the table had no room for
+    uint32_t id() const { return m_entry->id; }
+    bool interned() const { return m_entry->id != InternedTopic::NOT_INTERNED; }
+    const InternedTopic* entry() const { return m_entry; }
+
+    bool operator == (const TopicName& o) const
+    {
+        return m_entry == o.m_entry || ((!interned() || !o.interned()) && str() == o.str());
+    }
+    bool operator != (const TopicName& o) const { return !(*this == o); }
+    bool operator < (const TopicName& o) const { return m_entry != o.m_entry && str() < o.str(); }
+
+private:
+    static const InternedTopic* make(const char* data, size_t len)
+    {
+        const InternedTopic* e = TopicTable::global().intern(data, len);
+        return e ? e : TopicTable::uninterned(data, len);
+    }
+    void retain() const
+    {
+        if(!interned())
+            m_entry->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    void release()
+    {
+        if(!interned() && m_entry->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete m_entry;
+    }
+
+    const InternedTopic* m_entry;
+};
+
+inline bool operator == (const TopicName& t, const std::string& s) { return t.str() == s; }
+inline bool operator == (const std::string& s, const TopicName& t) { return t.str() == s; }
+inline bool operator == (const TopicName& t, const char* s) { return t.str() == s; }
+inline bool operator != (const TopicName& t, const std::string& s) { return t.str() != s; }
+inline bool operator != (const std::string& s, const TopicName& t) { return t.str() != s; }
+inline bool operator != (const TopicName& t, const char* s) { return t.str() != s; }
+
+}
+
+namespace std {
+
+template <>
+struct hash<kafkaprotocpp::TopicName>
+{
+    size_t operator()(const kafkaprotocpp::TopicName& t) const
+    {
+        return t.entry()->hash;
+    }
+};
+
+}
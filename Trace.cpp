@@ -0,0 +1,183 @@
+#include "Trace.h"
+
+#include <time.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+using namespace kafkaprotocpp;
+
+namespace {
+
+// seq is 2 * pos + 1 while event pos is written and 2 * pos + 2 once it is
+// complete, 0 for never written; the event is packed into relaxed atomics so
+// a dumper reading it during a write gets old or new values, which seq sorts
+// out
+struct TraceSlot
+{
+    std::atomic<uint64_t> seq;
+    std::atomic<uint64_t> tsc;
+    std::atomic<uint64_t> id; // ctxid << 32 | apikey << 16 | phase
+};
+
+// single writer (the owning thread), any number of dumpers
+struct TraceRing
+{
+    std::atomic<uint64_t> head;
+    long tid;
+    TraceRing* next;
+    TraceSlot slots[Trace::RING_SIZE];
+};
+
+// rings are never freed, so a dump still sees threads that have exited
+std::atomic<TraceRing*> s_rings(NULL);
+thread_local TraceRing* t_ring = NULL;
+
+std::atomic<uint64_t> s_tscPerUs(0); // bits of a double, 0 if not calibrated
+
+const char* s_phaseNames[] = {
+    "marshal_begin",
+    "marshal_end",
+    "write_done",
+    "first_byte",
+    "frame_done",
+    "decode_done",
+};
+
+uint64_t monoNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+TraceRing* threadRing()
+{
+    if(t_ring != NULL)
+        return t_ring;
+
+    TraceRing* ring = new TraceRing;
+    ring->head.store(0, std::memory_order_relaxed);
+    for(auto& slot : ring->slots)
+        slot.seq.store(0, std::memory_order_relaxed);
+    ring->tid = syscall(SYS_gettid);
+    ring->next = s_rings.load(std::memory_order_relaxed);
+    while(!s_rings.compare_exchange_weak(ring->next, ring, std::memory_order_release, std::memory_order_relaxed))
+        ;
+    t_ring = ring;
+    return ring;
+}
+
+void calibrate()
+{
+    if(s_tscPerUs.load(std::memory_order_acquire) != 0)
+        return;
+
+    uint64_t ns0 = monoNs(), tsc0 = Trace::now();
+    uint64_t ns1;
+    do {
+        ns1 = monoNs();
+    } while(ns1 - ns0 < 10000000ULL); // 10ms
+    uint64_t tsc1 = Trace::now();
+
+    double perUs = (double)(tsc1 - tsc0) * 1000.0 / (double)(ns1 - ns0);
+    uint64_t bits;
+    memcpy(&bits, &perUs, sizeof(bits));
+    s_tscPerUs.store(bits, std::memory_order_release);
+}
+
+}
+
+std::atomic<bool> Trace::s_enabled(false);
+
+void Trace::enable(bool on)
+{
+    if(on)
+        calibrate();
+    s_enabled.store(on, std::memory_order_relaxed);
+}
+
+uint64_t Trace::now()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return monoNs();
+#endif
+}
+
+double Trace::tscPerUs()
+{
+    uint64_t bits = s_tscPerUs.load(std::memory_order_acquire);
+    double perUs;
+    memcpy(&perUs, &bits, sizeof(perUs));
+    return perUs;
+}
+
+const char* Trace::phaseName(int phase)
+{
+    if(phase < 0 || phase >= TRACE_PHASE_MAX)
+        return "unknown";
+    return s_phaseNames[phase];
+}
+
+void Trace::record(int32_t ctxid, int16_t apikey, TracePhase phase)
+{
+    TraceRing* ring = threadRing();
+    uint64_t h = ring->head.load(std::memory_order_relaxed);
+    TraceSlot& slot = ring->slots[h & (RING_SIZE - 1)];
+    slot.seq.store(2 * h + 1, std::memory_order_relaxed);
+    // the busy mark is visible before any of the new event
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.tsc.store(now(), std::memory_order_relaxed);
+    slot.id.store((uint64_t)(uint32_t)ctxid << 32 | (uint64_t)(uint16_t)apikey << 16 | (uint16_t)phase,
+            std::memory_order_relaxed);
+    slot.seq.store(2 * h + 2, std::memory_order_release);
+    ring->head.store(h + 1, std::memory_order_release);
+}
+
+size_t Trace::dump(FILE* fp)
+{
+    size_t n = 0;
+    std::vector<TraceEvent> copy;
+    copy.reserve(RING_SIZE);
+
+    fprintf(fp, "# tsc_per_us=%.3f\n", tscPerUs());
+    for(TraceRing* ring = s_rings.load(std::memory_order_acquire); ring != NULL; ring = ring->next) {
+        uint64_t end = ring->head.load(std::memory_order_acquire);
+        uint64_t begin = end > RING_SIZE ? end - RING_SIZE : 0;
+
+        copy.clear();
+        for(uint64_t i = begin; i < end; ++i) {
+            const TraceSlot& slot = ring->slots[i & (RING_SIZE - 1)];
+            uint64_t seq = slot.seq.load(std::memory_order_acquire);
+            if(seq != 2 * i + 2)
+                continue; // being written, or overwritten by a later event
+            uint64_t tsc = slot.tsc.load(std::memory_order_relaxed);
+            uint64_t id = slot.id.load(std::memory_order_relaxed);
+            // the loads above happen before seq is read again
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(slot.seq.load(std::memory_order_relaxed) != seq)
+                continue; // torn
+            TraceEvent ev;
+            ev.tsc = tsc;
+            ev.ctxid = (int32_t)(id >> 32);
+            ev.apikey = (int16_t)(id >> 16);
+            ev.phase = (int16_t)id;
+            copy.push_back(ev);
+        }
+
+        for(size_t i = 0; i < copy.size(); ++i) {
+            const TraceEvent& ev = copy[i];
+            fprintf(fp, "%ld %d %d %s %llu\n", ring->tid, ev.ctxid, ev.apikey,
+                    phaseName(ev.phase), (unsigned long long)ev.tsc);
+            ++n;
+        }
+    }
+    return n;
+}
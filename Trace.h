@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+
+namespace kafkaprotocpp {
+
+// phases of one request, in the order they normally happen
+enum TracePhase {
+    TRACE_MARSHAL_BEGIN = 0,
+    TRACE_MARSHAL_END,
+    TRACE_WRITE_DONE,   // last byte of the request handed to the socket
+    TRACE_FIRST_BYTE,   // length field of the response read
+    TRACE_FRAME_DONE,   // whole response frame read
+    TRACE_DECODE_DONE,  // response unmarshaled
+    TRACE_PHASE_MAX
+};
+
+struct TraceEvent
+{
+    uint64_t tsc;
+    int32_t ctxid;
+    int16_t apikey;
+    int16_t phase;
+};
+
+// Opt-in request lifecycle tracing.
+//
+// Every thread records into its own ring of RING_SIZE events, so recording is
+// a relaxed load of the enable flag, a TSC read and four stores without
+// locks. When tracing is off only the flag is checked; build with
+// KAFKAPROTOCPP_NO_TRACE to compile the probes out entirely.
+//
+// dump() writes one event per line:
+//   <tid> <ctxid> <apikey> <phase> <tsc>
+// preceded by a "# tsc_per_us=<n>" header used to turn ticks into time.
+// Events of one request share (tid, ctxid), so sorting by those and tsc gives
+// a timeline. Old events are overwritten when a ring wraps.
+//
+// dump() may run while other threads record. Each slot is a seqlock: its
+// sequence number is marked busy, the event stored and the number set to the
+// event's position, all with atomics. dump() prints an event only if the slot
+// held the same position before and after it was copied, so every line is an
+// event as recorded, never a mix of two. Events recorded during the dump, and
+// ones overwritten while it copied, may be missing.
+class Trace
+{
+public:
+    enum { RING_SIZE = 4096 }; // must be a power of 2
+
+    static void enable(bool on);
+    static bool enabled()
+    {
+        return s_enabled.load(std::memory_order_relaxed);
+    }
+
+    static void record(int32_t ctxid, int16_t apikey, TracePhase phase);
+    static size_t dump(FILE* fp);
+
+    static uint64_t now();
+    static double tscPerUs();
+    static const char* phaseName(int phase);
+
+private:
+    static std::atomic<bool> s_enabled;
+};
+
+}
+
+#ifdef KAFKAPROTOCPP_NO_TRACE
+#define KAFKA_TRACE(ctxid, apikey, phase) do {} while(0)
+#else
+#define KAFKA_TRACE(ctxid, apikey, phase) \
+    do { \
+        if(kafkaprotocpp::Trace::enabled()) \
+            kafkaprotocpp::Trace::record(ctxid, apikey, phase); \
+    } while(0)
+#endif
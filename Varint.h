@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace kafkaprotocpp {
+
+// Base 128 varints as used by RecordBatch v2 (magic 2): 7 bits per byte, low
+// group first, high bit set on every byte but the last. Signed values are
+// zigzag encoded so small negative numbers stay short.
+
+inline uint64_t zigzag_encode(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+inline int64_t zigzag_decode(uint64_t v) { return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+
+// false, leaving p alone, if the varint runs past end or over 10 bytes
+inline bool read_uvarint(const char*& p, const char* end, uint64_t& v)
+{
+    uint64_t r = 0;
+    const char* q = p;
+    for(int shift = 0; shift < 64; shift += 7) {
+        if(q == end)
+            return false;
+        uint8_t b = (uint8_t)*q++;
+        r |= (uint64_t)(b & 0x7f) << shift;
+        if(!(b & 0x80)) {
+            v = r;
+            p = q;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline bool read_varint(const char*& p, const char* end, int64_t& v)
+{
+    uint64_t u;
+    if(!read_uvarint(p, end, u))
+        return false;
+    v = zigzag_decode(u);
+    return true;
+}
+
+// 32 bit fields (lengths, counts, deltas) that must also fit an int32
+inline bool read_varint(const char*& p, const char* end, int32_t& v)
+{
+    int64_t w;
+    if(!read_varint(p, end, w) || w < INT32_MIN || w > INT32_MAX)
+        return false;
+    v = (int32_t)w;
+    return true;
+}
+
+inline size_t uvarint_size(uint64_t v)
+{
+    size_t n = 1;
+    while(v >= 0x80) {
+        v >>= 7;
+        ++n;
+    }
+    return n;
+}
+
+inline size_t varint_size(int64_t v) { return uvarint_size(zigzag_encode(v)); }
+
+// writes at most 10 bytes, returns how many
+inline size_t write_uvarint(char* p, uint64_t v)
+{
+    size_t n = 0;
+    while(v >= 0x80) {
+        p[n++] = (char)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (char)v;
+    return n;
+}
+
+inline size_t write_varint(char* p, int64_t v) { return write_uvarint(p, zigzag_encode(v)); }
+
+}
@@ -0,0 +1,98 @@
+#include "../StickyAssignor.h"
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace kafkaprotocpp;
+
+// Sticky assignor timings on large groups.
+// usage: ./assign_bench [topics] [partitions per topic] [members]
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// members as the leader sees them in JoinGroupResponse, owning 'prev'
+static void build_members(std::vector<GroupMemberMeta>& members, int count, const std::vector<std::string>& topics,
+        const StickyAssignor::Assignments& prev, bool halfTopics)
+{
+    members.clear();
+    members.resize(count);
+    for(int i = 0; i < count; ++i) {
+        GroupMemberMeta& m = members[i];
+        char id[64];
+        snprintf(id, sizeof(id), "consumer-%05d-1b0c9e5a", i);
+        m.memberid = id;
+        m.meta.version = 0;
+        for(size_t t = 0; t < topics.size(); ++t) {
+            if(!halfTopics || (t + i) % 2 == 0)
+                m.meta.topics.push_back(topics[t]);
+        }
+        auto it = prev.find(m.memberid);
+        if(it == prev.end())
+            continue;
+        m.meta.oldSubs.toppars = it->second.topicAssign;
+    }
+}
+
+static void run(const char* name, StickyAssignor& assignor, const std::vector<GroupMemberMeta>& members,
+        const StickyAssignor::PartitionCounts& counts, StickyAssignor::Assignments& out)
+{
+    uint64_t t0 = now_ns();
+    assignor.assign(members, counts, out);
+    uint64_t ns = now_ns() - t0;
+
+    size_t lo = SIZE_MAX, hi = 0;
+    for(auto& a : out) {
+        size_t n = 0;
+        for(auto& block : a.second.topicAssign)
+            n += block.partitions.size();
+        lo = std::min(lo, n);
+        hi = std::max(hi, n);
+    }
+    printf("%-16s %9.2f ms  members %5zu  load %zu..%zu  kept %6zu  moved %6zu\n",
+            name, ns / 1e6, out.size(), lo, hi, assignor.kept(), assignor.moved());
+}
+
+int main(int argc, char** argv)
+{
+    int topicCount = argc > 1 ? atoi(argv[1]) : 100;
+    int partitions = argc > 2 ? atoi(argv[2]) : 100;
+    int memberCount = argc > 3 ? atoi(argv[3]) : 1000;
+
+    std::vector<std::string> topics;
+    StickyAssignor::PartitionCounts counts;
+    for(int t = 0; t < topicCount; ++t) {
+        topics.push_back("bench.topic." + std::to_string(t));
+        counts[topics.back()] = partitions;
+    }
+    printf("%d topics x %d partitions, %d members\n", topicCount, partitions, memberCount);
+
+    StickyAssignor assignor;
+    StickyAssignor::Assignments none, first, second;
+    std::vector<GroupMemberMeta> members;
+
+    build_members(members, memberCount, topics, none, false);
+    run("initial", assignor, members, counts, first);
+
+    build_members(members, memberCount, topics, first, false);
+    run("unchanged", assignor, members, counts, second);
+
+    build_members(members, memberCount + 1, topics, first, false);
+    run("member joins", assignor, members, counts, second);
+
+    build_members(members, memberCount - 1, topics, first, false);
+    run("member leaves", assignor, members, counts, second);
+
+    build_members(members, memberCount, topics, none, true);
+    run("mixed initial", assignor, members, counts, first);
+
+    build_members(members, memberCount - 1, topics, first, true);
+    run("mixed leaves", assignor, members, counts, second);
+
+    return 0;
+}
@@ -0,0 +1,383 @@
+#include "../KafkaMessage.h"
+#include "../MessageColumns.h"
+#include "../ArenaMessage.h"
+#include "../KafkaConsumerMessage.h"
+#include "../Request.h"
+#include "../ProduceBuilder.h"
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <new>
+
+using namespace kafkaprotocpp;
+
+// Offline codec benchmark, also the training workload of `make pgo`.
+// Every case runs ROUNDS times and the fastest round is reported.
+// usage: ./codec_bench [scale]
+
+#define ROUNDS 5
+
+// Heap allocations, to check that reused objects stop allocating. Counted
+// only when built by examples/Makefile: the `make pgo` training run leaves the
+// counting allocator out and profiles the default one, as users run it.
+#ifdef CODEC_BENCH_COUNT_ALLOCS
+static uint64_t g_allocs = 0;
+
+void* operator new(size_t n)
+{
+    ++g_allocs;
+    void* p = malloc(n ? n : 1);
+    if(p == NULL)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+#else
+static const uint64_t g_allocs = 0;
+#endif
+
+static void report_allocs(uint64_t allocs, int loops)
+{
+#ifdef CODEC_BENCH_COUNT_ALLOCS
+    printf("%-20s %12.1f allocs/op after warm-up\n", "", (double)allocs / loops);
+#else
+    (void)allocs;
+    (void)loops;
+#endif
+}
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void report(const char* name, int loops, uint64_t ns, size_t bytes)
+{
+    double perOp = (double)ns / loops;
+    double mbps = (double)bytes * loops / ((double)ns / 1e9) / (1024 * 1024);
+    printf("%-20s %12.1f ns/op %10.1f MB/s\n", name, perOp, mbps);
+}
+
+static void build_metadata(MetadataResponse& meta)
+{
+    for(int b = 0; b < 5; ++b) {
+        Broker broker;
+        broker.nodeid = b;
+        broker.host = "kafka-broker-0" + std::to_string(b) + ".example.com";
+        broker.port = 9092;
+        meta.vecBroker.push_back(broker);
+    }
+    for(int t = 0; t < 50; ++t) {
+        TopicMetadata tmeta;
+        tmeta.errcode = 0;
+        tmeta.strTopic = "bench.topic." + std::to_string(t);
+        for(int p = 0; p < 32; ++p) {
+            PartitionMetadata pmeta;
+            pmeta.errcode = 0;
+            pmeta.parid = p;
+            pmeta.leader = p % 5;
+            for(int r = 0; r < 3; ++r)
+                pmeta.replicas.push_back((p + r) % 5);
+            pmeta.isr = pmeta.replicas;
+            tmeta.vecParMeta.push_back(pmeta);
+        }
+        meta.vecTopicMeta.push_back(tmeta);
+    }
+}
+
+static void build_message_set(MessageSet& ms, int count)
+{
+    std::string value(100, 'v');
+    for(int i = 0; i < count; ++i) {
+        Message msg(1, 0, 1500000000000LL + i, "key-" + std::to_string(i % 1000), std::string(value));
+        msg.offset = i;
+        ms.pushMessage(std::move(msg));
+    }
+}
+
+// FetchResponse v2 with one topic, <partitions> partitions of <count> messages
+static void build_fetch_response(PackBuffer& pb, int partitions, int count)
+{
+    Pack pk(pb);
+    MessageSet ms;
+    build_message_set(ms, count);
+
+    pk.push_int32(0); // throttle time
+    pk.push_int32(1);
+    pk.push_string("bench.topic.0");
+    pk.push_int32(partitions);
+    for(int p = 0; p < partitions; ++p) {
+        pk.push_int32(p);
+        pk.push_int16(0);
+        pk.push_int64(count);
+        size_t sizeHead = pk.size();
+        pk.push_int32(0);
+        pk << ms;
+        pk.replace_int32(sizeHead, pk.size() - sizeHead - 4);
+    }
+}
+
+static void build_produce_request(ProduceRequest& req, int partitions, int count)
+{
+    req.ack = 1;
+    req.timeout = 1000;
+    req.topicMsgSets.resize(1);
+    ProduceTopicReqUnit& topic = req.topicMsgSets[0];
+    topic.topic = "bench.topic.0";
+    topic.parMsgSets.resize(partitions);
+    for(int p = 0; p < partitions; ++p) {
+        topic.parMsgSets[p].parn = p;
+        build_message_set(topic.parMsgSets[p].msgSet, count);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int scale = argc > 1 ? atoi(argv[1]) : 1;
+    if(scale <= 0)
+        scale = 1;
+
+    {
+        MetadataResponse meta;
+        build_metadata(meta);
+        PackBuffer pb;
+        Pack pk(pb);
+        pk << meta;
+
+        int loops = 400 * scale;
+        uint64_t best = UINT64_MAX;
+        for(int r = 0; r < ROUNDS; ++r) {
+            uint64_t t0 = now_ns();
+            for(int i = 0; i < loops; ++i) {
+                MetadataResponse out;
+                Unpack up(pk.data(), pk.size());
+                up >> out;
+            }
+            best = std::min(best, now_ns() - t0);
+        }
+        report("metadata_decode", loops, best, pk.size());
+
+        MetadataResponse reused;
+        uint64_t allocs = 0;
+        best = UINT64_MAX;
+        for(int r = 0; r < ROUNDS; ++r) {
+            uint64_t a0 = g_allocs;
+            uint64_t t0 = now_ns();
+            for(int i = 0; i < loops; ++i) {
+                Unpack up(pk.data(), pk.size());
+                up >> reused;
+            }
+            best = std::min(best, now_ns() - t0);
+            allocs = g_allocs - a0;
+        }
+        report("metadata_reuse", loops, best, pk.size());
+        report_allocs(allocs, loops);
+    }
+
+    {
+        PackBuffer pb;
+        build_fetch_response(pb, 4, 500);
+
+        int loops = 40 * scale;
+        uint64_t best = UINT64_MAX;
+        for(int r = 0; r < ROUNDS; ++r) {
+            uint64_t t0 = now_ns();
+            for(int i = 0; i < loops; ++i) {
+                FetchResponseV2 out;
+                Unpack up(pb.data(), pb.size());
+                up >> out;
+            }
+            best = std::min(best, now_ns() - t0);
+        }
+        report("fetch_decode", loops, best, pb.size());
+
+        FetchResponseV2 reused;
+        uint64_t allocs = 0;
+        best = UINT64_MAX;
+        for(int r = 0; r < ROUNDS; ++r) {
+            uint64_t a0 = g_allocs;
+            uint64_t t0 = now_ns();
+            for(int i = 0; i < loops; ++i) {
+                Unpack up(pb.data(), pb.size());
+                up >> reused;
+            }
+            best = std::min(best, now_ns() - t0);
+            allocs = g_allocs - a0;
+        }
+        report("fetch_reuse", loops, best, pb.size());
+        report_allocs(allocs, loops);
+
+        best = UINT64_MAX;
+        for(int r = 0; r < ROUNDS; ++r) {
+            uint64_t t0 = now_ns();
+            for(int i = 0; i < loops; ++i) {
+                Unpack up(pb.data(), pb.size());
+                if(reused.decode(up) > DECODE_TRUNCATED)
+                    printf("fetch_status: decode failed\n");
+            }
+            best = std::min(best, now_ns() - t0);
+        }
+        report("fetch_status", loops, best, pb.size());
+
+        FetchColumnsResponseV2 columns;
+        std::vector<uint32_t> sel;
+        best = UINT64_MAX;
+        for(int r = 0; r < ROUNDS; ++r) {
+            uint64_t t0 = now_ns();
+            for(int i = 0; i < loops; ++i) {
+                Unpack up(pb.data(), pb.size());
+                up >> columns;
+                for(auto& par : columns.result[0].fetchParResult)
+                    par.msgSet.selectKey("key-7", 5, sel);
+            }
+            best = std::min(best, now_ns() - t0);
+        }
+        report("fetch_columns", loops, best, pb.size());
+
+        best = UINT64_MAX;
+        int64_t sum = 0;
+        for(int r = 0; r < ROUNDS; ++r) {
+            uint64_t t0 = now_ns();
+            for(int i = 0; i < loops; ++i) {
+                FetchLazyResponseV2 lazy;
+                Unpack up(pb.data(), pb.size());
+                up >> lazy;
+                for(auto& par : lazy.result[0].fetchParResult)
+                    for(const MessageView& m : par.msgSet)
+                        sum += m.offset;
+            }
+            best = std::min(best, now_ns() - t0);
+        }
+        report("fetch_lazy", loops, best, pb.size());
+
+        ArenaDecoded<ArenaFetchResponseV2> arena;
+        best = UINT64_MAX;
+        for(int r = 0; r < ROUNDS; ++r) {
+            uint64_t t0 = now_ns();
+            for(int i = 0; i < loops; ++i) {
+                Unpack up(pb.data(), pb.size());
+                up >> arena;
+                for(auto& par : arena->result[0].fetchParResult)
+                    for(const MessageView& m : par.msgSet.messages)
+                        sum += m.offset;
+            }
+            best = std::min(best, now_ns() - t0);
+        }
+        report("fetch_arena", loops, best, pb.size());
+        if(sum == 0)
+            printf("no messages\n");
+    }
+
+    {
+        // what a member of a large group sends in JoinGroup: 100 topics x 50 owned partitions
+        ProtocolMetadata meta;
+        meta.version = 0;
+        PartitionSet next;
+        for(int t = 0; t < 100; ++t) {
+            std::string topic = "topic-" + std::to_string(t);
+            meta.topics.push_back(topic);
+            TopicPartitionsBlock& owned = meta.oldSubs.toppars.append(topic);
+            TopicPartitionsBlock& assigned = next.append(topic);
+            for(int p = 0; p < 50; ++p) {
+                owned.partitions.push_back(p * 2);
+                assigned.partitions.push_back(p * 2 + (p % 10 == 0));
+            }
+        }
+        PackBuffer pb;
+        Pack pk(pb);
+        pk << meta;
+
+        int loops = 400 * scale;
+        ProtocolMetadata reused;
+        uint64_t best = UINT64_MAX;
+        for(int r = 0; r < ROUNDS; ++r) {
+            uint64_t t0 = now_ns();
+            for(int i = 0; i < loops; ++i) {
+                Unpack up(pk.data(), pk.size());
+                up >> reused;
+            }
+            best = std::min(best, now_ns() - t0);
+        }
+        report("group_meta_decode", loops, best, pk.size());
+
+        best = UINT64_MAX;
+        for(int r = 0; r < ROUNDS; ++r) {
+            uint64_t t0 = now_ns();
+            for(int i = 0; i < loops; ++i) {
+                PackBuffer out;
+                Pack opk(out);
+                opk << meta;
+            }
+            best = std::min(best, now_ns() - t0);
+        }
+        report("group_meta_encode", loops, best, pk.size());
+
+        // partitions revoked and added by a new assignment
+        PartitionSet revoked, added;
+        size_t changed = 0;
+        best = UINT64_MAX;
+        for(int r = 0; r < ROUNDS; ++r) {
+            uint64_t t0 = now_ns();
+            for(int i = 0; i < loops; ++i) {
+                PartitionSet::setDifference(reused.oldSubs.toppars, next, revoked);
+                PartitionSet::setDifference(next, reused.oldSubs.toppars, added);
+                changed = revoked.size() + added.size();
+            }
+            best = std::min(best, now_ns() - t0);
+        }
+        report("group_meta_diff", loops, best, pk.size());
+        if(changed != 1000)
+            printf("group_meta_diff: %zu partitions changed\n", changed);
+    }
+
+    {
+        ProduceRequest req;
+        build_produce_request(req, 4, 500);
+
+        size_t bytes = 0;
+        int loops = 40 * scale;
+        uint64_t best = UINT64_MAX;
+        for(int r = 0; r < ROUNDS; ++r) {
+            uint64_t t0 = now_ns();
+            for(int i = 0; i < loops; ++i) {
+                Request out(i, "codec_bench", req.apikey, req.apiver, req);
+                bytes = out.size();
+            }
+            best = std::min(best, now_ns() - t0);
+        }
+        report("produce_encode", loops, best, bytes);
+
+        // same request, appended straight into the frame
+        std::string value(100, 'v');
+        std::vector<std::string> keys;
+        for(int i = 0; i < 1000; ++i)
+            keys.push_back("key-" + std::to_string(i));
+        ProduceBuilder builder(0, "codec_bench", req.ack, req.timeout);
+        best = UINT64_MAX;
+        for(int r = 0; r < ROUNDS; ++r) {
+            uint64_t t0 = now_ns();
+            for(int i = 0; i < loops; ++i) {
+                builder.reset();
+                builder.beginTopic(req.topicMsgSets[0].topic);
+                for(int p = 0; p < 4; ++p) {
+                    builder.beginPartition(p);
+                    for(int m = 0; m < 500; ++m)
+                        builder.append(1500000000000LL + m, keys[m % 1000], value);
+                }
+                bytes = builder.size();
+            }
+            best = std::min(best, now_ns() - t0);
+        }
+        report("produce_build", loops, best, bytes);
+    }
+
+    return 0;
+}
@@ -0,0 +1,228 @@
+#include "../LagMonitor.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+using namespace kafkaprotocpp;
+
+// LagMonitor scan timings against two stub brokers in this process, each
+// group committed 10 * partition and each log ending 5 further.
+// usage: ./lag_bench [groups] [topics] [partitions per topic] [-s]
+// -s: broker 2 stops answering after the first scan, so its requests expire
+
+static int s_ports[2];
+static std::atomic<bool> s_silent(false);
+
+static bool readAll(int fd, char* p, size_t n)
+{
+    while(n > 0) {
+        ssize_t len = read(fd, p, n);
+        if(len <= 0)
+            return false;
+        p += len;
+        n -= len;
+    }
+    return true;
+}
+
+static bool writeAll(int fd, const char* p, size_t n)
+{
+    while(n > 0) {
+        ssize_t len = write(fd, p, n);
+        if(len <= 0)
+            return false;
+        p += len;
+        n -= len;
+    }
+    return true;
+}
+
+// ApiVersions v3 (each connection asks first), then FindCoordinator v0,
+// OffsetFetch v1 and ListOffsets v1, the versions LagMonitor sends
+static void serve(int fd, int node)
+{
+    std::vector<char> buf;
+    for(;;) {
+        char head[4];
+        if(!readAll(fd, head, 4))
+            break;
+        buf.resize(load_be32(head));
+        if(!readAll(fd, buf.data(), buf.size()))
+            break;
+        if(node == 2 && s_silent)
+            continue;
+
+        Unpack up(buf.data(), buf.size());
+        int16_t apikey = up.pop_int16();
+        up.pop_int16();
+        int32_t ctxid = up.pop_int32();
+        up.pop_string();
+
+        PackBuffer out;
+        Pack pk(out);
+        pk.push_int32(0);
+        pk.push_int32(ctxid);
+        if(apikey == ApiVersionsRequest::apikey) {
+            const int16_t ranges[][3] = {
+                { ListOffsetRequest::apikey, 0, 1 },
+                { FetchGroupOffsetRequest::apikey, 1, 1 },
+                { QueryGroupCoordinator::apikey, 0, 0 },
+                { ApiVersionsRequest::apikey, 0, 3 },
+            };
+            pk.push_int16(0).push_uvarint(4 + 1);
+            for(auto& r : ranges)
+                pk.push_int16(r[0]).push_int16(r[1]).push_int16(r[2]).push_uvarint(0);
+            pk.push_int32(0).push_uvarint(0);
+        } else if(apikey == QueryGroupCoordinator::apikey) {
+            std::string group = up.pop_string();
+            int id = std::hash<std::string>()(group) % 2;
+            pk.push_int16(0).push_int32(id + 1).push_string("127.0.0.1").push_int32(s_ports[id]);
+        } else if(apikey == FetchGroupOffsetRequest::apikey) {
+            up.pop_string();
+            int32_t topics = up.pop_int32();
+            pk.push_int32(topics);
+            for(int32_t i = 0; i < topics; ++i) {
+                pk.push_string(up.pop_string());
+                int32_t parts = up.pop_int32();
+                pk.push_int32(parts);
+                for(int32_t k = 0; k < parts; ++k) {
+                    int32_t parn = up.pop_int32();
+                    pk.push_int32(parn).push_int64(parn * 10).push_string("").push_int16(0);
+                }
+            }
+        } else if(apikey == ListOffsetRequest::apikey) {
+            up.pop_int32();
+            int32_t topics = up.pop_int32();
+            pk.push_int32(topics);
+            for(int32_t i = 0; i < topics; ++i) {
+                pk.push_string(up.pop_string());
+                int32_t parts = up.pop_int32();
+                pk.push_int32(parts);
+                for(int32_t k = 0; k < parts; ++k) {
+                    int32_t parn = up.pop_int32();
+                    up.pop_int64();
+                    pk.push_int32(parn).push_int16(0).push_int64(-1).push_int64(parn * 10 + 5);
+                }
+            }
+        }
+        pk.replace_int32(0, pk.size() - 4);
+        if(!writeAll(fd, pk.data(), pk.size()))
+            break;
+    }
+    close(fd);
+}
+
+static void accepting(int listenFd, int node)
+{
+    for(;;) {
+        int fd = accept(listenFd, NULL, NULL);
+        if(fd < 0)
+            return;
+        // answers go out one by one, don't let them wait for acks
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        std::thread(serve, fd, node).detach();
+    }
+}
+
+static int listenLoopback()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if(fd < 0 || bind(fd, (struct sockaddr*)&addr, len) < 0 || listen(fd, 64) < 0
+            || getsockname(fd, (struct sockaddr*)&addr, &len) < 0)
+        return -1;
+    return fd;
+}
+
+int main(int argc, char** argv)
+{
+    bool silent = argc > 1 && strcmp(argv[argc - 1], "-s") == 0;
+    if(silent)
+        --argc;
+    int groups = argc > 1 ? atoi(argv[1]) : 500;
+    int topics = argc > 2 ? atoi(argv[2]) : 20;
+    int partitions = argc > 3 ? atoi(argv[3]) : 8;
+
+    MetadataResponse meta;
+    for(int i = 0; i < 2; ++i) {
+        int fd = listenLoopback();
+        if(fd < 0) {
+            printf("listen failed\n");
+            return -1;
+        }
+        struct sockaddr_in addr;
+        socklen_t len = sizeof(addr);
+        getsockname(fd, (struct sockaddr*)&addr, &len);
+        s_ports[i] = ntohs(addr.sin_port);
+        std::thread(accepting, fd, i + 1).detach();
+
+        Broker b;
+        b.nodeid = i + 1;
+        b.host = "127.0.0.1";
+        b.port = s_ports[i];
+        meta.vecBroker.push_back(b);
+    }
+    for(int t = 0; t < topics; ++t) {
+        TopicMetadata tm;
+        tm.errcode = 0;
+        tm.strTopic = TopicName("topic" + std::to_string(t));
+        for(int p = 0; p < partitions; ++p) {
+            PartitionMetadata pm;
+            pm.errcode = 0;
+            pm.parid = p;
+            pm.leader = p % 2 + 1;
+            tm.vecParMeta.push_back(pm);
+        }
+        meta.vecTopicMeta.push_back(tm);
+    }
+    MetadataCache cache;
+    cache.update(meta);
+
+    BrokerPool pool;
+    if(silent)
+        pool.setRequestTimeout(1000);
+    LagMonitor monitor(pool, cache);
+    // two topics per group
+    for(int g = 0; g < groups; ++g) {
+        monitor.watch("group" + std::to_string(g),
+                { "topic" + std::to_string(g % topics), "topic" + std::to_string((g + 1) % topics) });
+    }
+
+    std::vector<LagMonitor::Row> rows;
+    for(int round = 0; round < 5; ++round) {
+        if(silent && round == 1)
+            s_silent = true;
+        auto start = std::chrono::steady_clock::now();
+        bool done = monitor.run(10000);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        rows.clear();
+        monitor.table(rows);
+        size_t known = 0, failed = 0;
+        for(auto& row : rows) {
+            if(row.lag == 5)
+                ++known;
+            if(row.errcode != 0)
+                ++failed;
+        }
+        printf("scan %d %s %8.2f ms  requests %5zu  lookups %4zu  lag known %zu/%zu  failed %zu\n", round,
+                done ? "done   " : "timeout", ms, monitor.requests(), monitor.coordinatorLookups(), known, rows.size(),
+                failed);
+    }
+    return 0;
+}
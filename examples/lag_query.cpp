@@ -0,0 +1,76 @@
+#include "../KafkaMessage.h"
+#include "../Connection.h"
+#include "../LagMonitor.h"
+
+#include <chrono>
+#include <sstream>
+
+using namespace kafkaprotocpp;
+
+// usage: ./lag_query host port group:topic1,topic2 [group:topic ...]
+int main(int argc, char**argv)
+{
+    if(argc < 4) {
+        printf("usage: ./lag_query host port group:topic1,topic2 [group:topic ...]\n");
+        return -1;
+    }
+
+    std::string host(argv[1]);
+    int port = atoi(argv[2]);
+
+    std::vector<std::pair<std::string, std::vector<std::string> > > groups;
+    MetadataRequest metareq;
+    for(int i = 3; i < argc; ++i) {
+        std::string arg(argv[i]);
+        size_t colon = arg.find(':');
+        if(colon == std::string::npos) {
+            printf("bad group spec %s\n", argv[i]);
+            return -1;
+        }
+        groups.emplace_back();
+        groups.back().first = arg.substr(0, colon);
+        std::stringstream ss(arg.substr(colon + 1));
+        std::string topic;
+        while(std::getline(ss, topic, ',')) {
+            groups.back().second.push_back(topic);
+            metareq.vecTopic.push_back(topic);
+        }
+    }
+
+    Connection con;
+    if(con.Connect(host, port) < 0) {
+        printf("Connect to %s:%d failed\n", host.c_str(), port);
+        return -1;
+    }
+    MetadataResponse meta;
+    if(con.SendRequest(metareq.apikey, metareq.apiver, metareq, meta) < 0) {
+        printf("send request failed\n");
+        return -1;
+    }
+
+    MetadataCache cache;
+    cache.update(meta);
+    BrokerPool pool;
+    LagMonitor mon(pool, cache);
+    for(auto& g : groups)
+        mon.watch(g.first, g.second);
+
+    // the second scan reuses the coordinators and connections of the first
+    for(int round = 0; round < 2; ++round) {
+        auto start = std::chrono::steady_clock::now();
+        bool done = mon.run(10000);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        printf("scan %d: %s in %.1f ms, %zu requests, %zu coordinator lookups\n", round, done ? "done" : "timeout",
+                ms, mon.requests(), mon.coordinatorLookups());
+    }
+
+    std::vector<LagMonitor::Row> rows;
+    mon.table(rows);
+    for(auto& row : rows) {
+        printf("group:%s, topic:%s, partition:%d, committed:%ld, logend:%ld, lag:%ld, errcode:%d\n",
+                row.groupid->c_str(), row.topic.c_str(), row.parn, row.committed, row.logEnd, row.lag, row.errcode);
+    }
+    for(auto& g : groups)
+        printf("group:%s, total lag:%ld\n", g.first.c_str(), mon.groupLag(g.first));
+    return 0;
+}
@@ -0,0 +1,63 @@
+#include "../SegmentReader.h"
+
+#include <chrono>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace kafkaprotocpp;
+
+// Reads a log segment copied off a broker, no broker needed.
+// usage: ./segment_dump path/00000000000000000000.log [offset | @timestampMs] [-q]
+//   -q only counts the records and reports the read rate
+int main(int argc, char**argv)
+{
+    if(argc < 2) {
+        printf("usage: ./segment_dump path/00000000000000000000.log [offset | @timestampMs] [-q]\n");
+        return -1;
+    }
+
+    bool quiet = false;
+    const char* from = NULL;
+    for(int i = 2; i < argc; ++i) {
+        if(strcmp(argv[i], "-q") == 0)
+            quiet = true;
+        else
+            from = argv[i];
+    }
+
+    SegmentReader seg;
+    if(seg.open(argv[1]) < 0) {
+        printf("open %s failed: %s\n", argv[1], strerror(errno));
+        return -1;
+    }
+    printf("base offset:%ld, size:%zu, index:%s, timeindex:%s\n", seg.baseOffset(), seg.size(),
+            seg.hasIndex() ? "yes" : "no", seg.hasTimeIndex() ? "yes" : "no");
+
+    int64_t minOffset = -1;
+    size_t pos = 0;
+    if(from && from[0] == '@') {
+        pos = seg.positionForTime(atoll(from + 1));
+    } else if(from) {
+        minOffset = atoll(from);
+        pos = seg.position(minOffset);
+    }
+    printf("start position:%zu\n", pos);
+
+    auto start = std::chrono::steady_clock::now();
+    size_t records = 0, bytes = 0;
+    for(const RecordView& r : seg.records(pos)) {
+        if(r.offset < minOffset)
+            continue;
+        ++records;
+        bytes += (r.keyLen > 0 ? r.keyLen : 0) + (r.valueLen > 0 ? r.valueLen : 0);
+        if(!quiet)
+            printf("offset:%ld, timestamp:%ld, key:%d bytes, value:%d bytes, headers:%d\n", r.offset, r.timestamp,
+                    r.keyLen, r.valueLen, r.headerCount);
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    printf("%zu records, %zu key/value bytes in %.1f ms, %.1f MB/s of log\n", records, bytes, ms,
+            (seg.size() - pos) / (1024.0 * 1024.0) / (ms / 1000.0));
+    return 0;
+}